@@ -1,43 +0,0 @@
-#version 410
-
-layout (location = 0) in vec3 v_fragPos;
-
-layout (location = 0) out vec4 f_color;
-
-uniform samplerCube u_cubemap;
-
-const float c_maxHdrValue = 20.0;
-
-const float PI = 3.14159265359;
-
-void main()
-{
-    vec3 normal = normalize(v_fragPos);
-
-    vec3 irradiance = vec3(0.0);
-
-    vec3 up    = vec3(0.0, 1.0, 0.0);
-    vec3 right = normalize(cross(up, normal));
-    up         = normalize(cross(normal, right));
-
-    float sampleDelta = 0.025;
-    float nrSamples = 0.0;
-    for(float phi = 0.0; phi < 2.0 * PI; phi += sampleDelta)
-    {
-        for(float theta = 0.0; theta < 0.5 * PI; theta += sampleDelta)
-        {
-            // spherical to cartesian (in tangent space)
-            vec3 tangentSample = vec3(sin(theta) * cos(phi),  sin(theta) * sin(phi), cos(theta));
-            // tangent space to world
-            vec3 sampleVec = tangentSample.x * right + tangentSample.y * up + tangentSample.z * normal;
-
-            vec3 sampleColor = texture(u_cubemap, sampleVec).rgb;
-            sampleColor = min(sampleColor, vec3(c_maxHdrValue));
-            irradiance += sampleColor * cos(theta) * sin(theta);
-            nrSamples++;
-        }
-    }
-    irradiance = PI * irradiance * (1.0 / float(nrSamples));
-
-    f_color = vec4(irradiance, 1.0);
-}
\ No newline at end of file
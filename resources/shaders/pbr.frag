@@ -32,13 +32,16 @@ uniform float u_metallicFactor;
 uniform float u_roughnessFactor;
 uniform float u_normalScale;
 uniform vec3 u_emissiveFactor;
-uniform samplerCube u_irradianceMap;
 uniform samplerCube u_prefilterMap;
 uniform sampler2D   u_brdfLUT;
 
 uniform vec3 u_cameraPosition;
 uniform vec3 u_sunDirection;
 
+layout(std140) uniform FrameData {
+    vec4 u_irradianceSH[9]; // Spherical harmonics of the diffuse environment light, see IrradianceSH
+};
+
 struct DirectionalLight {
     vec3 direction;
     vec3 color;
@@ -80,9 +83,11 @@ vec3 getNormal()
     }
 
 #ifdef HAS_NORMALMAP
-    vec3 tangentNormal = texture(u_normalMap, v_texCoords[u_normalTexCoordIndex]).rgb;
-    tangentNormal = (tangentNormal * 2.0) - 1.0; // make it [-1, 1]
-    tangentNormal *= u_normalScale;
+    // Normal maps are stored as two channels, z is rebuilt from the unit length
+    vec3 tangentNormal;
+    tangentNormal.xy = texture(u_normalMap, v_texCoords[u_normalTexCoordIndex]).rg * 2.0 - 1.0; // make it [-1, 1]
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
+    tangentNormal.xy *= u_normalScale;
     tangentNormal = normalize(tangentNormal);
 
     vec3 finalNormal = normalize(TBN * tangentNormal);
@@ -97,6 +102,21 @@ vec3 getNormal()
     return finalNormal;
 }
 
+vec3 irradianceSH(vec3 n)
+{
+    vec3 irradiance = u_irradianceSH[0].rgb
+        + u_irradianceSH[1].rgb * n.y
+        + u_irradianceSH[2].rgb * n.z
+        + u_irradianceSH[3].rgb * n.x
+        + u_irradianceSH[4].rgb * (n.x * n.y)
+        + u_irradianceSH[5].rgb * (n.y * n.z)
+        + u_irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + u_irradianceSH[7].rgb * (n.x * n.z)
+        + u_irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+    // Nine terms cannot follow sharp lights, they ring below zero on the opposite side
+    return max(irradiance, vec3(0.0));
+}
+
 vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
 {
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
@@ -137,9 +157,9 @@ void main()
     vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
 
     vec2 envBRDF = texture(u_brdfLUT, vec2(NdotV, roughness)).rg;
-    // 4. Sample IBL (Cubemap)
-    // Irradiance: Blurry map for diffuse (High mip level)
-    vec3 irradiance = texture(u_irradianceMap, N).rgb;
+    // 4. Sample IBL
+    // Irradiance: Evaluated from its spherical harmonics
+    vec3 irradiance = irradianceSH(N);
     // Prefilter: Sharp-to-blurry map for reflections based on roughness
     vec3 prefilteredColor = textureLod(u_prefilterMap, R, roughness * 4.0).rgb;
 
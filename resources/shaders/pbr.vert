@@ -16,7 +16,21 @@ layout (location = 4) out vec4 v_color0;
 layout (location = 5) out vec2 v_texCoords[2];
 
 uniform mat4 u_projectionView;
+#ifdef HAS_VERTEX_ANIMATION
 uniform mat4 u_transform;
+uniform sampler2D u_vertexAnimation; // Baked position and normal of every vertex, frame after frame
+uniform samplerBuffer u_instances; // Per instance: the 3 first rows of its transform, then its time offset
+uniform int u_vertexAnimationOffset;
+uniform int u_vertexAnimationVertexCount;
+uniform int u_vertexAnimationFrameCount;
+uniform float u_vertexAnimationDuration;
+uniform float u_time;
+#else
+layout(std140) uniform DrawData {
+    mat4 u_transform;
+    mat3 u_normalMatrix; // transpose(inverse(mat3(u_transform))), computed on the CPU
+};
+#endif
 uniform vec3 u_viewPos;
 uniform vec3 u_lightPos;
 #ifdef HAS_SKIN
@@ -25,6 +39,52 @@ layout(std140) uniform JointMatrices {
 };
 #endif
 
+#ifdef HAS_VERTEX_ANIMATION
+vec4 fetchVertexAnimation(int frame, int texel)
+{
+    int index = 2 * (frame * u_vertexAnimationVertexCount + gl_VertexID + u_vertexAnimationOffset) + texel;
+    int width = textureSize(u_vertexAnimation, 0).x;
+    return texelFetch(u_vertexAnimation, ivec2(index % width, index / width), 0);
+}
+
+void main()
+{
+    int instance = gl_InstanceID * 4;
+    mat4 instanceTransform = transpose(mat4(
+        texelFetch(u_instances, instance),
+        texelFetch(u_instances, instance + 1),
+        texelFetch(u_instances, instance + 2),
+        vec4(0.0, 0.0, 0.0, 1.0)
+    ));
+    float timeOffset = texelFetch(u_instances, instance + 3).x;
+
+    float frame = fract((u_time + timeOffset) / u_vertexAnimationDuration) * float(u_vertexAnimationFrameCount);
+    int frame0 = min(int(frame), u_vertexAnimationFrameCount - 1);
+    int frame1 = (frame0 + 1) % u_vertexAnimationFrameCount;
+    float t = fract(frame);
+
+    vec3 position = mix(fetchVertexAnimation(frame0, 0).xyz, fetchVertexAnimation(frame1, 0).xyz, t);
+    vec3 normal = mix(fetchVertexAnimation(frame0, 1).xyz, fetchVertexAnimation(frame1, 1).xyz, t);
+
+    mat4 transform = u_transform * instanceTransform;
+    vec4 worldPosition = transform * vec4(position, 1.0);
+
+    gl_Position = u_projectionView * worldPosition;
+    v_position = vec3(worldPosition);
+
+    // Crowd instances are only rotated and uniformly scaled, so mat3(transform) transforms normals up to a scale
+    mat3 transform3 = mat3(transform);
+    v_normal = normalize(transform3 * normal);
+
+    // Tangents are not baked, crowd programs are built without normal maps
+    v_tangent = vec4(0.0);
+
+    v_texCoords[0] = a_texCoords0;
+    v_texCoords[1] = a_texCoords1;
+
+    v_color0 = a_color0;
+}
+#else
 void main()
 {
 #ifdef HAS_SKIN
@@ -52,11 +112,13 @@ void main()
     );
 
     mat3 transform3 = mat3(u_transform);
+    mat3 normalMatrix = u_normalMatrix;
 #ifdef HAS_SKIN
     transform3 *= mat3(skinMatrix);
+    // Joints may be scaled non-uniformly, and the blend of several joints is not a rotation anyway
+    normalMatrix = transpose(inverse(transform3));
 #endif
 
-    mat3 normalMatrix = transpose(inverse(transform3)); // TODO pass normal matrix as argument
     v_normal = normalize(normalMatrix * a_normal);
 
     v_tangent.xyz = normalize(transform3 * a_tangent.xyz);
@@ -67,3 +129,4 @@ void main()
 
     v_color0 = a_color0;
 }
+#endif
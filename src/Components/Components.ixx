@@ -6,6 +6,7 @@ export module Components;
 
 export import :CameraController;
 export import :Animator;
+export import :CrowdRenderer;
 export import :ImguiSingleton;
 export import :MapController;
 export import :MeshRenderer;
@@ -8,51 +8,109 @@ module;
 
 module Components;
 import std;
+import glm;
 import Engine;
-import Engine.AnimationChannel;
+import Engine.AnimationLod;
+import Engine.PoseCache;
+import Time;
 
 Animator::Animator(Object &object, const Model &mesh): Component(object), m_mesh(mesh)
 {
-    m_nodeTransforms.resize(mesh.renderInfo().nodesCount);
+}
+
+auto Animator::selectLod(Engine &engine) -> const AnimationLodTier *
+{
+    const auto &renderInfo = m_mesh.renderInfo();
+    const auto &settings = engine.animationLod();
+    const Camera *camera = engine.getCamera();
+
+    if (camera == nullptr || renderInfo.boundsRadius <= 0)
+        return &settings.tiers.front();
+
+    const glm::mat4 world = object().worldTransform();
+    const glm::vec3 center = world * glm::vec4(renderInfo.boundsCenter, 1.0f);
+    const float scale = std::max({
+        glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))
+    });
+    const float radius = renderInfo.boundsRadius * scale;
+
+    if (settings.freezeOffscreen && !engine.frustum().intersectsSphere(center, radius))
+        return nullptr;
+
+    // The camera may be parented, e.g. to the player, its local translation is not its position
+    Object &cameraObject = engine.objects()[camera->object().index];
+    const float distance = glm::length(glm::vec3(cameraObject.worldTransform()[3]) - center);
+    return &settings.tier(distance / radius);
 }
 
 void Animator::onUpdate(Engine &engine)
 {
+    const DurationType deltaTime = engine.frameInfo().deltaTime;
+
     if (m_animationChanged)
     {
         m_timeSinceAnimationStart = DurationType::zero();
         m_animationChanged = false;
-        std::fill(m_nodeTransforms.begin(), m_nodeTransforms.end(), AnimatedTransform{});
+        m_cursors.assign(m_currentAnimationIndex < 0 ? 0 : animations()[m_currentAnimationIndex].samplersCount(), {});
     } else
     {
-        m_timeSinceAnimationStart += engine.frameInfo().deltaTime;
+        m_timeSinceAnimationStart += deltaTime;
+    }
+
+    if (m_previousAnimationIndex >= 0)
+    {
+        m_previousTime += deltaTime;
+        m_fadeElapsed += deltaTime;
+        if (m_fadeElapsed >= m_fadeDuration)
+            m_previousAnimationIndex = -1;
     }
 
     if (m_currentAnimationIndex < 0)
+    {
+        m_pose = nullptr;
         return;
+    }
+
+    auto &poseCache = engine.poseCache();
+    const AnimationLodTier *lod = selectLod(engine);
+
+    // Offscreen, keep the last pose as long as it is still cached (acquired during the previous frame)
+    if (lod == nullptr && m_pose != nullptr && m_poseFrame + 1 == poseCache.frame())
+    {
+        m_pose = &poseCache.retain(*m_pose);
+        m_poseFrame = poseCache.frame();
+        return;
+    }
+    if (lod == nullptr)
+        lod = &engine.animationLod().tiers.back();
+
+    m_poseFrame = poseCache.frame();
 
     const Animation &animation = m_mesh.animations()[m_currentAnimationIndex];
 
-    const float animationTime = fmodf(m_timeSinceAnimationStart.count(), animation.duration());
+    const PoseLayer layer{
+        .animation = &animation,
+        .time = fmodf(m_timeSinceAnimationStart.count(), animation.duration()),
+        .cursors = m_cursors,
+    };
 
-    for (int i = 0; i < animation.channelsCount(); ++i)
+    if (m_previousAnimationIndex < 0)
     {
-        auto &channel = animation.channel(i);
-        auto &nodeTransform = m_nodeTransforms[channel.node];
-
-        switch (channel.type)
-        {
-            case AnimationChannelType::Translation:
-                nodeTransform.translation = animation.sampler(channel.sampler).vec3(animationTime);
-                break;
-            case AnimationChannelType::Rotation:
-                nodeTransform.rotation = animation.sampler(channel.sampler).quat(animationTime);
-                break;
-            case AnimationChannelType::Scale:
-                nodeTransform.scale = animation.sampler(channel.sampler).vec3(animationTime);
-                break;
-            default:
-                assert(false);
-        }
+        if (lod->updatePeriod > 0)
+            m_pose = &poseCache.acquireInterpolated(m_mesh.renderInfo(), layer, lod->updatePeriod, lod->reducedSkeleton);
+        else
+            m_pose = &poseCache.acquire(m_mesh.renderInfo(), layer, lod->reducedSkeleton);
+        return;
     }
+
+    const Animation &previousAnimation = m_mesh.animations()[m_previousAnimationIndex];
+
+    const PoseLayer previousLayer{
+        .animation = &previousAnimation,
+        .time = fmodf(m_previousTime.count(), previousAnimation.duration()),
+        .cursors = m_previousCursors,
+    };
+
+    m_pose = &poseCache.acquire(m_mesh.renderInfo(), previousLayer, layer, m_fadeElapsed / m_fadeDuration,
+                                lod->reducedSkeleton);
 }
@@ -7,18 +7,13 @@ import std.compat;
 import glm;
 import Engine;
 import Engine.Animation;
+import Engine.AnimationLod;
+import Engine.AnimationSampler;
+import Engine.PoseCache;
 import Time;
 
 export class Animator final : public Component
 {
-public:
-    struct AnimatedTransform
-    {
-        std::optional<glm::vec3> translation;
-        std::optional<glm::quat> rotation;
-        std::optional<glm::vec3> scale;
-    };
-
 private:
     bool m_animationChanged{false};
     int m_currentAnimationIndex{-1};
@@ -26,12 +21,27 @@ private:
 
     const Model & m_mesh;
 
-    std::vector<AnimatedTransform> m_nodeTransforms;
+    const Pose * m_pose{nullptr};
+    std::uint64_t m_poseFrame{0};
+    std::vector<AnimationSampler::Cursor> m_cursors;
+
+    // Animation faded out during a cross fade
+    int m_previousAnimationIndex{-1};
+    DurationType m_previousTime{DurationType::zero()};
+    std::vector<AnimationSampler::Cursor> m_previousCursors;
+    DurationType m_fadeDuration{DurationType::zero()};
+    DurationType m_fadeElapsed{DurationType::zero()};
 
 public:
     explicit
     Animator(Object & object, const Model & mesh);
 
+    /**
+     * Pick the LOD tier from the distance to the camera. Returns nullptr when the model is outside the camera
+     * frustum.
+     */
+    auto selectLod(Engine & engine) -> const AnimationLodTier *;
+
     auto onUpdate(Engine & engine) -> void override;
 
     auto setAnimation(const int index) -> void
@@ -40,11 +50,35 @@ public:
             throw std::out_of_range("Animation index is invalid");
         m_currentAnimationIndex = index;
         m_animationChanged = true;
+        m_previousAnimationIndex = -1;
+    }
+
+    /**
+     * Start index from its beginning while the current animation keeps playing and fades out over duration.
+     */
+    auto crossFade(const int index, const DurationType duration) -> void
+    {
+        const int previousIndex = m_currentAnimationIndex;
+        const DurationType previousTime = m_timeSinceAnimationStart;
+
+        setAnimation(index);
+        if (previousIndex < 0 || index < 0 || duration <= DurationType::zero())
+            return;
+
+        m_previousAnimationIndex = previousIndex;
+        m_previousTime = previousTime;
+        std::swap(m_previousCursors, m_cursors);
+        m_fadeDuration = duration;
+        m_fadeElapsed = DurationType::zero();
     }
 
-    [[nodiscard]] auto nodeTransform(const int node) const -> const AnimatedTransform &
+    /**
+     * Pose shared with the instances playing the same animation at the same time, null without animation. Acquired
+     * during update and valid for the current frame only.
+     */
+    [[nodiscard]] auto pose() const -> const Pose *
     {
-        return m_nodeTransforms[node];
+        return m_pose;
     }
 
     [[nodiscard]] auto mesh() const -> const Model &
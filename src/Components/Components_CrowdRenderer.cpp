@@ -0,0 +1,105 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+module Components;
+import std;
+import glm;
+import Engine;
+import Engine.VertexAnimation;
+import OpenGL;
+
+auto CrowdRenderer::addInstance(const glm::mat4 & transform, const float timeOffset) -> void
+{
+    const glm::mat4 rows = glm::transpose(transform);
+    m_instances.push_back({
+        .transformRows = {rows[0], rows[1], rows[2]},
+        .timeOffset = glm::vec4(timeOffset, 0, 0, 0),
+    });
+    m_instancesDirty = true;
+}
+
+auto CrowdRenderer::uploadInstances(Engine & engine) -> void
+{
+    if (m_instanceBuffer == 0)
+    {
+        m_stateCache = &engine.stateCache();
+        glGenBuffers(1, &m_instanceBuffer);
+        glGenTextures(1, &m_instanceTexture);
+
+        engine.bindTextureBuffer(InstancesUnit, m_instanceTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instanceBuffer);
+    }
+
+    engine.bindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(m_instances.size() * sizeof(InstanceData)),
+                 m_instances.data(), GL_STATIC_DRAW);
+
+    m_instancesDirty = false;
+}
+
+auto CrowdRenderer::onRender(Engine & engine) -> void
+{
+    if (m_instances.empty())
+        return;
+
+    if (m_instancesDirty)
+        uploadInstances(engine);
+
+    const auto & renderInfo = m_mesh.renderInfo();
+    const glm::mat4 transform = object().worldTransform();
+    // Wrapped here so the float time keeps its precision in long sessions
+    const float time = std::fmod(engine.frameInfo().time.count(), m_animation.duration());
+
+    if (engine.polygonMode() != GL_FILL)
+        engine.setPolygoneMode(GL_FILL);
+
+    engine.bindTexture(VertexAnimationUnit, m_animation.texture().id());
+    engine.bindTextureBuffer(InstancesUnit, m_instanceTexture);
+
+    for (const auto & draw: m_animation.draws())
+    {
+        const auto & primitive = renderInfo.meshes[draw.mesh].primitives[draw.primitive];
+
+        engine.bindVertexArray(engine.getGeometryArena(primitive.vertexArrayFlags).vertexArray());
+
+        glVertexAttrib4f(2, 1, 1, 1, 1); // Color0
+        glVertexAttrib2f(3, 0, 0); // TexCoord0
+        glVertexAttrib2f(4, 0, 0); // TexCoord1
+        glVertexAttrib4f(5, 0, 0, 0, 0); // Tangent
+
+        auto * readyProgram = engine.getShaderManager().getReadyProgram(draw.programIndex);
+        if (readyProgram == nullptr)
+            continue;
+
+        auto & program = *readyProgram;
+        engine.useProgram(program);
+
+        engine.bindCubemap(1, m_prefilterMap.id());
+        engine.bindTexture(2, m_brdfLUT.id());
+        program.setInt(Uniform::PrefilterMap, 1);
+        program.setInt(Uniform::BrdfLUT, 2);
+
+        MeshRenderer::bindMaterial(engine, program, m_mesh, primitive.material);
+
+        program.setInt(Uniform::VertexAnimation, VertexAnimationUnit);
+        program.setInt(Uniform::Instances, InstancesUnit);
+        program.setInt(Uniform::VertexAnimationOffset, draw.vertexOffset);
+        program.setInt(Uniform::VertexAnimationVertexCount, m_animation.vertexCount());
+        program.setInt(Uniform::VertexAnimationFrameCount, m_animation.frameCount());
+        program.setFloat(Uniform::VertexAnimationDuration, m_animation.duration());
+        program.setFloat(Uniform::Time, time);
+        program.setMat4(Uniform::Transform, transform);
+
+        glDrawElementsInstancedBaseVertex(primitive.mode,
+                                          primitive.geometry.indexCount,
+                                          GL_UNSIGNED_INT,
+                                          primitive.geometry.indexOffset(),
+                                          static_cast<GLsizei>(m_instances.size()),
+                                          primitive.geometry.baseVertex);
+    }
+}
@@ -0,0 +1,89 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module Components:CrowdRenderer;
+import std;
+import glm;
+import Engine;
+import Engine.VertexAnimation;
+import OpenGL;
+import OpenGL.Cubemap;
+import OpenGL.StateCache;
+import OpenGL.Texture2D;
+
+/**
+ * Draws many copies of a model playing a baked vertex animation, each primitive with a single instanced draw. Nothing
+ * is computed on the CPU per frame, instances only differ by their transform and time offset, read from a texture
+ * buffer as GL 4.1 has no storage buffers.
+ */
+export class CrowdRenderer final : public Component
+{
+public:
+    static constexpr GLuint VertexAnimationUnit = 7;
+    static constexpr GLuint InstancesUnit = 8;
+
+private:
+    /**
+     * Layout of an instance in the texture buffer, one RGBA32F texel per row.
+     */
+    struct InstanceData
+    {
+        glm::vec4 transformRows[3];
+        glm::vec4 timeOffset;
+    };
+
+    const Model & m_mesh;
+    const VertexAnimation & m_animation;
+    const OpenGL::Cubemap & m_prefilterMap;
+    const OpenGL::Texture2D & m_brdfLUT;
+
+    std::vector<InstanceData> m_instances;
+    OpenGL::StateCache * m_stateCache{nullptr}; // Set with the GL objects below, which it binds
+    GLuint m_instanceBuffer{0};
+    GLuint m_instanceTexture{0};
+    bool m_instancesDirty{false};
+
+    auto uploadInstances(Engine & engine) -> void;
+
+public:
+    CrowdRenderer(Object & object, const Model & model, const VertexAnimation & animation,
+                  const OpenGL::Cubemap & prefilterMap, const OpenGL::Texture2D & brdfLUT) : Component(object),
+        m_mesh(model), m_animation(animation), m_prefilterMap(prefilterMap), m_brdfLUT(brdfLUT)
+    {}
+
+    CrowdRenderer(const CrowdRenderer &) = delete;
+
+    auto operator=(const CrowdRenderer &) -> CrowdRenderer & = delete;
+
+    ~CrowdRenderer() override
+    {
+        if (m_stateCache != nullptr)
+        {
+            glDeleteTextures(1, &m_instanceTexture);
+            m_stateCache->invalidateTexture(m_instanceTexture);
+            glDeleteBuffers(1, &m_instanceBuffer);
+            m_stateCache->invalidateBuffer(m_instanceBuffer);
+        }
+    }
+
+    /**
+     * transform is relative to the object, it should only rotate and uniformly scale. timeOffset shifts the animation
+     * of this instance, in seconds.
+     */
+    auto addInstance(const glm::mat4 & transform, float timeOffset) -> void;
+
+    auto clearInstances() -> void
+    {
+        m_instances.clear();
+        m_instancesDirty = true;
+    }
+
+    [[nodiscard]] auto instancesCount() const -> size_t { return m_instances.size(); }
+
+    auto onRender(Engine & engine) -> void override;
+};
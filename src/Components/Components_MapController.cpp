@@ -9,8 +9,7 @@ import glm;
 import Engine;
 import OpenGL;
 
-static auto instantiatePlaneTwoTables(Engine & engine, const OpenGL::Cubemap & irradianceMap,
-                                      const OpenGL::Cubemap & prefilterMap,
+static auto instantiatePlaneTwoTables(Engine & engine, const OpenGL::Cubemap & prefilterMap,
                                       const OpenGL::Texture2D & brdfLUT) -> Object &
 {
     auto & floorMesh = engine.getModel("floor")->get();
@@ -19,7 +18,7 @@ static auto instantiatePlaneTwoTables(Engine & engine, const OpenGL::Cubemap & i
     // Floor
     auto & object = engine.instantiate();
     object.transform().setTranslation({0, 0, 5});
-    object.addComponent<MeshRenderer>(floorMesh, irradianceMap, prefilterMap, brdfLUT);
+    object.addComponent<MeshRenderer>(floorMesh, prefilterMap, brdfLUT);
 
     {
         // Desk
@@ -27,7 +26,7 @@ static auto instantiatePlaneTwoTables(Engine & engine, const OpenGL::Cubemap & i
         subObject.transform().scale(0.004f);
         subObject.transform().setTranslation({-2, 0, 5});
         subObject.transform().setRotation(glm::quat({0, glm::radians(90.0f), 0}));
-        subObject.addComponent<MeshRenderer>(deskMesh, irradianceMap, prefilterMap, brdfLUT);
+        subObject.addComponent<MeshRenderer>(deskMesh, prefilterMap, brdfLUT);
         subObject.setParent(object);
     }
 
@@ -37,7 +36,7 @@ static auto instantiatePlaneTwoTables(Engine & engine, const OpenGL::Cubemap & i
         subObject.transform().scale(0.004f);
         subObject.transform().setTranslation({2, 0, 2});
         subObject.transform().setRotation(glm::quat({0, glm::radians(90.0f), 0}));
-        subObject.addComponent<MeshRenderer>(deskMesh, irradianceMap, prefilterMap, brdfLUT);
+        subObject.addComponent<MeshRenderer>(deskMesh, prefilterMap, brdfLUT);
         subObject.setParent(object);
     }
     return object;
@@ -49,7 +48,7 @@ auto MapController::onUpdate(Engine & engine) -> void
     {
         for (int i = 0; i < 8; ++i)
         {
-            auto & segment = instantiatePlaneTwoTables(engine, m_irradianceMap, m_prefilterMap, m_brdfLUT);
+            auto & segment = instantiatePlaneTwoTables(engine, m_prefilterMap, m_brdfLUT);
             segment.setActive(false);
             m_segmentsPool.emplace(segment);
         }
@@ -23,7 +23,6 @@ private:
     std::queue<std::reference_wrapper<Object>> m_segmentsPool;
     std::deque<std::reference_wrapper<Object>> m_movingSegments;
 
-    const OpenGL::Cubemap& m_irradianceMap;
     const OpenGL::Cubemap& m_prefilterMap;
     const OpenGL::Texture2D& m_brdfLUT;
 
@@ -35,8 +34,8 @@ private:
     }
 
 public:
-    explicit MapController(Object& object, const OpenGL::Cubemap& irradianceMap, const OpenGL::Cubemap& prefilterMap, const OpenGL::Texture2D& brdfLUT) :
-        Component(object), m_irradianceMap(irradianceMap), m_prefilterMap(prefilterMap), m_brdfLUT(brdfLUT) {}
+    explicit MapController(Object& object, const OpenGL::Cubemap& prefilterMap, const OpenGL::Texture2D& brdfLUT) :
+        Component(object), m_prefilterMap(prefilterMap), m_brdfLUT(brdfLUT) {}
 
     auto onUpdate(Engine& engine) -> void override;
 };
@@ -10,19 +10,78 @@ module Components;
 import std;
 import glm;
 import Engine;
+import Engine.PoseCache;
 import Engine.RenderInfo;
 import OpenGL;
 
-auto MeshRenderer::renderMesh(Engine & engine, const int meshIndex, const glm::mat4 & transform) -> void
+auto MeshRenderer::bindMaterial(Engine & engine, ShaderProgram & program, const Model & model,
+                                const MaterialIndex materialIndex) -> void
+{
+    if (materialIndex >= 0)
+    {
+        const auto & material = model.renderInfo().materials[materialIndex];
+
+        engine.setDoubleSided(material.doubleSided);
+        engine.setBlendEnabled(material.blend);
+
+        if (material.pbr.baseColorTexture.index >= 0)
+        {
+            engine.bindTexture(3, model.texture(material.pbr.baseColorTexture.index));
+            program.setInt(Uniform::BaseColorTexture, 3);
+            program.setUint(Uniform::BaseColorTexCoordIndex, material.pbr.baseColorTexture.texCoord);
+        }
+
+        if (material.pbr.metallicRoughnessTexture.index >= 0)
+        {
+            engine.bindTexture(4, model.texture(material.pbr.metallicRoughnessTexture.index));
+            program.setInt(Uniform::MetallicRoughnessMap, 4);
+            program.setUint(Uniform::MetallicRoughnessTexCoordIndex,
+                            material.pbr.metallicRoughnessTexture.texCoord);
+        }
+
+        if (material.normalTexture.index >= 0)
+        {
+            engine.bindTexture(5, model.texture(material.normalTexture.index));
+            program.setInt(Uniform::NormalMap, 5);
+            program.setUint(Uniform::NormalTexCoordIndex, material.normalTexture.texCoord);
+        }
+
+        if (material.emissiveTexture.index >= 0)
+        {
+            engine.bindTexture(6, model.texture(material.emissiveTexture.index));
+            program.setInt(Uniform::EmissiveMap, 6);
+            program.setUint(Uniform::EmissiveTexCoordIndex, material.emissiveTexture.texCoord);
+        }
+
+        program.setVec4(Uniform::BaseColorFactor, material.pbr.baseColorFactor);
+        program.setFloat(Uniform::MetallicFactor, material.pbr.metallicFactor);
+        program.setFloat(Uniform::RoughnessFactor, material.pbr.roughnessFactor);
+        program.setFloat(Uniform::NormalScale, material.normalTexture.scale);
+        program.setVec3(Uniform::EmissiveFactor, material.emissiveFactor);
+    }
+    else
+    {
+        engine.setDoubleSided(false);
+        engine.setBlendEnabled(false);
+        program.setVec4(Uniform::BaseColorFactor, glm::vec4(1));
+        program.setFloat(Uniform::MetallicFactor, 1);
+        program.setFloat(Uniform::RoughnessFactor, 1);
+        program.setFloat(Uniform::NormalScale, 1);
+        program.setVec3(Uniform::EmissiveFactor, glm::vec3(0));
+    }
+}
+
+auto MeshRenderer::renderMesh(Engine & engine, const int meshIndex, const RingAllocation & drawData) -> void
 {
     const auto & meshRenderInfo = m_mesh.renderInfo().meshes[meshIndex];
 
-    for (int p = 0; p < meshRenderInfo.primitivesCount; ++p)
+    engine.bindUniformBlock(UniformBlockBinding::DrawData, drawData);
+
+    for (const auto & batch: meshRenderInfo.batches)
     {
-        const auto & primitiveRenderInfo = meshRenderInfo.primitives[p];
+        const auto & primitiveRenderInfo = meshRenderInfo.primitives[batch.primitive];
 
-        auto & vertexArray = engine.getVertexArray(primitiveRenderInfo.vertexArrayFlags);
-        engine.bindVertexArray(vertexArray);
+        engine.bindVertexArray(engine.getGeometryArena(primitiveRenderInfo.vertexArrayFlags).vertexArray());
 
         glVertexAttrib3f(1, 0, 0, 0); // Normal
         glVertexAttrib4f(2, 1, 1, 1, 1); // Color0
@@ -30,121 +89,37 @@ auto MeshRenderer::renderMesh(Engine & engine, const int meshIndex, const glm::m
         glVertexAttrib2f(4, 0, 0); // TexCoord1
         glVertexAttrib4f(5, 0, 0, 0, 0); // Tangent
 
-        for (const auto & attribute: primitiveRenderInfo.attributes)
-        {
-            const auto & accessorRenderInfo = m_mesh.renderInfo().accessors[attribute.accessor];
-
-            const int attributeLocation = static_cast<int>(attribute.type);
-            if (attributeLocation != -1)
-            {
-                engine.bindBuffer(
-                    GL_ARRAY_BUFFER,
-                    *m_mesh.renderInfo().bufferViews[accessorRenderInfo.bufferView].glBuffer);
-
-                const bool isInteger = (accessorRenderInfo.componentType == GL_UNSIGNED_SHORT ||
-                                        accessorRenderInfo.componentType == GL_UNSIGNED_BYTE ||
-                                        accessorRenderInfo.componentType == GL_SHORT ||
-                                        accessorRenderInfo.componentType == GL_BYTE ||
-                                        accessorRenderInfo.componentType == GL_UNSIGNED_INT ||
-                                        accessorRenderInfo.componentType == GL_INT);
-
-                if (isInteger && !accessorRenderInfo.normalized)
-                {
-                    glVertexAttribIPointer(attributeLocation,
-                                           accessorRenderInfo.componentCount,
-                                           accessorRenderInfo.componentType,
-                                           accessorRenderInfo.byteStride,
-                                           bufferOffset(accessorRenderInfo.byteOffset));
-                }
-                else
-                {
-                    glVertexAttribPointer(attributeLocation,
-                                          accessorRenderInfo.componentCount,
-                                          accessorRenderInfo.componentType,
-                                          accessorRenderInfo.normalized,
-                                          accessorRenderInfo.byteStride,
-                                          bufferOffset(accessorRenderInfo.byteOffset));
-                }
-            }
-        }
+        auto * readyProgram = engine.getShaderManager().getReadyProgram(primitiveRenderInfo.programIndex);
+        if (readyProgram == nullptr)
+            continue;
 
-        auto & program = engine.getShaderManager().getProgram(primitiveRenderInfo.programIndex);
+        auto & program = *readyProgram;
         engine.useProgram(program);
 
-        program.setMat4("u_transform", transform);
-
-        engine.bindCubemap(0, m_irradianceMap.id());
         engine.bindCubemap(1, m_prefilterMap.id());
         engine.bindTexture(2, m_brdfLUT.id());
-        program.setInt("u_irradianceMap", 0);
-        program.setInt("u_prefilterMap", 1);
-        program.setInt("u_brdfLUT", 2);
+        program.setInt(Uniform::PrefilterMap, 1);
+        program.setInt(Uniform::BrdfLUT, 2);
+
+        bindMaterial(engine, program, m_mesh, primitiveRenderInfo.material);
 
-        if (primitiveRenderInfo.material >= 0)
+        if (batch.counts.size() == 1)
         {
-            const auto & material = m_mesh.renderInfo().materials[primitiveRenderInfo.material];
-
-            engine.setDoubleSided(material.doubleSided);
-            engine.setBlendEnabled(material.blend);
-
-            if (material.pbr.baseColorTexture.index >= 0)
-            {
-                engine.bindTexture(3, m_mesh.texture(material.pbr.baseColorTexture.index));
-                program.setInt("u_baseColorTexture", 3);
-                program.setUint("u_baseColorTexCoordIndex", material.pbr.baseColorTexture.texCoord);
-            }
-
-            if (material.pbr.metallicRoughnessTexture.index >= 0)
-            {
-                engine.bindTexture(4, m_mesh.texture(material.pbr.metallicRoughnessTexture.index));
-                program.setInt("u_metallicRoughnessMap", 4);
-                program.setUint("u_metallicRoughnessTexCoordIndex",
-                                material.pbr.metallicRoughnessTexture.texCoord);
-            }
-
-            if (material.normalTexture.index >= 0)
-            {
-                engine.bindTexture(5, m_mesh.texture(material.normalTexture.index));
-                program.setInt("u_normalMap", 5);
-                program.setUint("u_normalTexCoordIndex", material.normalTexture.texCoord);
-            }
-
-            if (material.emissiveTexture.index >= 0)
-            {
-                engine.bindTexture(6, m_mesh.texture(material.emissiveTexture.index));
-                program.setInt("u_emissiveMap", 6);
-                program.setUint("u_emissiveTexCoordIndex", material.emissiveTexture.texCoord);
-            }
-
-            program.setVec4("u_baseColorFactor", material.pbr.baseColorFactor);
-            program.setFloat("u_metallicFactor", material.pbr.metallicFactor);
-            program.setFloat("u_roughnessFactor", material.pbr.roughnessFactor);
-            program.setFloat("u_normalScale", material.normalTexture.scale);
-            program.setVec3("u_emissiveFactor", material.emissiveFactor);
+            glDrawElementsBaseVertex(primitiveRenderInfo.mode,
+                                     batch.counts[0],
+                                     GL_UNSIGNED_INT,
+                                     batch.indexOffsets[0],
+                                     batch.baseVertices[0]);
         }
         else
         {
-            engine.setDoubleSided(false);
-            engine.setBlendEnabled(false);
-            program.setVec4("u_baseColorFactor", glm::vec4(1));
-            program.setFloat("u_metallicFactor", 1);
-            program.setFloat("u_roughnessFactor", 1);
-            program.setFloat("u_normalScale", 1);
-            program.setVec3("u_emissiveFactor", glm::vec3(0));
+            glMultiDrawElementsBaseVertex(primitiveRenderInfo.mode,
+                                          batch.counts.data(),
+                                          GL_UNSIGNED_INT,
+                                          batch.indexOffsets.data(),
+                                          static_cast<GLsizei>(batch.counts.size()),
+                                          batch.baseVertices.data());
         }
-
-        assert(primitiveRenderInfo.indices >= 0); // TODO handle non indexed primitives
-
-        const auto & accessorRenderInfo = m_mesh.renderInfo().accessors[primitiveRenderInfo.indices];
-
-        engine.bindBuffer(
-            GL_ELEMENT_ARRAY_BUFFER,
-            *m_mesh.renderInfo().bufferViews[accessorRenderInfo.bufferView].glBuffer);
-
-        glDrawElements(primitiveRenderInfo.mode,
-                       static_cast<GLsizei>(accessorRenderInfo.count),
-                       accessorRenderInfo.componentType,
-                       bufferOffset(accessorRenderInfo.byteOffset));
     }
 }
 
@@ -152,8 +127,14 @@ auto MeshRenderer::renderNodeRecursive(Engine & engine, const int nodeIndex) ->
 {
     const NodeRenderInfo & node = m_mesh.renderInfo().nodes[nodeIndex];
 
-    if (node.mesh > -1)
-        renderMesh(engine, node.mesh, m_nodes[nodeIndex].globalTransform);
+    // Allocations are missing when the uniform ring is full, the mesh is skipped for this frame
+    if (node.mesh > -1 && m_nodes[nodeIndex].drawData.has_value()
+        && (node.skin == -1 || m_skins[node.skin].palette.has_value()))
+    {
+        if (node.skin > -1)
+            engine.bindUniformBlock(UniformBlockBinding::JointMatrices, *m_skins[node.skin].palette);
+        renderMesh(engine, node.mesh, *m_nodes[nodeIndex].drawData);
+    }
     for (int i = 0; i < node.childrenCount; ++i)
         renderNodeRecursive(engine, node.children[i]);
 }
@@ -169,13 +150,10 @@ auto MeshRenderer::calculateGlobalTransformsRecursive(const int nodeIndex, glm::
     else
     {
         const auto & trs = std::get<TRS>(node.transform);
-        const auto & animTRS = m_animator.has_value()
-                                   ? m_animator->get().nodeTransform(nodeIndex)
-                                   : Animator::AnimatedTransform{};
 
-        transform = glm::translate(transform, animTRS.translation.has_value() ? *animTRS.translation : trs.translation);
-        transform *= glm::gtc::mat4_cast(animTRS.rotation.has_value() ? *animTRS.rotation : trs.rotation);
-        transform = glm::scale(transform, animTRS.scale.has_value() ? *animTRS.scale : trs.scale);
+        transform = glm::translate(transform, trs.translation);
+        transform *= glm::gtc::mat4_cast(trs.rotation);
+        transform = glm::scale(transform, trs.scale);
     }
 
     m_nodes[nodeIndex].globalTransform = transform;
@@ -199,46 +177,110 @@ auto MeshRenderer::calculateJointMatrices(const int skinIndex, const glm::mat4 &
     }
 }
 
-void MeshRenderer::onRender(Engine & engine)
+/**
+ * Only touches this renderer and allocations reserved for it, so it can run on a worker while other instances are
+ * computed in parallel. Animated instances take their node transforms from the shared pose, which already holds the
+ * palettes.
+ */
+auto MeshRenderer::writeDrawData(UniformRing & uniformRing, const glm::mat4 & transform, const Pose * pose) -> void
 {
-    if (!displayed())
-        return;
+    const auto & renderInfo = m_mesh.renderInfo();
 
-    if (engine.polygonMode() != m_polygonMode)
-        engine.setPolygoneMode(m_polygonMode);
+    if (pose != nullptr)
+    {
+        for (int nodeIndex = 0; nodeIndex < renderInfo.nodesCount; ++nodeIndex)
+        {
+            if (m_nodes[nodeIndex].drawData.has_value())
+                m_nodes[nodeIndex].globalTransform = transform * pose->nodeTransforms[nodeIndex];
+        }
+    }
+    else
+    {
+        for (int i = 0; i < renderInfo.rootNodesCount; ++i)
+        {
+            calculateGlobalTransformsRecursive(renderInfo.rootNodes[i], transform);
+        }
 
-    const auto globalTransform = object().worldTransform();
+        for (int skinIndex = 0; skinIndex < renderInfo.skinsCount; ++skinIndex)
+        {
+            calculateJointMatrices(skinIndex, transform);
 
-    const auto & renderInfo = m_mesh.renderInfo();
+            const auto & skin = m_skins[skinIndex];
+            if (skin.palette.has_value())
+                std::memcpy(uniformRing.data(*skin.palette), skin.jointMatrices.data(), skin.palette->size);
+        }
+    }
 
-    for (int i = 0; i < renderInfo.rootNodesCount; ++i)
+    for (int nodeIndex = 0; nodeIndex < renderInfo.nodesCount; ++nodeIndex)
     {
-        calculateGlobalTransformsRecursive(renderInfo.rootNodes[i], globalTransform);
+        const auto & node = m_nodes[nodeIndex];
+        if (!node.drawData.has_value())
+            continue;
+
+        const auto normalMatrix = glm::transpose(glm::inverse(glm::mat3(node.globalTransform)));
+        const DrawData drawData{
+            .transform = node.globalTransform,
+            .normalMatrix = {
+                glm::vec4(normalMatrix[0], 0),
+                glm::vec4(normalMatrix[1], 0),
+                glm::vec4(normalMatrix[2], 0),
+            },
+        };
+        std::memcpy(uniformRing.data(*node.drawData), &drawData, sizeof(DrawData));
     }
+}
+
+void MeshRenderer::onPreRender(Engine & engine)
+{
+    if (!displayed())
+        return;
 
+    const auto & renderInfo = m_mesh.renderInfo();
+    auto & uniformRing = engine.uniformRing();
+    const Pose * pose = m_animator.has_value() ? m_animator->get().pose() : nullptr;
+
+    // Ring allocations are not thread safe, reserve everything here and only fill it in the job
     for (int skinIndex = 0; skinIndex < renderInfo.skinsCount; ++skinIndex)
     {
-        calculateJointMatrices(skinIndex, globalTransform);
+        auto & skin = m_skins[skinIndex];
+        if (pose != nullptr)
+            skin.palette = pose->palettes[skinIndex];
+        else
+            skin.palette = uniformRing.allocate(static_cast<GLsizeiptr>(skin.jointMatrices.size() * sizeof(glm::mat4)));
+    }
 
-        const auto jointsUBO = m_mesh.renderInfo().skins[skinIndex].glBuffer;
-        const GLuint uniformBlockBinding = skinIndex;
-        glBindBufferBase(GL_UNIFORM_BUFFER, uniformBlockBinding, jointsUBO);
+    for (int nodeIndex = 0; nodeIndex < renderInfo.nodesCount; ++nodeIndex)
+    {
+        m_nodes[nodeIndex].drawData = renderInfo.nodes[nodeIndex].mesh > -1
+                                          ? uniformRing.allocate(sizeof(DrawData))
+                                          : std::nullopt;
+    }
 
-        for (auto & program: engine.getShaderManager().getPrograms())
-        {
-            if ((engine.getShaderManager().getShader(program.vertexShaderIdx()).flags() & ShaderFlags::HasSkin) ==
-                ShaderFlags::HasSkin)
-            {
-                program.setUniformBlock("JointMatrices", uniformBlockBinding);
-            }
-        }
+    const auto globalTransform = object().worldTransform();
 
-        glBindBuffer(GL_UNIFORM_BUFFER, jointsUBO);
-        glBufferSubData(
-            GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(m_skins[skinIndex].jointMatrices.size() * sizeof(glm::mat4)),
-            m_skins[skinIndex].jointMatrices.data());
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    // Static meshes are cheap, only animated instances are worth a job
+    if (m_animator.has_value())
+    {
+        engine.workers().submit([this, &uniformRing, globalTransform, pose]
+        {
+            writeDrawData(uniformRing, globalTransform, pose);
+        });
     }
+    else
+    {
+        writeDrawData(uniformRing, globalTransform, pose);
+    }
+}
+
+void MeshRenderer::onRender(Engine & engine)
+{
+    if (!displayed())
+        return;
+
+    if (engine.polygonMode() != m_polygonMode)
+        engine.setPolygoneMode(m_polygonMode);
+
+    const auto & renderInfo = m_mesh.renderInfo();
 
     for (int i = 0; i < renderInfo.rootNodesCount; ++i)
     {
@@ -11,6 +11,8 @@ import std;
 import glm;
 import :Animator;
 import Engine;
+import Engine.PoseCache;
+import Engine.RenderInfo;
 import OpenGL;
 import OpenGL.Cubemap;
 import OpenGL.Texture2D;
@@ -21,32 +23,43 @@ private:
     struct Node
     {
         glm::mat4 globalTransform = glm::identity<glm::mat4>();
+        std::optional<RingAllocation> drawData;
     };
 
     struct Skin
     {
         std::vector<glm::mat4> jointMatrices;
+        std::optional<RingAllocation> palette;
+    };
+
+    /**
+     * std140 layout of the DrawData uniform block.
+     */
+    struct DrawData
+    {
+        glm::mat4 transform;
+        glm::vec4 normalMatrix[3]; // mat3 columns are padded to vec4 in std140
     };
 
     const Model& m_mesh;
     bool m_displayed{true};
     GLenum m_polygonMode{GL_FILL};
     std::optional<std::reference_wrapper<const Animator>> m_animator;
-    const OpenGL::Cubemap& m_irradianceMap;
     const OpenGL::Cubemap& m_prefilterMap;
     const OpenGL::Texture2D& m_brdfLUT;
 
     std::vector<Node> m_nodes;
     std::vector<Skin> m_skins;
 
-    auto renderMesh(Engine& engine, int meshIndex, const glm::mat4& transform) -> void;
+    auto renderMesh(Engine& engine, int meshIndex, const RingAllocation& drawData) -> void;
     auto renderNodeRecursive(Engine& engine, int nodeIndex) -> void;
     auto calculateGlobalTransformsRecursive(int nodeIndex, glm::mat4 transform) -> void;
     auto calculateJointMatrices(int skin, const glm::mat4& transform) -> void;
+    auto writeDrawData(UniformRing& uniformRing, const glm::mat4& transform, const Pose* pose) -> void;
 
 public:
-    explicit MeshRenderer(Object& object, const Model& model, const OpenGL::Cubemap& irradianceMap, const OpenGL::Cubemap& prefilterMap, const OpenGL::Texture2D& brdfLUT) :
-        Component(object), m_mesh(model), m_irradianceMap(irradianceMap), m_prefilterMap(prefilterMap), m_brdfLUT(brdfLUT)
+    explicit MeshRenderer(Object& object, const Model& model, const OpenGL::Cubemap& prefilterMap, const OpenGL::Texture2D& brdfLUT) :
+        Component(object), m_mesh(model), m_prefilterMap(prefilterMap), m_brdfLUT(brdfLUT)
     {
         m_nodes.resize(m_mesh.renderInfo().nodesCount);
         m_skins.resize(m_mesh.renderInfo().skinsCount);
@@ -59,6 +72,12 @@ public:
 
     [[nodiscard]] auto mesh() const -> const Model& { return m_mesh; }
 
+    /**
+     * Set the material uniforms and textures (units 3 to 6) of a primitive, materialIndex is -1 for the default one.
+     */
+    static auto bindMaterial(Engine& engine, ShaderProgram& program, const Model& model, MaterialIndex materialIndex)
+        -> void;
+
     auto setAnimator(const Animator& animator) -> void { m_animator = animator; }
     auto unsetAnimator() -> void { m_animator = std::nullopt; }
 
@@ -76,5 +95,6 @@ public:
 
     auto setPolygoneMode(const GLenum polygonMode) -> void { m_polygonMode = polygonMode; }
 
+    auto onPreRender(Engine& engine) -> void override;
     auto onRender(Engine& engine) -> void override;
 };
@@ -65,36 +65,39 @@ private:
     VertexArray m_vao;
     GLuint m_vbo;
     OpenGL::Cubemap& m_cubemap;
+    SlotSetIndex m_programIdx;
 
     void renderSkybox(Engine& engine)
     {
-        SlotSetIndex program = *engine.getShaderManager().getOrCreateShaderProgram(
-                *engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/skybox.vert"),
-            *engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/skybox.frag"), ShaderFlags::None);
+        auto& program = engine.getShaderManager().getProgram(m_programIdx);
 
         const auto pvMat = engine.getCamera()->projectionMatrix() * glm::mat4(glm::mat3(engine.getCamera()->computeViewMatrix()));
 
-        glDepthFunc(GL_LEQUAL);
+        engine.stateCache().depthFunc(GL_LEQUAL);
         engine.bindCubemap(0, m_cubemap.id());
         engine.setDepthMaskEnabled(false);
         engine.setDoubleSided(true);
 
-        engine.useProgram(engine.getShaderManager().getProgram(program));
-        engine.getShaderManager().getProgram(program).setInt("u_cubemap", 0);
-        engine.getShaderManager().getProgram(program).setMat4("u_projectionView", pvMat);
+        engine.useProgram(program);
+        program.setInt(Uniform::Cubemap, 0);
+        program.setMat4(Uniform::ProjectionView, pvMat);
         engine.bindVertexArray(m_vao);
         engine.bindBuffer(GL_ARRAY_BUFFER, m_vbo);
         glDrawArrays(GL_TRIANGLES, 0, 36);
         engine.setDepthMaskEnabled(true);
-        glDepthFunc(GL_LESS);
+        engine.stateCache().depthFunc(GL_LESS);
     }
 
 public:
     SkyboxRenderer(Object& object, Engine& engine, OpenGL::Cubemap& cubemap) :
         Component(object),
-        m_cubemap(cubemap)
+        m_cubemap(cubemap),
+        m_programIdx(*engine.getShaderManager().getOrCreateShaderProgram(
+            *engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/skybox.vert"),
+            *engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/skybox.frag"), ShaderFlags::None))
     {
         auto vao = VertexArray::Create(VertexArrayHasPosition);
+        engine.stateCache().invalidateVertexArray(); // Left bound by Create
         GLuint vertexBuffer;
         glGenBuffers(1, &vertexBuffer);
 
@@ -2,7 +2,272 @@
 // Created by scros on 2/22/26.
 //
 
+module;
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 module DataCache;
+
+namespace
+{
+    constexpr std::string_view CacheRoot = ".cache";
+    constexpr std::string_view IndexPath = ".cache/index";
+
+    auto now() -> std::int64_t
+    {
+        return std::filesystem::file_time_type::clock::now().time_since_epoch().count();
+    }
+
+    /**
+     * Write data to a temporary file next to path, then rename it over path. Cache files are mapped by this process
+     * and written by the cook tool, truncating one in place would tear it for readers, or fault their mapped pages.
+     * The temporary is named after the process so two writers never share it.
+     */
+    auto replaceFile(const std::filesystem::path & path,
+                     const std::span<const std::byte> data) -> std::expected<void, std::string>
+    {
+        auto temporary = path;
+        temporary += std::format(".{}.tmp", getpid());
+
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return std::unexpected<std::string>(std::in_place, "PermissionDenied");
+        }
+
+        file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.flush();
+        file.close();
+
+        std::error_code ec;
+        if (file.fail())
+        {
+            std::filesystem::remove(temporary, ec);
+            return std::unexpected<std::string>(std::in_place, "WriteError");
+        }
+
+        std::filesystem::rename(temporary, path, ec);
+        if (ec)
+        {
+            const auto error = mapError(ec);
+            std::filesystem::remove(temporary, ec);
+            return std::unexpected<std::string>(std::in_place, error);
+        }
+        return {};
+    }
+
+    /**
+     * Entries are named by their normalized path, only files under the cache root are tracked.
+     */
+    auto indexKey(const std::filesystem::path & path) -> std::optional<std::string>
+    {
+        auto key = path.lexically_normal().generic_string();
+        if (!key.starts_with(CacheRoot) || key.size() <= CacheRoot.size() || key[CacheRoot.size()] != '/'
+            || key == IndexPath)
+        {
+            return std::nullopt;
+        }
+        return key;
+    }
+
+    /**
+     * The directory is the truth, the index only remembers when each file was last used. Files it does not know,
+     * written before it existed or by another process, count as used when they were written. Writes and reads only
+     * update it in memory, it is saved by DataCache::saveIndex() and on exit.
+     */
+    class CacheIndex
+    {
+    private:
+        struct Entry
+        {
+            std::uintmax_t size;
+            std::int64_t lastUse;
+        };
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+        std::uintmax_t m_totalSize{0};
+        std::uintmax_t m_capacity{DataCache::DefaultCapacity};
+        bool m_loaded{false};
+        bool m_dirty{false};
+
+        auto load() -> void
+        {
+            if (m_loaded)
+                return;
+            m_loaded = true;
+
+            std::unordered_map<std::string, std::int64_t> lastUses;
+            std::ifstream file{std::string(IndexPath)};
+            std::int64_t lastUse;
+            std::uintmax_t size;
+            std::string key;
+            while (file >> lastUse >> size && std::getline(file >> std::ws, key))
+                lastUses[key] = lastUse;
+
+            std::error_code ec;
+            std::filesystem::recursive_directory_iterator it(CacheRoot, ec);
+            for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                std::error_code entryEc;
+                const auto fileKey = indexKey(it->path());
+                if (!fileKey || !it->is_regular_file(entryEc))
+                    continue;
+
+                const auto fileSize = it->file_size(entryEc);
+                const auto writeTime = it->last_write_time(entryEc);
+                if (entryEc)
+                    continue;
+
+                const auto found = lastUses.find(*fileKey);
+                m_entries[*fileKey] = {
+                    fileSize, found != lastUses.end() ? found->second : writeTime.time_since_epoch().count()
+                };
+                m_totalSize += fileSize;
+            }
+        }
+
+        auto save() -> void
+        {
+            std::string content;
+            for (const auto & [key, entry]: m_entries)
+                std::format_to(std::back_inserter(content), "{} {} {}\n", entry.lastUse, entry.size, key);
+
+            std::error_code ec;
+            std::filesystem::create_directories(CacheRoot, ec);
+            // Left dirty on failure, the next save retries
+            if (replaceFile(std::string(IndexPath), std::as_bytes(std::span(content))))
+                m_dirty = false;
+        }
+
+        auto evict(const std::string & keep) -> void
+        {
+            if (m_totalSize <= m_capacity)
+                return;
+
+            std::vector<std::pair<std::int64_t, std::string>> byLastUse;
+            byLastUse.reserve(m_entries.size());
+            for (const auto & [key, entry]: m_entries)
+            {
+                if (key != keep)
+                    byLastUse.emplace_back(entry.lastUse, key);
+            }
+            std::ranges::sort(byLastUse);
+
+            for (const auto & key: byLastUse | std::views::values)
+            {
+                if (m_totalSize <= m_capacity)
+                    break;
+
+                std::error_code ec;
+                std::filesystem::remove(key, ec);
+                if (ec)
+                    continue;
+                m_totalSize -= m_entries[key].size;
+                m_entries.erase(key);
+            }
+        }
+
+    public:
+        CacheIndex() = default;
+
+        CacheIndex(const CacheIndex &) = delete;
+
+        ~CacheIndex()
+        {
+            if (m_dirty)
+                save();
+        }
+
+        auto operator=(const CacheIndex &) -> CacheIndex & = delete;
+
+        auto setCapacity(const std::uintmax_t bytes) -> void
+        {
+            std::lock_guard lock(m_mutex);
+            m_capacity = bytes;
+        }
+
+        auto touch(const std::filesystem::path & path) -> void
+        {
+            const auto key = indexKey(path);
+            if (!key)
+                return;
+
+            std::lock_guard lock(m_mutex);
+            load();
+            if (const auto it = m_entries.find(*key); it != m_entries.end())
+            {
+                it->second.lastUse = now();
+                m_dirty = true;
+            }
+        }
+
+        auto insert(const std::filesystem::path & path, const std::uintmax_t size) -> void
+        {
+            const auto key = indexKey(path);
+            if (!key)
+                return;
+
+            std::lock_guard lock(m_mutex);
+            load();
+            auto & entry = m_entries[*key];
+            m_totalSize = m_totalSize - entry.size + size;
+            entry = {size, now()};
+
+            evict(*key);
+            m_dirty = true;
+        }
+
+        auto saveIfDirty() -> void
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_dirty)
+                save();
+        }
+    };
+
+    auto cacheIndex() -> CacheIndex &
+    {
+        static CacheIndex index;
+        return index;
+    }
+}
+
+auto CacheKey::addFile(const std::filesystem::path & path) -> std::expected<void, std::string>
+{
+    const auto oe_result = DataCache::mapFile(path);
+    if (!oe_result)
+    {
+        return std::unexpected(std::format("{} not found", path.string()));
+    }
+    if (!oe_result->has_value())
+    {
+        return std::unexpected(std::format("failed to read {}: {}", path.string(), oe_result->error()));
+    }
+
+    m_hash.add(oe_result->value().data());
+    return {};
+}
+
+auto DataCache::setCapacity(const std::uintmax_t bytes) -> void
+{
+    cacheIndex().setCapacity(bytes);
+}
+
+auto DataCache::saveIndex() -> void
+{
+    cacheIndex().saveIfDirty();
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<std::byte *>(m_data), m_size);
+}
+
 auto DataCache::writeFile(const std::filesystem::path & path,
                           const std::span<const std::byte> data) -> std::expected<void, std::string>
 {
@@ -16,18 +281,12 @@ auto DataCache::writeFile(const std::filesystem::path & path,
         }
     }
 
-    std::ofstream file(path, std::ios::binary);
-    if (!file)
-    {
-        return std::unexpected<std::string>(std::in_place, "PermissionDenied");
-    }
-
-    file.write(reinterpret_cast<const char *>(data.data()), data.size());
-    if (file.fail())
+    if (auto e_result = replaceFile(path, data); !e_result)
     {
-        std::unexpected<std::string>(std::in_place, "ReadError");
+        return e_result;
     }
 
+    cacheIndex().insert(path, data.size());
     return {};
 }
 
@@ -64,5 +323,47 @@ auto DataCache::readFile(
         return std::unexpected<std::string>(std::in_place, "ReadError");
     }
 
+    cacheIndex().touch(path);
     return buffer;
 }
+
+auto DataCache::mapFile(const std::filesystem::path & path) -> std::optional<std::expected<MappedFile, std::string> >
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            return std::nullopt;
+        }
+        return std::unexpected<std::string>(std::in_place, mapError(std::error_code(errno, std::generic_category())));
+    }
+
+    struct stat status{};
+    if (fstat(fd, &status) != 0)
+    {
+        const std::error_code ec(errno, std::generic_category());
+        close(fd);
+        return std::unexpected<std::string>(std::in_place, mapError(ec));
+    }
+
+    const auto size = static_cast<std::size_t>(status.st_size);
+    if (size == 0)
+    {
+        // Empty files cannot be mapped
+        close(fd);
+        return MappedFile();
+    }
+
+    void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const std::error_code ec(errno, std::generic_category());
+    close(fd); // The mapping keeps its own reference to the file
+    if (data == MAP_FAILED)
+    {
+        return std::unexpected<std::string>(std::in_place, mapError(ec));
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    cacheIndex().touch(path);
+    return MappedFile(static_cast<const std::byte *>(data), size);
+}
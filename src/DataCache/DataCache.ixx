@@ -7,6 +7,7 @@ module;
 
 export module DataCache;
 import std;
+import Utility.Hash;
 
 constexpr auto andThenWith(auto func)
 {
@@ -28,9 +29,95 @@ concept CacheDataSerializable = requires(const T & t, const std::vector<std::byt
     { T::deserialize(data) } -> std::same_as<std::expected<T, std::string> >;
 };
 
+/**
+ * Read-only mapping of a whole cache file, unmapped on destruction. Pages are read on first access, so the file is
+ * never copied to an intermediate buffer.
+ */
+export class MappedFile
+{
+private:
+    const std::byte * m_data{nullptr};
+    std::size_t m_size{0};
+
+public:
+    MappedFile() = default;
+
+    MappedFile(const std::byte * data, const std::size_t size) : m_data(data), m_size(size) {}
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile(MappedFile && other) noexcept : m_data(std::exchange(other.m_data, nullptr)),
+                                               m_size(std::exchange(other.m_size, 0))
+    {}
+
+    ~MappedFile();
+
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+    auto operator=(MappedFile && other) noexcept -> MappedFile &
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        return *this;
+    }
+
+    [[nodiscard]] auto data() const -> std::span<const std::byte> { return {m_data, m_size}; }
+};
+
+/**
+ * Name of a cache entry derived from everything it is computed from: source files, parameters and the version of its
+ * format. Changing any input names another entry, so nothing stale is ever read, and the old entry is left to the
+ * eviction of the cache index.
+ */
+export class CacheKey
+{
+private:
+    std::string m_kind;
+    StableHash m_hash;
+
+public:
+    /**
+     * kind names the directory and the extension of the entry. Bump version when the format of the entry changes.
+     */
+    CacheKey(const std::string_view kind, const std::uint32_t version) : m_kind(kind)
+    {
+        m_hash.add(kind).add(version);
+    }
+
+    template<class T>
+    auto add(const T & value) -> CacheKey &
+    {
+        m_hash.add(value);
+        return *this;
+    }
+
+    /**
+     * Hash the content of the file, not its path or modification time.
+     */
+    [[nodiscard]] auto addFile(const std::filesystem::path & path) -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto path() const -> std::filesystem::path
+    {
+        return std::format(".cache/{}/{:016x}.{}", m_kind, m_hash.value(), m_kind);
+    }
+};
+
+/**
+ * Files under .cache are tracked in .cache/index with their size and last use. When a write makes the cache larger
+ * than its capacity, the least recently used files are deleted.
+ */
 export class DataCache
 {
 public:
+    static constexpr std::uintmax_t DefaultCapacity = 2ull * 1024 * 1024 * 1024;
+
+    static auto setCapacity(std::uintmax_t bytes) -> void;
+
+    /**
+     * Save the index if it changed. Call it once a batch of writes is done, it is also saved on exit.
+     */
+    static auto saveIndex() -> void;
+
     [[nodiscard]]
     static auto writeFile(const std::filesystem::path & path,
                           std::span<const std::byte> data) -> std::expected<void, std::string>;
@@ -39,6 +126,12 @@ public:
     static auto readFile(
         const std::filesystem::path & path) -> std::optional<std::expected<std::vector<std::byte>, std::string> >;
 
+    /**
+     * Like readFile, without the copy. Access is hinted sequential, callers read the file front to back.
+     */
+    [[nodiscard]]
+    static auto mapFile(const std::filesystem::path & path) -> std::optional<std::expected<MappedFile, std::string> >;
+
     // template<CacheDataSerializable T>
     // static auto load(const std::filesystem::path & path) -> std::optional<std::expected<T, std::string> >
     // {
@@ -9,61 +9,203 @@ module;
 
 module Engine.Animation;
 
+import std.compat;
+import glm;
+import Engine.AnimationCompression;
+import Engine.LocalPose;
 import Engine.RenderInfo;
+import Utility.BinaryStream;
 
-auto Animation::initInputBuffer(const ModelRenderInfo & renderInfo, const AccessorIndex accessorIdx)
-    -> AnimationSampler::InputBuffer
+namespace
 {
-    const auto & accessor = renderInfo.accessors[accessorIdx];
-    assert(accessor.type == TINYGLTF_TYPE_SCALAR);
-    assert(accessor.componentType == GL_FLOAT);
-    const auto & bufferView = renderInfo.bufferViews[accessor.bufferView];
-    const auto & buffer = renderInfo.buffers[bufferView.buffer];
+    struct PendingTrack
+    {
+        AnimationSampler::Type type{AnimationSampler::Type::Vec3};
+        std::vector<float> times;
+        std::vector<std::array<uint16_t, 3>> values;
+        glm::vec3 rangeMin{0};
+        glm::vec3 rangeExtent{0};
+        AnimationSampler::Interpolation interpolation{AnimationSampler::Interpolation::Linear};
+    };
 
-    const size_t offset = bufferView.byteOffset + accessor.byteOffset;
-    constexpr size_t attributeSize = sizeof(GLfloat); // accessor.componentType MUST be GL_FLOAT
+    /**
+     * Samples between two keys of a cubic spline, enough for its linear fit to stay close to the curve between them.
+     */
+    constexpr size_t CubicSplineSubdivisions = 8;
 
-    const size_t length = accessor.byteStride * accessor.count;
-    assert(length > 0);
-    assert(accessor.byteOffset + length <= bufferView.byteLength);
+    template<class T>
+    auto keep(const std::vector<T> & values, const std::vector<size_t> & kept) -> std::vector<T>
+    {
+        std::vector<T> result;
+        result.reserve(kept.size());
+        for (const auto index: kept)
+            result.push_back(values[index]);
+        return result;
+    }
 
-    const auto data = reinterpret_cast<const GLfloat *>(buffer.data.data() + offset);
-    return {
-        .size = accessor.count,
-        .attributeStride = accessor.byteStride / sizeof(GLfloat),
-        .data = data,
-    };
+    auto everyKey(const size_t count) -> std::vector<size_t>
+    {
+        std::vector<size_t> kept(count);
+        std::iota(kept.begin(), kept.end(), size_t{0});
+        return kept;
+    }
+
+    /**
+     * Hermite curve of a glTF cubic spline sampler, whose output holds an in-tangent, a value and an out-tangent per
+     * key. Rotations are normalized after interpolating their components, as the glTF specification does.
+     */
+    template<class T>
+    auto sampleCubicSpline(std::vector<float> & times, const std::vector<T> & triplets) -> std::vector<T>
+    {
+        const auto normalized = [](const T & value)
+        {
+            if constexpr (std::is_same_v<T, glm::quat>)
+                return glm::normalize(value);
+            else
+                return value;
+        };
+
+        std::vector<float> sampledTimes;
+        std::vector<T> sampledValues;
+        sampledTimes.reserve((times.size() - 1) * CubicSplineSubdivisions + 1);
+        sampledValues.reserve(sampledTimes.capacity());
+
+        for (size_t key = 0; key + 1 < times.size(); ++key)
+        {
+            const float span = times[key + 1] - times[key];
+            const T & from = triplets[key * 3 + 1];
+            const T & to = triplets[(key + 1) * 3 + 1];
+            const T outTangent = triplets[key * 3 + 2] * span;
+            const T inTangent = triplets[(key + 1) * 3] * span;
+
+            for (size_t i = 0; i < CubicSplineSubdivisions; ++i)
+            {
+                const float t = static_cast<float>(i) / static_cast<float>(CubicSplineSubdivisions);
+                const float t2 = t * t;
+                const float t3 = t2 * t;
+
+                sampledTimes.push_back(times[key] + t * span);
+                sampledValues.push_back(normalized(from * (2 * t3 - 3 * t2 + 1) + outTangent * (t3 - 2 * t2 + t)
+                                                   + to * (3 * t2 - 2 * t3) + inTangent * (t3 - t2)));
+            }
+        }
+        sampledTimes.push_back(times.back());
+        sampledValues.push_back(normalized(triplets[(times.size() - 1) * 3 + 1]));
+
+        times = std::move(sampledTimes);
+        return sampledValues;
+    }
 }
 
-auto Animation::initOutputBuffer(const ModelRenderInfo & renderInfo, const AccessorIndex accessorIdx)
-    -> AnimationSampler::OutputBuffer
+template<class T>
+auto Animation::readAccessor(const ModelRenderInfo & renderInfo, const AccessorIndex accessorIdx) -> std::vector<T>
 {
     const auto & accessor = renderInfo.accessors[accessorIdx];
+    assert(accessor.componentType == GL_FLOAT);
+    assert(accessor.componentCount * sizeof(GLfloat) == sizeof(T));
     const auto & bufferView = renderInfo.bufferViews[accessor.bufferView];
     const auto & buffer = renderInfo.buffers[bufferView.buffer];
 
     const size_t offset = bufferView.byteOffset + accessor.byteOffset;
-    const size_t attributeSize =
-            tinygltf::GetNumComponentsInType(accessor.type) * tinygltf::GetComponentSizeInBytes(accessor.componentType);
 
     const size_t length = accessor.byteStride * accessor.count;
     assert(length > 0);
     assert(accessor.byteOffset + length <= bufferView.byteLength);
 
     const GLubyte * bytes = buffer.data.data() + offset;
-    return {
-        .size = length,
-        .byteStride = accessor.byteStride,
-        .data = bytes,
-    };
+
+    std::vector<T> values(accessor.count);
+    for (size_t i = 0; i < accessor.count; ++i)
+        std::memcpy(&values[i], bytes + i * accessor.byteStride, sizeof(T));
+    return values;
 }
 
-auto Animation::Create(const ModelRenderInfo & renderInfo, const tinygltf::Animation & animation) -> Animation
+auto Animation::Create(const ModelRenderInfo & renderInfo, const tinygltf::Animation & animation,
+                       const CompressionSettings & settings) -> Animation
 {
     float duration = 0;
-    std::vector<AnimationChannel> channels;
-    std::vector<AnimationSampler> samplers;
 
+    std::vector<PendingTrack> tracks;
+    std::vector<bool> invalidSamplers(animation.samplers.size());
+    tracks.reserve(animation.samplers.size());
+    for (size_t samplerIdx = 0; samplerIdx < animation.samplers.size(); ++samplerIdx)
+    {
+        const auto & i = animation.samplers[samplerIdx];
+        auto & track = tracks.emplace_back();
+
+        auto times = readAccessor<float>(renderInfo, i.input);
+
+        // Morph target weights are not supported, no channel uses their samplers
+        const auto & output = renderInfo.accessors[i.output];
+        if (output.type != TINYGLTF_TYPE_VEC4 && output.type != TINYGLTF_TYPE_VEC3)
+        {
+            if (!times.empty())
+                duration = std::max(duration, times.back());
+            track.times = {0};
+            track.values = {{0, 0, 0}};
+            continue;
+        }
+
+        const bool step = i.interpolation == "STEP";
+        const bool cubicSpline = i.interpolation == "CUBICSPLINE";
+        const size_t valuesPerKey = cubicSpline ? 3 : 1;
+        if (times.empty() || output.count != times.size() * valuesPerKey)
+        {
+            std::println(stderr, "Invalid {} sampler of animation {}: {} keys for {} values, its channels are ignored",
+                         i.interpolation, animation.name, times.size(), output.count);
+            invalidSamplers[samplerIdx] = true;
+            track.times = {0};
+            track.values = {{0, 0, 0}};
+            continue;
+        }
+        duration = std::max(duration, times.back());
+        track.interpolation = step ? AnimationSampler::Interpolation::Step : AnimationSampler::Interpolation::Linear;
+
+        if (output.type == TINYGLTF_TYPE_VEC4)
+        {
+            const auto raw = readAccessor<glm::vec4>(renderInfo, i.output);
+            std::vector<glm::quat> rotations;
+            rotations.reserve(raw.size());
+            for (const auto & value: raw)
+                rotations.emplace_back(value.w, value.x, value.y, value.z);
+
+            if (cubicSpline)
+                rotations = sampleCubicSpline(times, rotations);
+
+            // Steps are not interpolated, dropping a key would move the next change of value
+            const auto kept = step ? everyKey(times.size()) : reduceKeys(times, rotations, settings.quatTolerance);
+
+            track.type = AnimationSampler::Type::Quat;
+            track.times = keep(times, kept);
+            for (const auto index: kept)
+                track.values.push_back(packQuat(rotations[index]));
+        }
+        else
+        {
+            auto values = readAccessor<glm::vec3>(renderInfo, i.output);
+            if (cubicSpline)
+                values = sampleCubicSpline(times, values);
+
+            const auto kept = step ? everyKey(times.size()) : reduceKeys(times, values, settings.vec3Tolerance);
+
+            glm::vec3 min(std::numeric_limits<float>::max());
+            glm::vec3 max(std::numeric_limits<float>::lowest());
+            for (const auto index: kept)
+            {
+                min = glm::min(min, values[index]);
+                max = glm::max(max, values[index]);
+            }
+
+            track.type = AnimationSampler::Type::Vec3;
+            track.times = keep(times, kept);
+            track.rangeMin = min;
+            track.rangeExtent = max - min;
+            for (const auto index: kept)
+                track.values.push_back(packVec3(values[index], track.rangeMin, track.rangeExtent));
+        }
+    }
+
+    std::vector<AnimationChannel> channels;
     channels.reserve(animation.channels.size());
     for (const auto & i: animation.channels)
     {
@@ -85,23 +227,200 @@ auto Animation::Create(const ModelRenderInfo & renderInfo, const tinygltf::Anima
             std::println(stderr, "Unsupported target_path: {}", i.target_path);
             continue;
         }
+
+        if (i.sampler < 0 || static_cast<size_t>(i.sampler) >= tracks.size() || invalidSamplers[i.sampler])
+            continue;
         channels.emplace_back(i.sampler, i.target_node, type);
     }
 
-    samplers.reserve(animation.samplers.size());
-    for (const auto & i: animation.samplers)
+    size_t keyCount = 0;
+    for (const auto & track: tracks)
+        keyCount += track.times.size();
+
+    // All key times first, then all packed values
+    std::vector<std::byte> data(keyCount * (sizeof(float) + 3 * sizeof(uint16_t)));
+    auto * times = reinterpret_cast<float *>(data.data());
+    auto * values = reinterpret_cast<uint16_t *>(data.data() + keyCount * sizeof(float));
+
+    std::vector<AnimationSampler> samplers;
+    samplers.reserve(tracks.size());
+    for (const auto & track: tracks)
     {
-        auto input = initInputBuffer(renderInfo, i.input);
-        auto output = initOutputBuffer(renderInfo, i.output);
+        std::ranges::copy(track.times, times);
+        std::memcpy(values, track.values.data(), track.values.size() * sizeof(track.values[0]));
 
-        const auto & inserted = samplers.emplace_back(input, output);
-        duration = std::max(duration, inserted.duration());
+        samplers.emplace_back(AnimationSampler::Track{
+            .type = track.type,
+            .keyCount = track.times.size(),
+            .times = times,
+            .values = values,
+            .rangeMin = track.rangeMin,
+            .rangeExtent = track.rangeExtent,
+            .interpolation = track.interpolation,
+        });
+
+        times += track.times.size();
+        values += track.values.size() * 3;
     }
 
     return {
         animation.name,
         duration,
         std::move(channels),
+        std::move(data),
         std::move(samplers),
+        renderInfo.detailNodes,
+    };
+}
+
+auto Animation::serialize(BinaryWriter & writer, const Animation & animation) -> void
+{
+    const auto * data = animation.m_data.data();
+
+    // Field by field, struct padding would make the cooked bytes differ between cooks of the same model
+    writer.writeString(animation.m_name);
+    writer.write(animation.m_duration);
+
+    writer.write(static_cast<uint64_t>(animation.m_channels.size()));
+    for (const auto & channel: animation.m_channels)
+    {
+        writer.write(static_cast<int32_t>(channel.sampler));
+        writer.write(static_cast<int32_t>(channel.node));
+        writer.write(static_cast<uint8_t>(channel.type));
+    }
+
+    writer.writeArray(std::span<const std::byte>(animation.m_data));
+
+    writer.write(static_cast<uint64_t>(animation.m_samplers.size()));
+    for (const auto & sampler: animation.m_samplers)
+    {
+        const auto & track = sampler.track();
+        writer.write(static_cast<uint8_t>(track.type));
+        writer.write(static_cast<uint8_t>(track.interpolation));
+        writer.write(static_cast<uint64_t>(track.keyCount));
+        writer.write(static_cast<uint64_t>(reinterpret_cast<const std::byte *>(track.times) - data));
+        writer.write(static_cast<uint64_t>(reinterpret_cast<const std::byte *>(track.values) - data));
+        writer.write(track.rangeMin);
+        writer.write(track.rangeExtent);
+    }
+}
+
+auto Animation::deserialize(BinaryReader & reader, const std::vector<bool> & detailNodes)
+    -> std::expected<Animation, std::string>
+{
+    constexpr size_t ChannelSize = 2 * sizeof(int32_t) + sizeof(uint8_t);
+    constexpr size_t TrackSize = 2 * sizeof(uint8_t) + 3 * sizeof(uint64_t) + 2 * sizeof(glm::vec3);
+
+    auto name = reader.readString();
+    const auto duration = reader.read<float>();
+
+    std::vector<AnimationChannel> channels(reader.readCount(ChannelSize));
+    for (auto & channel: channels)
+    {
+        channel.sampler = reader.read<int32_t>();
+        channel.node = reader.read<int32_t>();
+        const auto type = reader.read<uint8_t>();
+        if (type > static_cast<uint8_t>(AnimationChannelType::Scale))
+            return std::unexpected<std::string>(std::in_place, "Corrupted");
+        channel.type = static_cast<AnimationChannelType>(type);
+    }
+
+    auto data = reader.readArray<std::byte>();
+
+    const size_t tracksCount = reader.readCount(TrackSize);
+    std::vector<AnimationSampler> samplers;
+    samplers.reserve(tracksCount);
+    for (size_t i = 0; i < tracksCount; ++i)
+    {
+        const auto type = reader.read<uint8_t>();
+        const auto interpolation = reader.read<uint8_t>();
+        const auto keyCount = reader.read<uint64_t>();
+        const auto timesOffset = reader.read<uint64_t>();
+        const auto valuesOffset = reader.read<uint64_t>();
+        const auto rangeMin = reader.read<glm::vec3>();
+        const auto rangeExtent = reader.read<glm::vec3>();
+        if (reader.failed())
+            break;
+
+        const bool valid = type <= static_cast<uint8_t>(AnimationSampler::Type::Quat)
+                           && interpolation <= static_cast<uint8_t>(AnimationSampler::Interpolation::Step)
+                           && keyCount > 0 && keyCount <= data.size()
+                           && timesOffset <= data.size() && valuesOffset <= data.size()
+                           && timesOffset % alignof(float) == 0
+                           && valuesOffset % alignof(uint16_t) == 0
+                           && timesOffset + keyCount * sizeof(float) <= data.size()
+                           && valuesOffset + keyCount * 3 * sizeof(uint16_t) <= data.size();
+        if (!valid)
+            return std::unexpected<std::string>(std::in_place, "Corrupted");
+
+        // The data block keeps its address when moved into the animation
+        samplers.emplace_back(AnimationSampler::Track{
+            .type = static_cast<AnimationSampler::Type>(type),
+            .keyCount = keyCount,
+            .times = reinterpret_cast<const float *>(data.data() + timesOffset),
+            .values = reinterpret_cast<const uint16_t *>(data.data() + valuesOffset),
+            .rangeMin = rangeMin,
+            .rangeExtent = rangeExtent,
+            .interpolation = static_cast<AnimationSampler::Interpolation>(interpolation),
+        });
+    }
+    if (reader.failed())
+        return std::unexpected<std::string>(std::in_place, "Truncated");
+
+    for (const auto & channel: channels)
+    {
+        if (channel.sampler < 0 || static_cast<size_t>(channel.sampler) >= samplers.size())
+            return std::unexpected<std::string>(std::in_place, "Corrupted");
+    }
+
+    return Animation(name, duration, std::move(channels), std::move(data), std::move(samplers), detailNodes);
+}
+
+auto Animation::sample(const float time, const std::span<AnimationSampler::Cursor> cursors, LocalPose & pose,
+                       const bool reduced) const -> void
+{
+    const auto & vec3Channels = reduced ? m_reducedVec3Channels : m_vec3Channels;
+    const auto & quatChannels = reduced ? m_reducedQuatChannels : m_quatChannels;
+
+    thread_local Vec3Batch vec3Batch;
+    thread_local QuatBatch quatBatch;
+
+    const auto cursor = [&](const AnimationChannel & channel)
+    {
+        return cursors.empty() ? nullptr : &cursors[channel.sampler];
     };
+
+    vec3Batch.resize(vec3Channels.size());
+    for (size_t i = 0; i < vec3Channels.size(); ++i)
+    {
+        const auto & channel = m_channels[vec3Channels[i]];
+        const auto & sampler = m_samplers[channel.sampler];
+        const auto input = sampler.getInput(time, cursor(channel));
+        vec3Batch.set(i, sampler.packedKey(input.prevIndex), sampler.packedKey(input.nextIndex),
+                      sampler.track().rangeMin, vec3Step(sampler.track().rangeExtent), input.t);
+    }
+
+    quatBatch.resize(quatChannels.size());
+    for (size_t i = 0; i < quatChannels.size(); ++i)
+    {
+        const auto & channel = m_channels[quatChannels[i]];
+        const auto & sampler = m_samplers[channel.sampler];
+        const auto input = sampler.getInput(time, cursor(channel));
+        quatBatch.set(i, sampler.packedKey(input.prevIndex), sampler.packedKey(input.nextIndex), input.t);
+    }
+
+    vec3Batch.lerp();
+    quatBatch.interpolate();
+
+    for (size_t i = 0; i < vec3Channels.size(); ++i)
+    {
+        const auto & channel = m_channels[vec3Channels[i]];
+        if (channel.type == AnimationChannelType::Translation)
+            pose.setTranslation(channel.node, vec3Batch.result(i));
+        else
+            pose.setScale(channel.node, vec3Batch.result(i));
+    }
+
+    for (size_t i = 0; i < quatChannels.size(); ++i)
+        pose.setRotation(m_channels[quatChannels[i]].node, quatBatch.result(i));
 }
@@ -8,35 +8,75 @@ module;
 
 export module Engine.Animation;
 import std;
+import glm;
+import Engine.AnimationCompression;
 import Engine.AnimationSampler;
 import Engine.AnimationChannel;
+import Engine.LocalPose;
 import Engine.RenderInfo;
+import Utility.BinaryStream;
 
+/**
+ * Clips are compressed at import: redundant keys are dropped within tolerance, then times and packed values of every
+ * track are stored in a single block, samplers being views over it.
+ */
 export class Animation
 {
 private:
     std::string m_name;
     float m_duration;
     std::vector<AnimationChannel> m_channels;
+    std::vector<std::byte> m_data;
     std::vector<AnimationSampler> m_samplers;
+    std::vector<size_t> m_vec3Channels; // Translations and scales
+    std::vector<size_t> m_quatChannels;
+    std::vector<size_t> m_reducedVec3Channels; // Without the channels of detail nodes
+    std::vector<size_t> m_reducedQuatChannels;
 
-    static auto initInputBuffer(const ModelRenderInfo & renderInfo,
-                                AccessorIndex accessorIdx) -> AnimationSampler::InputBuffer;
-
-    static auto initOutputBuffer(const ModelRenderInfo & renderInfo,
-                                 AccessorIndex accessorIdx) -> AnimationSampler::OutputBuffer;
+    template<class T>
+    static auto readAccessor(const ModelRenderInfo & renderInfo, AccessorIndex accessorIdx) -> std::vector<T>;
 
 public:
     Animation(const std::string & name,
               const float duration,
               std::vector<AnimationChannel> && channels,
-              std::vector<AnimationSampler> && samplers)
+              std::vector<std::byte> && data,
+              std::vector<AnimationSampler> && samplers,
+              const std::vector<bool> & detailNodes = {})
         : m_name(name),
           m_duration(duration),
           m_channels(std::move(channels)),
-          m_samplers(std::move(samplers)) {}
+          m_data(std::move(data)),
+          m_samplers(std::move(samplers))
+    {
+        for (size_t i = 0; i < m_channels.size(); ++i)
+        {
+            const bool isRotation = m_channels[i].type == AnimationChannelType::Rotation;
+            (isRotation ? m_quatChannels : m_vec3Channels).push_back(i);
+
+            const auto node = static_cast<size_t>(m_channels[i].node);
+            if (node >= detailNodes.size() || !detailNodes[node])
+                (isRotation ? m_reducedQuatChannels : m_reducedVec3Channels).push_back(i);
+        }
+    }
+
+    // Samplers point into m_data, which a move keeps in place
+    Animation(const Animation &) = delete;
+    Animation(Animation &&) noexcept = default;
+
+    auto operator=(const Animation &) -> Animation & = delete;
+    auto operator=(Animation &&) noexcept -> Animation & = default;
 
-    static auto Create(const ModelRenderInfo & renderInfo, const tinygltf::Animation & animation) -> Animation;
+    static auto Create(const ModelRenderInfo & renderInfo, const tinygltf::Animation & animation,
+                       const CompressionSettings & settings = {}) -> Animation;
+
+    /**
+     * Tracks are stored as offsets into the clip data, and turned back into pointers on read.
+     */
+    static auto serialize(BinaryWriter & writer, const Animation & animation) -> void;
+
+    [[nodiscard]] static auto deserialize(BinaryReader & reader, const std::vector<bool> & detailNodes)
+        -> std::expected<Animation, std::string>;
 
     [[nodiscard]] auto name() const -> const std::string & { return m_name; }
     [[nodiscard]] auto duration() const -> float { return m_duration; }
@@ -45,4 +85,17 @@ public:
     [[nodiscard]] auto channelsCount() const -> size_t { return m_channels.size(); }
     [[nodiscard]] auto sampler(const size_t index) const -> const AnimationSampler & { return m_samplers[index]; }
     [[nodiscard]] auto samplersCount() const -> size_t { return m_samplers.size(); }
+
+    /**
+     * Write the animated nodes of pose at time, other nodes are left untouched. cursors holds one cursor per sampler
+     * or is empty. Keys are decoded per channel, then interpolated in batches. reduced skips the channels of detail
+     * nodes, which keep the transform already in pose.
+     */
+    auto sample(float time, std::span<AnimationSampler::Cursor> cursors, LocalPose & pose,
+                bool reduced = false) const -> void;
+
+    /**
+     * Size of the compressed keys of every track, in bytes.
+     */
+    [[nodiscard]] auto dataSize() const -> size_t { return m_data.size(); }
 };
@@ -0,0 +1,121 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+module Engine.AnimationCompression;
+import std.compat;
+import glm;
+import Utility.Simd;
+
+namespace
+{
+    auto distance(const glm::vec3 & a, const glm::vec3 & b) -> float
+    {
+        return glm::length(a - b);
+    }
+
+    auto distance(const glm::quat & a, const glm::quat & b) -> float
+    {
+        // Roughly half the angle between the rotations for small differences
+        return std::min(glm::length(glm::vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w)),
+                        glm::length(glm::vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w)));
+    }
+
+    auto interpolate(const glm::vec3 & a, const glm::vec3 & b, const float t) -> glm::vec3
+    {
+        return glm::mix(a, b, t);
+    }
+
+    auto interpolate(const glm::quat & a, const glm::quat & b, const float t) -> glm::quat
+    {
+        return glm::slerp(a, b, t);
+    }
+
+    template<class T>
+    auto reduce(const std::span<const float> times, const std::span<const T> values, const float tolerance)
+        -> std::vector<size_t>
+    {
+        assert(times.size() == values.size());
+
+        if (values.empty())
+            return {};
+
+        const bool constant = std::ranges::all_of(values, [&](const T & value)
+        {
+            return distance(value, values.front()) <= tolerance;
+        });
+        if (constant)
+            return {0};
+
+        // Interpolating from `from` to `to` must reproduce every key in between
+        const auto fits = [&](const size_t from, const size_t to)
+        {
+            for (size_t i = from + 1; i < to; ++i)
+            {
+                const float span = times[to] - times[from];
+                const float t = span > 0 ? (times[i] - times[from]) / span : 0;
+                if (distance(interpolate(values[from], values[to], t), values[i]) > tolerance)
+                    return false;
+            }
+            return true;
+        };
+
+        std::vector<size_t> kept{0};
+        for (size_t i = 1; i + 1 < values.size(); ++i)
+        {
+            if (!fits(kept.back(), i + 1))
+                kept.push_back(i);
+        }
+        kept.push_back(values.size() - 1);
+        return kept;
+    }
+}
+
+auto reduceKeys(const std::span<const float> times, const std::span<const glm::vec3> values,
+                const float tolerance) -> std::vector<size_t>
+{
+    return reduce(times, values, tolerance);
+}
+
+auto reduceKeys(const std::span<const float> times, const std::span<const glm::quat> values,
+                const float tolerance) -> std::vector<size_t>
+{
+    return reduce(times, values, tolerance);
+}
+
+auto unpackQuats(const size_t size, const uint32_t * low, const uint32_t * high,
+                 float * x, float * y, float * z, float * w) -> void
+{
+    const UInt4 componentMask = UInt4::broadcast(0x7fff);
+    const Float4 steps = Float4::broadcast(QuatComponentSteps);
+    const Float4 range = Float4::broadcast(QuatComponentRange);
+    const Float4 one = Float4::broadcast(1.0f);
+    const Float4 two = Float4::broadcast(2.0f);
+
+    const auto component = [&](const UInt4 bits)
+    {
+        return (toFloat(bits & componentMask) / steps * two - one) * range;
+    };
+
+    for (size_t i = 0; i < size; i += Float4::Width)
+    {
+        const UInt4 lowBits = UInt4::load(low + i);
+        const UInt4 largest = lowBits & UInt4::broadcast(0x3);
+
+        // The three stored components in order, the largest one is rebuilt and slotted in their place
+        const Float4 c0 = component(shiftRight<2>(lowBits));
+        const Float4 c1 = component(shiftRight<17>(lowBits));
+        const Float4 c2 = component(UInt4::load(high + i));
+        const Float4 rebuilt = sqrt(max(Float4::broadcast(0.0f), one - (c0 * c0 + c1 * c1 + c2 * c2)));
+
+        const Mask4 isX = largest == UInt4::broadcast(0);
+        const Mask4 isY = largest == UInt4::broadcast(1);
+        const Mask4 isZ = largest == UInt4::broadcast(2);
+        const Mask4 isW = largest == UInt4::broadcast(3);
+
+        select(isX, rebuilt, c0).store(x + i);
+        select(isY, rebuilt, select(isX, c0, c1)).store(y + i);
+        select(isZ, rebuilt, select(isW, c2, c1)).store(z + i);
+        select(isW, rebuilt, c2).store(w + i);
+    }
+}
@@ -0,0 +1,128 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+export module Engine.AnimationCompression;
+import std.compat;
+import glm;
+
+/**
+ * Rotations use 48 bits "smallest three": the index of the largest component in 2 bits, then the three others in
+ * 15 bits each. The largest component is rebuilt from the unit length, the others are within +-1/sqrt(2).
+ */
+export using PackedQuat = std::array<uint16_t, 3>;
+
+/**
+ * Translations and scales use 16 bits per component, quantized over the range of their track.
+ */
+export using PackedVec3 = std::array<uint16_t, 3>;
+
+constexpr float QuatComponentRange = 0.70710678118f;
+constexpr float QuatComponentSteps = static_cast<float>((1 << 15) - 1);
+constexpr float Vec3ComponentSteps = static_cast<float>(std::numeric_limits<uint16_t>::max());
+
+export struct CompressionSettings
+{
+    float vec3Tolerance{1e-4f};
+    float quatTolerance{1e-4f};
+};
+
+export [[nodiscard]] inline auto packQuat(const glm::quat & rotation) -> PackedQuat
+{
+    const glm::quat normalized = glm::normalize(rotation);
+    std::array<float, 4> q{normalized.x, normalized.y, normalized.z, normalized.w};
+
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+    {
+        if (std::abs(q[i]) > std::abs(q[largest]))
+            largest = i;
+    }
+
+    // q and -q are the same rotation, make the dropped component positive
+    const float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+    uint64_t bits = static_cast<uint64_t>(largest);
+    int shift = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+
+        const float unit = std::clamp(q[i] * sign / QuatComponentRange * 0.5f + 0.5f, 0.0f, 1.0f);
+        bits |= static_cast<uint64_t>(std::lround(unit * QuatComponentSteps)) << shift;
+        shift += 15;
+    }
+
+    return {
+        static_cast<uint16_t>(bits),
+        static_cast<uint16_t>(bits >> 16),
+        static_cast<uint16_t>(bits >> 32),
+    };
+}
+
+export [[nodiscard]] inline auto unpackQuat(const uint16_t * packed) -> glm::quat
+{
+    const uint64_t bits = packed[0] | static_cast<uint64_t>(packed[1]) << 16 | static_cast<uint64_t>(packed[2]) << 32;
+    const int largest = static_cast<int>(bits & 0x3);
+
+    std::array<float, 4> q{};
+    float squaredSum = 0;
+    int shift = 2;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+
+        const auto value = static_cast<float>((bits >> shift) & 0x7fff);
+        q[i] = (value / QuatComponentSteps * 2.0f - 1.0f) * QuatComponentRange;
+        squaredSum += q[i] * q[i];
+        shift += 15;
+    }
+    q[largest] = std::sqrt(std::max(0.0f, 1.0f - squaredSum));
+
+    return {q[3], q[0], q[1], q[2]};
+}
+
+export [[nodiscard]] inline auto packVec3(const glm::vec3 & value, const glm::vec3 & min, const glm::vec3 & extent)
+    -> PackedVec3
+{
+    PackedVec3 packed{};
+    for (int i = 0; i < 3; ++i)
+    {
+        const float unit = extent[i] > 0 ? std::clamp((value[i] - min[i]) / extent[i], 0.0f, 1.0f) : 0.0f;
+        packed[i] = static_cast<uint16_t>(std::lround(unit * Vec3ComponentSteps));
+    }
+    return packed;
+}
+
+/**
+ * Value of one quantization step of a track, unpacked = min + packed * step.
+ */
+export [[nodiscard]] inline auto vec3Step(const glm::vec3 & extent) -> glm::vec3
+{
+    return extent / Vec3ComponentSteps;
+}
+
+export [[nodiscard]] inline auto unpackVec3(const uint16_t * packed, const glm::vec3 & min, const glm::vec3 & extent)
+    -> glm::vec3
+{
+    return min + glm::vec3(packed[0], packed[1], packed[2]) * vec3Step(extent);
+}
+
+/**
+ * unpackQuat of many keys, 4 per instruction. Each key is given as its first two uint16 in low (packed[0] |
+ * packed[1] << 16) and its third in high. size must be a multiple of Float4::Width.
+ */
+export auto unpackQuats(size_t size, const uint32_t * low, const uint32_t * high,
+                        float * x, float * y, float * z, float * w) -> void;
+
+/**
+ * Indices of the keys to keep so that linear interpolation (slerp for rotations) between them stays within tolerance
+ * of every original key. A constant track is reduced to its first key.
+ */
+export [[nodiscard]] auto reduceKeys(std::span<const float> times, std::span<const glm::vec3> values,
+                                     float tolerance) -> std::vector<size_t>;
+
+export [[nodiscard]] auto reduceKeys(std::span<const float> times, std::span<const glm::quat> values,
+                                     float tolerance) -> std::vector<size_t>;
@@ -0,0 +1,37 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+export module Engine.AnimationLod;
+import std;
+
+export struct AnimationLodTier
+{
+    float maxDistance; // In bounding radii of the model
+    float updatePeriod; // Seconds between two sampled poses, interpolated in between. 0 samples every frame
+    bool reducedSkeleton; // Only sample the nodes large enough to be noticed, see ModelRenderInfo::detailNodes
+};
+
+export struct AnimationLodSettings
+{
+    std::vector<AnimationLodTier> tiers{
+        {20.0f, 0.0f, false},
+        {50.0f, 1.0f / 30.0f, false},
+        {100.0f, 1.0f / 15.0f, true},
+        {std::numeric_limits<float>::infinity(), 1.0f / 8.0f, true},
+    };
+    bool freezeOffscreen{true};
+
+    /**
+     * Tiers are sorted by maxDistance, the last one is used past every tier.
+     */
+    [[nodiscard]] auto tier(const float distance) const -> const AnimationLodTier &
+    {
+        for (const auto & tier: tiers)
+        {
+            if (distance <= tier.maxDistance)
+                return tier;
+        }
+        return tiers.back();
+    }
+};
@@ -4,36 +4,85 @@
 
 module Engine.AnimationSampler;
 import std.compat;
-import Utility;
 
-using difference_type = StridedIterator<float*>::difference_type;
-
-auto AnimationSampler::getInput(const float time) const -> InputResult
+auto AnimationSampler::findKey(const float time, Cursor *cursor) const -> size_t
 {
-    const auto begin = StridedIterator(m_input.data, static_cast<difference_type>(m_input.attributeStride));
-    const auto end = begin + static_cast<difference_type>(m_input.size);
-    const auto upperBound = std::upper_bound(begin, end, time);
+    const size_t lastKey = m_track.keyCount - 2;
+
+    if (m_inverseStep > 0)
+    {
+        // Stored times are not exactly first + key * step, rounding can be off by one key
+        size_t key = std::min(static_cast<size_t>((time - inputTime(0)) * m_inverseStep), lastKey);
+        if (key > 0 && inputTime(key) > time)
+            --key;
+        else if (key < lastKey && inputTime(key + 1) <= time)
+            ++key;
+        return key;
+    }
+
+    if (cursor != nullptr && cursor->key <= lastKey && inputTime(cursor->key) <= time)
+    {
+        // Try the cached key and the next ones, a seek or a loop falls back to the search
+        const size_t maxKey = std::min(cursor->key + 2, lastKey);
+        for (size_t key = cursor->key; key <= maxKey; ++key)
+        {
+            if (time < inputTime(key + 1))
+            {
+                cursor->key = key;
+                return key;
+            }
+        }
+    }
+
+    const float *begin = m_track.times;
+    const float *end = begin + m_track.keyCount;
+    const float *upperBound = std::upper_bound(begin, end, time);
+
+    const auto key = static_cast<size_t>(upperBound - begin - 1);
+    if (cursor != nullptr)
+        cursor->key = key;
+    return key;
+}
 
+auto AnimationSampler::getInput(const float time, Cursor *cursor) const -> InputResult
+{
     // Clamp to first and last
-    if (upperBound == begin)
+    if (time < inputTime(0))
         return {0, 0, 0};
-    if (upperBound == end)
-        return {m_input.size - 1, m_input.size - 1, 1};
+    if (time >= inputTime(m_track.keyCount - 1))
+        return {m_track.keyCount - 1, m_track.keyCount - 1, 1};
+
+    const size_t prevIndex = findKey(time, cursor);
+    const size_t nextIndex = prevIndex + 1;
 
-    const auto next = upperBound;
-    const auto prev = upperBound - 1;
+    if (m_track.interpolation == Interpolation::Step)
+        return {prevIndex, nextIndex, 0};
 
-    const auto prevVal = *prev;
-    const auto nextVal = *next;
-    const auto prevIndex = prev - begin;
-    const auto nextIndex = next - begin;
+    const auto prevVal = inputTime(prevIndex);
+    const auto nextVal = inputTime(nextIndex);
 
     const float stepRatio = (nextVal != prevVal) ? ((time - prevVal) / (nextVal - prevVal)) : 0;
-    return {static_cast<size_t>(prevIndex), static_cast<size_t>(nextIndex), stepRatio};
+    return {prevIndex, nextIndex, stepRatio};
 }
 
-AnimationSampler::AnimationSampler(const InputBuffer& input, const OutputBuffer& output)
-    : m_input(input), m_output(output)
+AnimationSampler::AnimationSampler(const Track& track) : m_track(track)
 {
-    m_duration = input.data[(input.size - 1) * input.attributeStride];
+    assert(track.keyCount > 0);
+
+    if (track.keyCount < 2)
+        return;
+
+    // Uniformly spaced keys (baked clips) are indexed with a single division
+    const float first = inputTime(0);
+    const float step = (inputTime(track.keyCount - 1) - first) / static_cast<float>(track.keyCount - 1);
+    if (step <= 0)
+        return;
+
+    const float tolerance = step * 1e-3f;
+    for (size_t i = 1; i < track.keyCount - 1; ++i)
+    {
+        if (std::abs(inputTime(i) - (first + static_cast<float>(i) * step)) > tolerance)
+            return;
+    }
+    m_inverseStep = 1.0f / step;
 }
@@ -2,35 +2,52 @@
 // Created by Simon Cros on 22/01/2025.
 //
 
-module;
-
-#include "glad/gl.h"
-
 export module Engine.AnimationSampler;
 import std.compat;
 import glm;
+import Engine.AnimationCompression;
 
 export class AnimationSampler
 {
 public:
-    struct InputBuffer
+    enum class Type
     {
-        size_t size;
-        size_t attributeStride;
-        const GLfloat *data;
+        Vec3,
+        Quat,
     };
 
-    struct OutputBuffer
+    /**
+     * Cubic splines are sampled into linear keys at import, see Animation::Create.
+     */
+    enum class Interpolation
     {
-        size_t size;
-        GLsizei byteStride;
-        const GLubyte *data;
+        Linear,
+        Step,
     };
 
-private:
-    GLfloat m_duration{};
-    InputBuffer m_input;
-    OutputBuffer m_output;
+    /**
+     * View over a compressed track stored in the clip data of its animation. Values are 3 uint16 per key, see
+     * PackedVec3 and PackedQuat.
+     */
+    struct Track
+    {
+        Type type{Type::Vec3};
+        size_t keyCount{0};
+        const float *times{nullptr};
+        const uint16_t *values{nullptr};
+        glm::vec3 rangeMin{0};
+        glm::vec3 rangeExtent{0};
+        Interpolation interpolation{Interpolation::Linear};
+    };
+
+    /**
+     * Last key found by a sampler, kept by the caller between samples. Playback moves forward, so the next key is
+     * usually the same one or the one after it.
+     */
+    struct Cursor
+    {
+        size_t key{0};
+    };
 
     struct InputResult
     {
@@ -39,42 +56,66 @@ private:
         float t;
     };
 
-    [[nodiscard]] auto getInput(float time) const -> InputResult;
+private:
+    Track m_track;
+    float m_inverseStep{0}; // 1 / key interval when keys are uniformly spaced, 0 otherwise
 
-    template<class T>
-    [[nodiscard]] auto getOutputPtr(const size_t index) const -> const T *
+    [[nodiscard]] auto inputTime(const size_t index) const -> float
     {
-        return reinterpret_cast<const T *>(m_output.data + index * m_output.byteStride);
+        return m_track.times[index];
     }
 
+    [[nodiscard]] auto findKey(float time, Cursor *cursor) const -> size_t;
+
 public:
-    AnimationSampler(const InputBuffer &input, const OutputBuffer &output);
+    explicit AnimationSampler(const Track &track);
 
-    [[nodiscard]] auto duration() const -> float { return m_duration; }
+    /**
+     * Keys surrounding time and the interpolation factor between them, always 0 for step tracks.
+     */
+    [[nodiscard]] auto getInput(float time, Cursor *cursor) const -> InputResult;
 
-    [[nodiscard]] auto vec3(const float time) const -> glm::vec3
+    /**
+     * 3 uint16 of a key, for batches unpacking many keys at once.
+     */
+    [[nodiscard]] auto packedKey(const size_t index) const -> const uint16_t *
     {
-        const auto result = getInput(time);
-        return glm::mix(*getOutputPtr<glm::vec3>(result.prevIndex),
-                        *getOutputPtr<glm::vec3>(result.nextIndex),
-                        result.t);
+        return m_track.values + index * 3;
     }
 
-    [[nodiscard]] auto vec4(const float time) const -> glm::vec4
+    [[nodiscard]] auto keyVec3(const size_t index) const -> glm::vec3
+    {
+        return unpackVec3(packedKey(index), m_track.rangeMin, m_track.rangeExtent);
+    }
+
+    [[nodiscard]] auto keyQuat(const size_t index) const -> glm::quat
+    {
+        return unpackQuat(packedKey(index));
+    }
+
+    [[nodiscard]] auto type() const -> Type { return m_track.type; }
+
+    [[nodiscard]] auto track() const -> const Track & { return m_track; }
+
+    [[nodiscard]] auto keyCount() const -> size_t { return m_track.keyCount; }
+
+    [[nodiscard]] auto isUniform() const -> bool { return m_inverseStep > 0; }
+
+    [[nodiscard]] auto vec3(const float time, Cursor *cursor = nullptr) const -> glm::vec3
     {
-        const auto result = getInput(time);
-        return glm::mix(*getOutputPtr<glm::vec4>(result.prevIndex),
-                        *getOutputPtr<glm::vec4>(result.nextIndex),
-                        result.t);
+        assert(m_track.type == Type::Vec3);
+        const auto result = getInput(time, cursor);
+        if (result.prevIndex == result.nextIndex)
+            return keyVec3(result.prevIndex);
+        return glm::mix(keyVec3(result.prevIndex), keyVec3(result.nextIndex), result.t);
     }
 
-    [[nodiscard]] auto quat(const float time) const -> glm::quat
+    [[nodiscard]] auto quat(const float time, Cursor *cursor = nullptr) const -> glm::quat
     {
-        const auto result = getInput(time);
-        const auto prev = getOutputPtr<float>(result.prevIndex);
-        const auto next = getOutputPtr<float>(result.nextIndex);
-        return glm::slerp(glm::quat(prev[3], prev[0], prev[1], prev[2]),
-                          glm::quat(next[3], next[0], next[1], next[2]),
-                          result.t);
+        assert(m_track.type == Type::Quat);
+        const auto result = getInput(time, cursor);
+        if (result.prevIndex == result.nextIndex)
+            return keyQuat(result.prevIndex);
+        return glm::slerp(keyQuat(result.prevIndex), keyQuat(result.nextIndex), result.t);
     }
 };
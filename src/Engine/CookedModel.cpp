@@ -0,0 +1,327 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include <cstdio>
+#include "glad/gl.h"
+#include "tiny_gltf.h"
+
+module Engine.CookedModel;
+import std.compat;
+import glm;
+import DataCache;
+import Engine.Animation;
+import Engine.CookedTexture;
+import Engine.RenderInfo;
+import Utility.BinaryStream;
+import Utility.Hash;
+
+namespace
+{
+    constexpr uint32_t CookedMagic = 0x4c444d43; // "CMDL"
+    constexpr uint32_t CookedVersion = 4; // Bump when the render info, the vertex layout or the animations change
+
+    /**
+     * The cooked model is outdated when its source file changes.
+     */
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+
+        auto operator==(const Header &) const -> bool = default;
+    };
+
+    auto sourceHeader(const std::filesystem::path & source) -> std::expected<Header, std::string>
+    {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(source, ec);
+        if (ec)
+            return std::unexpected(ec.message());
+        const auto time = std::filesystem::last_write_time(source, ec);
+        if (ec)
+            return std::unexpected(ec.message());
+
+        return Header{CookedMagic, CookedVersion, size, time.time_since_epoch().count()};
+    }
+
+    template<class T>
+    auto writeArray(BinaryWriter & writer, const std::unique_ptr<T[]> & values, const size_t count) -> void
+    {
+        writer.writeArray(std::span<const T>(values.get(), count));
+    }
+
+    template<class T>
+    auto readArray(BinaryReader & reader, std::unique_ptr<T[]> & values, size_t & count) -> void
+    {
+        const auto read = reader.readArray<T>();
+        count = read.size();
+        values = std::make_unique<T[]>(count);
+        std::ranges::copy(read, values.get());
+    }
+
+    auto writeNode(BinaryWriter & writer, const NodeRenderInfo & node) -> void
+    {
+        writer.write(node.skin);
+        writer.write(node.mesh);
+        writer.write(static_cast<uint8_t>(node.transform.index()));
+        if (const auto * matrix = std::get_if<glm::mat4>(&node.transform))
+            writer.write(*matrix);
+        else
+            writer.write(std::get<TRS>(node.transform));
+        writeArray(writer, node.children, node.childrenCount);
+    }
+
+    auto readNode(BinaryReader & reader, NodeRenderInfo & node) -> void
+    {
+        node.skin = reader.read<int>();
+        node.mesh = reader.read<int>();
+        if (reader.read<uint8_t>() == 0)
+            node.transform = reader.read<glm::mat4>();
+        else
+            node.transform = reader.read<TRS>();
+        readArray(reader, node.children, node.childrenCount);
+    }
+
+    auto writePrimitive(BinaryWriter & writer, const PrimitiveRenderInfo & primitive) -> void
+    {
+        writer.writeArray(std::span<const PrimitiveAttribute>(primitive.attributes));
+        writer.write(primitive.material);
+        writer.write(primitive.mode);
+        writer.write(primitive.indices);
+        writer.write(primitive.vertexArrayFlags);
+    }
+
+    auto readPrimitive(BinaryReader & reader, PrimitiveRenderInfo & primitive) -> void
+    {
+        primitive.attributes = reader.readArray<PrimitiveAttribute>();
+        primitive.material = reader.read<int>();
+        primitive.mode = reader.read<int>();
+        primitive.indices = reader.read<AccessorIndex>();
+        primitive.vertexArrayFlags = reader.read<VertexArrayFlags>();
+    }
+
+    auto writeSkin(BinaryWriter & writer, const SkinRenderInfo & skin) -> void
+    {
+        writer.writeArray(std::span<const glm::mat4>(skin.inverseBindMatrices));
+        writer.writeArray(std::span<const int>(skin.joints));
+        writer.write(skin.skeleton);
+    }
+
+    auto readSkin(BinaryReader & reader, SkinRenderInfo & skin) -> void
+    {
+        skin.inverseBindMatrices = reader.readArray<glm::mat4>();
+        skin.joints = reader.readArray<int>();
+        skin.skeleton = reader.read<int>();
+    }
+}
+
+auto CookedModel::serialize(BinaryWriter & writer, const CookedModel & model) -> void
+{
+    const auto & renderInfo = model.renderInfo;
+
+    writer.write(static_cast<uint64_t>(renderInfo.nodesCount));
+    for (size_t i = 0; i < renderInfo.nodesCount; ++i)
+        writeNode(writer, renderInfo.nodes[i]);
+    writeArray(writer, renderInfo.rootNodes, renderInfo.rootNodesCount);
+
+    writer.write(static_cast<uint64_t>(renderInfo.buffersCount));
+    for (size_t i = 0; i < renderInfo.buffersCount; ++i)
+        writer.writeArray(std::span<const unsigned char>(renderInfo.buffers[i].data));
+    writeArray(writer, renderInfo.bufferViews, renderInfo.bufferViewsCount);
+    writeArray(writer, renderInfo.accessors, renderInfo.accessorsCount);
+    writeArray(writer, renderInfo.materials, renderInfo.materialsCount);
+
+    writer.write(static_cast<uint64_t>(renderInfo.skinsCount));
+    for (size_t i = 0; i < renderInfo.skinsCount; ++i)
+        writeSkin(writer, renderInfo.skins[i]);
+
+    writer.write(static_cast<uint64_t>(renderInfo.meshesCount));
+    for (size_t i = 0; i < renderInfo.meshesCount; ++i)
+    {
+        const auto & mesh = renderInfo.meshes[i];
+        writer.write(static_cast<uint64_t>(mesh.primitivesCount));
+        for (size_t j = 0; j < mesh.primitivesCount; ++j)
+            writePrimitive(writer, mesh.primitives[j]);
+    }
+
+    writer.write(renderInfo.boundsCenter);
+    writer.write(renderInfo.boundsRadius);
+    const std::vector<uint8_t> detailNodes(renderInfo.detailNodes.begin(), renderInfo.detailNodes.end());
+    writer.writeArray(std::span(detailNodes));
+
+    writer.write(static_cast<uint64_t>(model.geometries.size()));
+    for (const auto & geometry: model.geometries)
+    {
+        writer.writeArray(std::span<const std::byte>(geometry.vertices));
+        writer.writeArray(std::span<const GLuint>(geometry.indices));
+    }
+
+    writer.write(static_cast<uint64_t>(model.textures.size()));
+    for (const auto & texture: model.textures)
+    {
+        writer.writeArray(std::span<const std::byte>(texture.image));
+        writer.write(texture.sampler);
+        writer.write(texture.usage);
+    }
+
+    writer.write(static_cast<uint64_t>(model.animations.size()));
+    for (const auto & animation: model.animations)
+        Animation::serialize(writer, animation);
+}
+
+auto CookedModel::deserialize(BinaryReader & reader) -> std::expected<CookedModel, std::string>
+{
+    CookedModel model;
+    auto & renderInfo = model.renderInfo;
+
+    renderInfo.nodesCount = reader.readCount();
+    renderInfo.nodes = std::make_unique<NodeRenderInfo[]>(renderInfo.nodesCount);
+    for (size_t i = 0; i < renderInfo.nodesCount; ++i)
+        readNode(reader, renderInfo.nodes[i]);
+    readArray(reader, renderInfo.rootNodes, renderInfo.rootNodesCount);
+
+    renderInfo.buffersCount = reader.readCount();
+    renderInfo.buffers = std::make_unique<Buffer[]>(renderInfo.buffersCount);
+    for (size_t i = 0; i < renderInfo.buffersCount; ++i)
+        renderInfo.buffers[i].data = reader.readArray<unsigned char>();
+    readArray(reader, renderInfo.bufferViews, renderInfo.bufferViewsCount);
+    readArray(reader, renderInfo.accessors, renderInfo.accessorsCount);
+    readArray(reader, renderInfo.materials, renderInfo.materialsCount);
+
+    renderInfo.skinsCount = reader.readCount();
+    renderInfo.skins = std::make_unique<SkinRenderInfo[]>(renderInfo.skinsCount);
+    for (size_t i = 0; i < renderInfo.skinsCount; ++i)
+        readSkin(reader, renderInfo.skins[i]);
+
+    size_t primitivesCount = 0;
+    renderInfo.meshesCount = reader.readCount();
+    renderInfo.meshes = std::make_unique<MeshRenderInfo[]>(renderInfo.meshesCount);
+    for (size_t i = 0; i < renderInfo.meshesCount; ++i)
+    {
+        auto & mesh = renderInfo.meshes[i];
+        mesh.primitivesCount = reader.readCount();
+        mesh.primitives = std::make_unique<PrimitiveRenderInfo[]>(mesh.primitivesCount);
+        for (size_t j = 0; j < mesh.primitivesCount; ++j)
+            readPrimitive(reader, mesh.primitives[j]);
+        primitivesCount += mesh.primitivesCount;
+    }
+
+    renderInfo.boundsCenter = reader.read<glm::vec3>();
+    renderInfo.boundsRadius = reader.read<float>();
+    const auto detailNodes = reader.readArray<uint8_t>();
+    renderInfo.detailNodes.assign(detailNodes.begin(), detailNodes.end());
+
+    model.geometries.resize(reader.readCount());
+    for (auto & geometry: model.geometries)
+    {
+        geometry.vertices = reader.readArray<std::byte>();
+        geometry.indices = reader.readArray<GLuint>();
+    }
+
+    model.textures.resize(reader.readCount());
+    for (auto & texture: model.textures)
+    {
+        texture.image = reader.readArray<std::byte>();
+        texture.sampler = reader.read<TextureSampler>();
+        texture.usage = reader.read<TextureUsage>();
+    }
+
+    const size_t animationsCount = reader.readCount();
+    model.animations.reserve(animationsCount);
+    for (size_t i = 0; i < animationsCount && !reader.failed(); ++i)
+    {
+        auto e_animation = Animation::deserialize(reader, renderInfo.detailNodes);
+        if (!e_animation)
+            return std::unexpected(std::move(e_animation).error());
+        model.animations.push_back(std::move(*e_animation));
+    }
+
+    if (reader.failed() || !reader.atEnd())
+        return std::unexpected<std::string>(std::in_place, "Truncated");
+    if (model.geometries.size() != primitivesCount)
+        return std::unexpected<std::string>(std::in_place, "Corrupted");
+    return model;
+}
+
+auto cookSettings(const ModelTexture & texture, const bool s3tc, const bool s3tcSrgb) -> CookSettings
+{
+    CookSettings settings{.sampler = texture.sampler};
+    switch (texture.usage)
+    {
+        case TextureUsage::BaseColor:
+        case TextureUsage::Emissive:
+            settings.colorSpace = ColorSpace::Srgb;
+            settings.blockCompression = s3tcSrgb;
+            break;
+        case TextureUsage::MetallicRoughness:
+            // Occlusion, roughness and metallic in r, g and b
+            settings.blockCompression = s3tc;
+            break;
+        case TextureUsage::Normal:
+            settings.normalMap = true;
+            settings.blockCompression = true;
+            break;
+    }
+    return settings;
+}
+
+auto cookedModelPath(const std::filesystem::path & source) -> std::filesystem::path
+{
+    std::error_code ec;
+    const auto canonical = std::filesystem::weakly_canonical(source, ec);
+    return std::format(".cache/models/{:016x}.model", StableHash().add((ec ? source : canonical).string()).value());
+}
+
+auto loadCookedModel(const std::filesystem::path & source) -> std::optional<CookedModel>
+{
+    const auto e_expected = sourceHeader(source);
+    if (!e_expected)
+        return std::nullopt;
+
+    const auto path = cookedModelPath(source);
+    const auto oe_result = DataCache::mapFile(path);
+    if (!oe_result)
+        return std::nullopt;
+    if (!oe_result->has_value())
+    {
+        std::println(stderr, "Failed to load model from {}: {}", path.c_str(), oe_result->error());
+        return std::nullopt;
+    }
+
+    BinaryReader reader(oe_result->value().data());
+    const auto header = reader.read<Header>();
+    if (reader.failed() || header != *e_expected)
+        return std::nullopt;
+
+    auto e_model = CookedModel::deserialize(reader);
+    if (!e_model)
+    {
+        std::println(stderr, "Failed to load model from {}: {}", path.c_str(), e_model.error());
+        return std::nullopt;
+    }
+    return std::move(*e_model);
+}
+
+auto saveCookedModel(const std::filesystem::path & source, const CookedModel & model)
+    -> std::expected<void, std::string>
+{
+    TRY_V(const auto, header, sourceHeader(source));
+
+    BinaryWriter writer;
+    writer.write(header);
+    CookedModel::serialize(writer, model);
+    return DataCache::writeFile(cookedModelPath(source), std::move(writer).data());
+}
+
+auto keepEncodedImage(tinygltf::Image * image, const int, std::string *, std::string *, int, int,
+                      const unsigned char * bytes, const int size, void *) -> bool
+{
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
@@ -0,0 +1,84 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+#include "tiny_gltf.h"
+
+export module Engine.CookedModel;
+import std;
+import Engine.Animation;
+import Engine.CookedTexture;
+import Engine.RenderInfo;
+import Utility.BinaryStream;
+
+export enum class TextureUsage : std::uint32_t
+{
+    BaseColor,
+    MetallicRoughness,
+    Normal,
+    Emissive,
+};
+
+/**
+ * Encoded image (PNG, JPEG...) of a glTF texture, and how the materials use it. Unused textures have no image.
+ */
+export struct ModelTexture
+{
+    std::vector<std::byte> image;
+    TextureSampler sampler{GL_REPEAT, GL_REPEAT, -1, -1};
+    TextureUsage usage{TextureUsage::BaseColor};
+};
+
+/**
+ * Interleaved vertices and indices of a primitive, ready to upload to the geometry arena.
+ */
+export struct PrimitiveGeometry
+{
+    std::vector<std::byte> vertices;
+    std::vector<GLuint> indices;
+};
+
+/**
+ * Everything a model is built from, without any GL object. Cooked from a glTF file once, then read back from the
+ * data cache without parsing the glTF again.
+ */
+export struct CookedModel
+{
+    ModelRenderInfo renderInfo;
+    std::vector<PrimitiveGeometry> geometries; // Primitives of every mesh, in order
+    std::vector<ModelTexture> textures;
+    std::vector<Animation> animations;
+
+    static auto serialize(BinaryWriter & writer, const CookedModel & model) -> void;
+
+    [[nodiscard]] static auto deserialize(BinaryReader & reader) -> std::expected<CookedModel, std::string>;
+};
+
+/**
+ * Block compression matching the channels the shader reads, if the driver supports it. BC5 (RGTC) is core, BC1 and
+ * BC3 (S3TC) are a common extension.
+ */
+export [[nodiscard]] auto cookSettings(const ModelTexture & texture, bool s3tc, bool s3tcSrgb) -> CookSettings;
+
+/**
+ * Data cache path of the model cooked from the glTF file at source.
+ */
+export [[nodiscard]] auto cookedModelPath(const std::filesystem::path & source) -> std::filesystem::path;
+
+/**
+ * The cooked model of source, if it was cooked from the current version of the file.
+ */
+export [[nodiscard]] auto loadCookedModel(const std::filesystem::path & source) -> std::optional<CookedModel>;
+
+export auto saveCookedModel(const std::filesystem::path & source, const CookedModel & model)
+    -> std::expected<void, std::string>;
+
+/**
+ * tinygltf image loader keeping images encoded as in the file, textures are decoded only when no cooked texture
+ * exists.
+ */
+export auto keepEncodedImage(tinygltf::Image * image, int, std::string *, std::string *, int, int,
+                             const unsigned char * bytes, int size, void *) -> bool;
@@ -0,0 +1,330 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+#include <cstdio>
+#include "glad/gl.h"
+#include "stb_image.h"
+
+module Engine.CookedTexture;
+import std.compat;
+import DataCache;
+import Engine.TextureCompression;
+import Utility.Hash;
+import Utility.ThreadPool;
+
+namespace
+{
+    constexpr uint32_t CookedMagic = 0x58455443; // "CTEX"
+    constexpr uint32_t CookedVersion = 1; // Bump when the cooked output changes
+    constexpr size_t RowsPerJob = 16;
+    constexpr std::array TentWeights{0.125f, 0.375f, 0.375f, 0.125f};
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        TextureEncoding encoding;
+        ColorSpace colorSpace;
+        TextureSampler sampler;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+    };
+
+    auto srgbToLinear(const uint8_t value) -> float
+    {
+        static const auto table = [] {
+            std::array<float, 256> values{};
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                const float v = static_cast<float>(i) / 255.0f;
+                values[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table[value];
+    }
+
+    auto linearToSrgb(const float value) -> float
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    auto quantize(const float value) -> uint8_t
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    auto chooseEncoding(const std::span<const uint8_t> rgba, const CookSettings & settings) -> TextureEncoding
+    {
+        if (!settings.blockCompression)
+            return TextureEncoding::RGBA8;
+        if (settings.normalMap)
+            return TextureEncoding::BC5;
+
+        for (size_t i = 3; i < rgba.size(); i += 4)
+        {
+            if (rgba[i] != 255)
+                return TextureEncoding::BC3;
+        }
+        return TextureEncoding::BC1;
+    }
+
+    /**
+     * Pixels as floats where filtering is correct: linear colors, or normal vectors in [-1, 1].
+     */
+    auto toFilterSpace(ThreadPool & workers, const std::span<const uint8_t> rgba, const uint32_t width,
+                       const uint32_t height, const CookSettings & settings) -> std::vector<float>
+    {
+        std::vector<float> pixels(rgba.size());
+        workers.parallelFor(height, RowsPerJob, [&](const size_t y) {
+            for (size_t i = y * width * 4; i < (y + 1) * width * 4; ++i)
+            {
+                const bool alpha = i % 4 == 3;
+                if (settings.normalMap && !alpha)
+                    pixels[i] = static_cast<float>(rgba[i]) / 255.0f * 2.0f - 1.0f;
+                else if (settings.colorSpace == ColorSpace::Srgb && !alpha)
+                    pixels[i] = srgbToLinear(rgba[i]);
+                else
+                    pixels[i] = static_cast<float>(rgba[i]) / 255.0f;
+            }
+        });
+        return pixels;
+    }
+
+    auto fromFilterSpace(ThreadPool & workers, const std::span<const float> pixels, const uint32_t width,
+                         const uint32_t height, const CookSettings & settings) -> std::vector<uint8_t>
+    {
+        std::vector<uint8_t> rgba(pixels.size());
+        workers.parallelFor(height, RowsPerJob, [&](const size_t y) {
+            for (size_t i = y * width * 4; i < (y + 1) * width * 4; i += 4)
+            {
+                std::array color{pixels[i], pixels[i + 1], pixels[i + 2]};
+                if (settings.normalMap)
+                {
+                    // Filtered normals get shorter, the mip must still hold unit vectors
+                    const float length = std::hypot(color[0], color[1], color[2]);
+                    for (float & c: color)
+                        c = (length > 0.0f ? c / length : c) * 0.5f + 0.5f;
+                }
+                else if (settings.colorSpace == ColorSpace::Srgb)
+                {
+                    for (float & c: color)
+                        c = linearToSrgb(std::max(c, 0.0f));
+                }
+
+                rgba[i] = quantize(color[0]);
+                rgba[i + 1] = quantize(color[1]);
+                rgba[i + 2] = quantize(color[2]);
+                rgba[i + 3] = quantize(pixels[i + 3]);
+            }
+        });
+        return rgba;
+    }
+
+    auto address(const int64_t coordinate, const uint32_t size, const int32_t wrap) -> size_t
+    {
+        if (wrap == GL_REPEAT)
+            return static_cast<size_t>((coordinate % size + size) % size);
+        return static_cast<size_t>(std::clamp<int64_t>(coordinate, 0, size - 1));
+    }
+
+    /**
+     * Halve the image with a separable 4-tap tent filter, which unlike a box filter also weighs the neighbors of each
+     * 2x2 footprint. Edges follow the wrap modes of the sampler.
+     */
+    auto downsample(ThreadPool & workers, const std::span<const float> pixels, const uint32_t width,
+                    const uint32_t height, const TextureSampler & sampler) -> std::vector<float>
+    {
+        const uint32_t nextWidth = std::max(width / 2, 1u);
+        const uint32_t nextHeight = std::max(height / 2, 1u);
+
+        std::vector<float> horizontal(static_cast<size_t>(nextWidth) * height * 4);
+        workers.parallelFor(height, RowsPerJob, [&](const size_t y) {
+            for (size_t x = 0; x < nextWidth; ++x)
+            {
+                std::array<float, 4> sum{};
+                for (size_t tap = 0; tap < TentWeights.size(); ++tap)
+                {
+                    const size_t sx = address(static_cast<int64_t>(x * 2 + tap) - 1, width, sampler.wrapS);
+                    for (size_t c = 0; c < 4; ++c)
+                        sum[c] += TentWeights[tap] * pixels[(y * width + sx) * 4 + c];
+                }
+                std::ranges::copy(sum, horizontal.begin() + static_cast<std::ptrdiff_t>((y * nextWidth + x) * 4));
+            }
+        });
+
+        std::vector<float> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+        workers.parallelFor(nextHeight, RowsPerJob, [&](const size_t y) {
+            for (size_t tap = 0; tap < TentWeights.size(); ++tap)
+            {
+                const size_t sy = address(static_cast<int64_t>(y * 2 + tap) - 1, height, sampler.wrapT);
+                for (size_t i = 0; i < nextWidth * 4; ++i)
+                    next[y * nextWidth * 4 + i] += TentWeights[tap] * horizontal[sy * nextWidth * 4 + i];
+            }
+        });
+        return next;
+    }
+
+    auto encodeLevel(ThreadPool & workers, const std::span<const uint8_t> rgba, const uint32_t width,
+                     const uint32_t height, const TextureEncoding encoding, const std::span<std::byte> out) -> void
+    {
+        switch (encoding)
+        {
+            case TextureEncoding::RGBA8:
+                std::ranges::copy(std::as_bytes(rgba), out.begin());
+                break;
+            case TextureEncoding::BC1:
+                compressImage(workers, rgba, width, height, BlockFormat::BC1, out);
+                break;
+            case TextureEncoding::BC3:
+                compressImage(workers, rgba, width, height, BlockFormat::BC3, out);
+                break;
+            case TextureEncoding::BC5:
+                compressImage(workers, rgba, width, height, BlockFormat::BC5, out);
+                break;
+        }
+    }
+}
+
+CookedTexture::CookedTexture(const TextureEncoding encoding, const ColorSpace colorSpace,
+                             const TextureSampler & sampler, const uint32_t width, const uint32_t height) :
+    m_encoding(encoding), m_colorSpace(colorSpace), m_sampler(sampler), m_width(width), m_height(height)
+{
+    const uint32_t levels = mipLevelCount(width, height);
+    m_levelOffsets.reserve(levels + 1);
+    for (uint32_t level = 0; level < levels; ++level)
+    {
+        const size_t size = levelSize(encoding, std::max(width >> level, 1u), std::max(height >> level, 1u));
+        m_levelOffsets.push_back(m_levelOffsets.back() + size);
+    }
+    m_data.resize(m_levelOffsets.back());
+}
+
+auto CookedTexture::level(const uint32_t level) const -> CookedLevel
+{
+    return {
+        std::max(m_width >> level, 1u), std::max(m_height >> level, 1u),
+        std::span(m_data).subspan(m_levelOffsets[level], m_levelOffsets[level + 1] - m_levelOffsets[level]),
+    };
+}
+
+auto CookedTexture::levelData(const uint32_t level) -> std::span<std::byte>
+{
+    return std::span(m_data).subspan(m_levelOffsets[level], m_levelOffsets[level + 1] - m_levelOffsets[level]);
+}
+
+auto CookedTexture::serialize(const CookedTexture & texture) -> std::vector<std::byte>
+{
+    const Header header{
+        CookedMagic, CookedVersion, texture.m_encoding, texture.m_colorSpace, texture.m_sampler,
+        texture.m_width, texture.m_height, texture.levelCount(),
+    };
+    const std::vector<uint64_t> offsets(texture.m_levelOffsets.begin(), texture.m_levelOffsets.end() - 1);
+    const auto offsetBytes = std::as_bytes(std::span(offsets));
+
+    std::vector<std::byte> data(sizeof(header) + offsetBytes.size() + texture.m_data.size());
+    std::memcpy(data.data(), &header, sizeof(header));
+    std::ranges::copy(offsetBytes, data.begin() + sizeof(header));
+    std::ranges::copy(texture.m_data, data.begin() + static_cast<std::ptrdiff_t>(sizeof(header) + offsetBytes.size()));
+    return data;
+}
+
+auto CookedTexture::deserialize(const std::vector<std::byte> & data) -> std::expected<CookedTexture, std::string>
+{
+    Header header{};
+    if (data.size() < sizeof(header))
+        return std::unexpected<std::string>(std::in_place, "Truncated");
+
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != CookedMagic || header.version != CookedVersion)
+        return std::unexpected<std::string>(std::in_place, "Outdated");
+    if (header.encoding > TextureEncoding::BC5 || header.levelCount != mipLevelCount(header.width, header.height))
+        return std::unexpected<std::string>(std::in_place, "Corrupted");
+
+    CookedTexture texture(header.encoding, header.colorSpace, header.sampler, header.width, header.height);
+    const size_t offsetsSize = header.levelCount * sizeof(uint64_t);
+    if (data.size() != sizeof(header) + offsetsSize + texture.m_data.size())
+        return std::unexpected<std::string>(std::in_place, "Truncated");
+
+    std::vector<uint64_t> offsets(header.levelCount);
+    std::memcpy(offsets.data(), data.data() + sizeof(header), offsetsSize);
+    if (!std::ranges::equal(offsets, texture.m_levelOffsets | std::views::take(header.levelCount)))
+        return std::unexpected<std::string>(std::in_place, "Corrupted");
+
+    std::ranges::copy(data | std::views::drop(sizeof(header) + offsetsSize), texture.m_data.begin());
+    return texture;
+}
+
+auto cookTexture(ThreadPool & workers, const std::span<const uint8_t> rgba, uint32_t width, uint32_t height,
+                 const CookSettings & settings) -> CookedTexture
+{
+    assert(rgba.size() == static_cast<size_t>(width) * height * 4);
+
+    const TextureEncoding encoding = chooseEncoding(rgba, settings);
+    CookedTexture texture(encoding, settings.colorSpace, settings.sampler, width, height);
+    encodeLevel(workers, rgba, width, height, encoding, texture.levelData(0));
+
+    auto pixels = toFilterSpace(workers, rgba, width, height, settings);
+    for (uint32_t level = 1; level < texture.levelCount(); ++level)
+    {
+        pixels = downsample(workers, pixels, width, height, settings.sampler);
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+
+        const auto levelRgba = fromFilterSpace(workers, pixels, width, height, settings);
+        encodeLevel(workers, levelRgba, width, height, encoding, texture.levelData(level));
+    }
+    return texture;
+}
+
+auto cookedTexturePath(const std::span<const std::byte> source, const CookSettings & settings)
+    -> std::filesystem::path
+{
+    StableHash hash;
+    hash.add(CookedVersion).add(settings.sampler.wrapS).add(settings.sampler.wrapT);
+    hash.add(settings.sampler.minFilter).add(settings.sampler.magFilter).add(settings.colorSpace);
+    hash.add(settings.normalMap).add(settings.blockCompression).add(source);
+    return std::format(".cache/textures/{:016x}.tex", hash.value());
+}
+
+auto loadCookedTexture(const std::span<const std::byte> source, const CookSettings & settings)
+    -> std::expected<CookedTexture, std::string>
+{
+    const auto path = cookedTexturePath(source, settings);
+    if (const auto oe_result = DataCache::readFile(path))
+    {
+        if (!oe_result->has_value())
+        {
+            std::println(stderr, "Failed to load texture from {}: {}", path.c_str(), oe_result->error());
+        }
+        else if (auto e_texture = CookedTexture::deserialize(oe_result->value()))
+        {
+            return std::move(*e_texture);
+        }
+    }
+
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    stbi_uc * pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(source.data()),
+                                             static_cast<int>(source.size()), &width, &height, &components,
+                                             STBI_rgb_alpha);
+    if (pixels == nullptr)
+        return std::unexpected(std::format("failed to decode image: {}", stbi_failure_reason()));
+
+    // Callers load several textures at once, each one is cooked on its calling thread
+    ThreadPool sequential(0);
+    const std::span<const std::uint8_t> rgba(pixels, static_cast<std::size_t>(width) * height * 4);
+    auto texture = cookTexture(sequential, rgba, static_cast<std::uint32_t>(width),
+                               static_cast<std::uint32_t>(height), settings);
+    stbi_image_free(pixels);
+
+    if (const auto e_result = DataCache::writeFile(path, CookedTexture::serialize(texture)); !e_result)
+    {
+        std::println(stderr, "Failed to save texture: {}", e_result.error());
+    }
+    return texture;
+}
@@ -0,0 +1,130 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module Engine.CookedTexture;
+import std.compat;
+import Engine.TextureCompression;
+import Utility.ThreadPool;
+
+/**
+ * How the levels of a cooked texture are stored.
+ */
+export enum class TextureEncoding : uint32_t
+{
+    RGBA8,
+    BC1,
+    BC3,
+    BC5,
+};
+
+export enum class ColorSpace : uint32_t
+{
+    Linear,
+    Srgb,
+};
+
+/**
+ * GL wrap and filter modes. Filters are -1 to keep the GL defaults.
+ */
+export struct TextureSampler
+{
+    int32_t wrapS;
+    int32_t wrapT;
+    int32_t minFilter;
+    int32_t magFilter;
+};
+
+export struct CookSettings
+{
+    TextureSampler sampler;
+    ColorSpace colorSpace{ColorSpace::Linear};
+    bool normalMap{false}; // Levels are renormalized, and BC5 keeps only x and y
+    bool blockCompression{false}; // BC1, or BC3 for images with transparent pixels, BC5 for normal maps
+};
+
+export struct CookedLevel
+{
+    uint32_t width;
+    uint32_t height;
+    std::span<const std::byte> data;
+};
+
+export [[nodiscard]] constexpr auto mipLevelCount(const uint32_t width, const uint32_t height) -> uint32_t
+{
+    return std::bit_width(std::max(width, height));
+}
+
+export [[nodiscard]] constexpr auto levelSize(const TextureEncoding encoding, const uint32_t width,
+                                              const uint32_t height) -> size_t
+{
+    switch (encoding)
+    {
+        case TextureEncoding::BC1:
+            return compressedSize(BlockFormat::BC1, width, height);
+        case TextureEncoding::BC3:
+            return compressedSize(BlockFormat::BC3, width, height);
+        case TextureEncoding::BC5:
+            return compressedSize(BlockFormat::BC5, width, height);
+        default:
+            return static_cast<size_t>(width) * height * 4;
+    }
+}
+
+/**
+ * Ready to upload texture with its whole mip chain, down to 1x1. The serialized layout is a header, the offset of
+ * each level, then the levels, largest first.
+ */
+export class CookedTexture
+{
+private:
+    TextureEncoding m_encoding{TextureEncoding::RGBA8};
+    ColorSpace m_colorSpace{ColorSpace::Linear};
+    TextureSampler m_sampler{};
+    uint32_t m_width{0};
+    uint32_t m_height{0};
+    std::vector<size_t> m_levelOffsets{0}; // One past the last level too
+    std::vector<std::byte> m_data;
+
+public:
+    CookedTexture() = default;
+
+    CookedTexture(TextureEncoding encoding, ColorSpace colorSpace, const TextureSampler & sampler, uint32_t width,
+                  uint32_t height);
+
+    [[nodiscard]] auto encoding() const -> TextureEncoding { return m_encoding; }
+
+    [[nodiscard]] auto colorSpace() const -> ColorSpace { return m_colorSpace; }
+
+    [[nodiscard]] auto sampler() const -> const TextureSampler & { return m_sampler; }
+
+    [[nodiscard]] auto levelCount() const -> uint32_t { return static_cast<uint32_t>(m_levelOffsets.size() - 1); }
+
+    [[nodiscard]] auto level(uint32_t level) const -> CookedLevel;
+
+    [[nodiscard]] auto levelData(uint32_t level) -> std::span<std::byte>;
+
+    [[nodiscard]] static auto serialize(const CookedTexture & texture) -> std::vector<std::byte>;
+
+    [[nodiscard]] static auto deserialize(const std::vector<std::byte> & data)
+        -> std::expected<CookedTexture, std::string>;
+};
+
+/**
+ * Build the mip chain of an RGBA8 image and encode every level, on the workers. Levels are downsampled from the
+ * previous one with a tent filter, in linear space for sRGB images.
+ */
+export [[nodiscard]] auto cookTexture(ThreadPool & workers, std::span<const uint8_t> rgba, uint32_t width,
+                                      uint32_t height, const CookSettings & settings) -> CookedTexture;
+
+/**
+ * Data cache path of a texture cooked from an encoded image (PNG, JPEG...) with these settings.
+ */
+export [[nodiscard]] auto cookedTexturePath(std::span<const std::byte> source, const CookSettings & settings)
+    -> std::filesystem::path;
+
+/**
+ * The image is decoded and cooked on its first load only, later loads read the cooked texture from the data cache.
+ */
+export [[nodiscard]] auto loadCookedTexture(std::span<const std::byte> source, const CookSettings & settings)
+    -> std::expected<CookedTexture, std::string>;
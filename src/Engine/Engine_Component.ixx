@@ -30,6 +30,14 @@ public:
     {
     }
 
+    /**
+     * Called for every active object before any onRender, with a fresh uniform ring frame. Jobs submitted to the
+     * engine workers here are completed and the ring is flushed before the render phase.
+     */
+    virtual auto onPreRender(Engine& engine) -> void
+    {
+    }
+
     virtual auto onRender(Engine& engine) -> void
     {
     }
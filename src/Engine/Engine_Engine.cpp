@@ -12,7 +12,9 @@ module;
 module Engine;
 import std;
 import glm;
+import Engine.CookedModel;
 import OpenGL;
+import OpenGL.StateCache;
 import Window;
 
 static auto onKeyPressed(const Window & window, const int key, const int action, int mode) -> void
@@ -32,13 +34,18 @@ Engine::Engine(Window && window) noexcept : m_window(std::move(window))
     const int version = gladLoadGL(glfwGetProcAddress);
     std::cout << "OpenGL " << GLAD_VERSION_MAJOR(version) << "." << GLAD_VERSION_MINOR(version) << std::endl;
 
+    if (enableParallelShaderCompile())
+        std::cout << "Parallel shader compile enabled" << std::endl;
+
+    m_loader.SetImageLoader(keepEncodedImage, nullptr);
+
     const bool hasDebugOutput = GLAD_GL_KHR_debug || GLAD_GL_ARB_debug_output;
 
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
     int flags;
     glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
-    glEnable(GL_DEPTH_TEST);
+    m_state.setEnabled(GL_DEPTH_TEST, true);
     if (hasDebugOutput && (flags & GL_CONTEXT_FLAG_DEBUG_BIT))
     {
         glEnable(GL_DEBUG_OUTPUT);
@@ -50,8 +57,11 @@ Engine::Engine(Window && window) noexcept : m_window(std::move(window))
     // TODO TMP only one global VAO for testing
     GLuint vao;
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_state.bindVertexArray(vao);
+    m_state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_state.setEnabled(GL_CULL_FACE, true);
+    m_state.cullFace(GL_BACK);
+    glFrontFace(GL_CCW);
 
     getWindow().setKeyCallback(onKeyPressed);
 }
@@ -63,21 +73,7 @@ auto Engine::run() -> std::expected<void, std::string>
         return std::unexpected("You must define a camera.");
     }
 
-    if (m_doubleSided)
-        glDisable(GL_CULL_FACE);
-    else
-        glEnable(GL_CULL_FACE);
-    if (m_blendEnabled)
-        glEnable(GL_BLEND);
-    else
-        glDisable(GL_BLEND);
-    glDepthMask(m_depthMaskEnabled ? GL_TRUE : GL_FALSE);
-
-    glPolygonMode(GL_FRONT_AND_BACK, m_polygonMode);
-
     // glClearColor(0.4705882353f, 0.6549019608f, 1.0f, 1.0f);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
 
     m_start = ClockType::now();
 
@@ -86,12 +82,12 @@ auto Engine::run() -> std::expected<void, std::string>
 
     int fb_w, fb_h;
     glfwGetFramebufferSize(m_window.getGLFWHandle(), &fb_w, &fb_h);
-    glViewport(0, 0, fb_w, fb_h);
+    m_state.viewport(0, 0, fb_w, fb_h);
 
     // create floating point color buffer
     unsigned int colorBuffer;
     glGenTextures(1, &colorBuffer);
-    glBindTexture(GL_TEXTURE_2D, colorBuffer);
+    m_state.bindTexture(GL_TEXTURE_2D, colorBuffer);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, static_cast<GLsizei>(fb_w),
                  static_cast<GLsizei>(fb_h), 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -100,7 +96,7 @@ auto Engine::run() -> std::expected<void, std::string>
     // create depth buffer (renderbuffer)
     unsigned int rboDepth;
     glGenTextures(1, &rboDepth);
-    glBindTexture(GL_TEXTURE_2D, rboDepth);
+    m_state.bindTexture(GL_TEXTURE_2D, rboDepth);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -118,17 +114,27 @@ auto Engine::run() -> std::expected<void, std::string>
     );
 
     // attach buffers
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    m_state.bindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, rboDepth, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    m_state.bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    const SlotSetIndex hdrProgramIdx = *m_shaderManager.getOrCreateShaderProgram(
+        *m_shaderManager.getOrAddShaderFile(RESOURCE_PATH"shaders/texcoord.vert"),
+        *m_shaderManager.getOrAddShaderFile(RESOURCE_PATH"shaders/hdr.frag"), ShaderFlags::None);
 
     auto previousTime = m_start;
     bool timeScaleKeyPressed = false;
     while (m_window.update())
     {
+        // Swaps in the programs that finished linking in the background, their ids changed
+        if (m_shaderManager.update())
+            m_state.invalidateProgram();
+
+        m_textureStreamer.update(m_state);
+
         for (SlotSet<Object>::SizeType objectIdx = 0; objectIdx < m_objects.size(); ++objectIdx)
         {
             Object & object = m_objects[objectIdx];
@@ -138,6 +144,8 @@ auto Engine::run() -> std::expected<void, std::string>
             }
         }
 
+        m_frustum = Frustum::FromMatrix(m_camera->projectionMatrix() * m_camera->computeViewMatrix());
+
         for (SlotSet<Object>::SizeType objectIdx = 0; objectIdx < m_objects.size(); ++objectIdx)
         {
             Object & object = m_objects[objectIdx];
@@ -150,18 +158,41 @@ auto Engine::run() -> std::expected<void, std::string>
         const auto pvMat = m_camera->projectionMatrix() * m_camera->computeViewMatrix();
         for (auto & program: m_shaderManager.getPrograms())
         {
+            if (!program.isReady())
+                continue;
+
             useProgram(program);
-            program.setVec3("u_cameraPosition", m_camera->object().transform().translation());
+            program.setVec3(Uniform::CameraPosition, m_camera->object().transform().translation());
             //program.setVec4("u_fogColor", glm::vec4(0.4705882353f, 0.6549019608f, 1.0f, 1.0f));
-            program.setVec3("u_lightPosition", {4, 5, 8});
-            program.setMat4("u_projectionView", pvMat);
+            program.setVec3(Uniform::LightPosition, {4, 5, 8});
+            program.setMat4(Uniform::ProjectionView, pvMat);
+        }
+
+        m_uniformRing.beginFrame();
+
+        // Bound for the whole frame, no other block uses its binding point
+        if (const auto frameData = m_uniformRing.push(m_irradiance))
+            bindUniformBlock(UniformBlockBinding::FrameData, *frameData);
+
+        m_poseCache.evaluate(m_workers, m_uniformRing);
+
+        for (SlotSet<Object>::SizeType objectIdx = 0; objectIdx < m_objects.size(); ++objectIdx)
+        {
+            Object & object = m_objects[objectIdx];
+            if (object.isActive())
+            {
+                object.preRender(*this);
+            }
         }
 
-        glDisable(GL_SCISSOR_TEST);
-        glDisable(GL_BLEND);
-        glEnable(GL_DEPTH_TEST);
-        glDepthMask(GL_TRUE);
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        m_workers.wait();
+        m_uniformRing.flush();
+
+        m_state.setEnabled(GL_SCISSOR_TEST, false);
+        m_state.setEnabled(GL_BLEND, false);
+        m_state.setEnabled(GL_DEPTH_TEST, true);
+        m_state.depthMask(true);
+        m_state.bindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         for (SlotSet<Object>::SizeType objectIdx = 0; objectIdx < m_objects.size(); ++objectIdx)
@@ -173,20 +204,16 @@ auto Engine::run() -> std::expected<void, std::string>
             }
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_state.bindFramebuffer(GL_FRAMEBUFFER, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
-        glDepthMask(GL_FALSE);
-        // TODO cache
-        const auto programIdx = *m_shaderManager.getOrCreateShaderProgram(
-            *m_shaderManager.getOrAddShaderFile(RESOURCE_PATH"shaders/texcoord.vert"),
-            *m_shaderManager.getOrAddShaderFile(RESOURCE_PATH"shaders/hdr.frag"), ShaderFlags::None);
-        auto & program = m_shaderManager.getProgram(programIdx);
+        m_state.setEnabled(GL_DEPTH_TEST, false);
+        m_state.depthMask(false);
+        auto & program = m_shaderManager.getProgram(hdrProgramIdx);
         useProgram(program);
         bindTexture(0, colorBuffer);
-        program.setBool("u_hdr", true);
-        program.setFloat("u_exposure", 1.0f);
-        renderQuad();
+        program.setBool(Uniform::Hdr, true);
+        program.setFloat(Uniform::Exposure, 1.0f);
+        renderQuad(m_state);
 
         for (SlotSet<Object>::SizeType objectIdx = 0; objectIdx < m_objects.size(); ++objectIdx)
         {
@@ -197,8 +224,12 @@ auto Engine::run() -> std::expected<void, std::string>
             }
         }
 
-        m_currentBoundVertexArray = 0;
-        m_currentBoundArrayBuffer = 0;
+        m_uniformRing.endFrame();
+
+        const auto stateStats = m_state.stats();
+        m_currentFrameInfo.stateCallsIssued = stateStats.issued;
+        m_currentFrameInfo.stateCallsElided = stateStats.elided;
+        m_state.resetStats();
 
         m_window.swapBuffers();
 
@@ -243,40 +274,30 @@ auto Engine::run() -> std::expected<void, std::string>
 auto Engine::loadModel(const std::string_view & id, const std::string & path,
                        const bool binary) -> std::expected<ModelRef, std::string>
 {
-    std::string err;
-    std::string warn;
-
-    tinygltf::Model rawModel;
-    bool loadResult = binary
-                          ? m_loader.LoadBinaryFromFile(&rawModel, &err, &warn, path)
-                          : m_loader.LoadASCIIFromFile(&rawModel, &err, &warn, path);
+    auto o_cooked = loadCookedModel(path);
+    if (!o_cooked)
+    {
+        std::string err;
+        std::string warn;
 
-    if (!loadResult)
-        return std::unexpected("failed to load model: " + std::move(err));
+        tinygltf::Model rawModel;
+        bool loadResult = binary
+                              ? m_loader.LoadBinaryFromFile(&rawModel, &err, &warn, path)
+                              : m_loader.LoadASCIIFromFile(&rawModel, &err, &warn, path);
 
-    if (!warn.empty())
-        std::cout << "[WARN] " << warn << std::endl;
+        if (!loadResult)
+            return std::unexpected("failed to load model: " + std::move(err));
 
-    auto model = Model::Create(*this, rawModel);
+        if (!warn.empty())
+            std::cout << "[WARN] " << warn << std::endl;
 
-    const auto & modelRenderInfo = model.renderInfo();
-    for (size_t i = 0; i < modelRenderInfo.meshesCount; i++)
-    {
-        const auto & meshRenderInfo = modelRenderInfo.meshes[i];
-
-        for (size_t j = 0; j < meshRenderInfo.primitivesCount; j++)
-        {
-            const auto & primitiveRenderInfo = meshRenderInfo.primitives[j];
-            if (!m_vertexArrays.contains(primitiveRenderInfo.vertexArrayFlags))
-            {
-                m_vertexArrays.emplace(std::piecewise_construct,
-                                       std::forward_as_tuple(primitiveRenderInfo.vertexArrayFlags),
-                                       std::forward_as_tuple(
-                                           VertexArray::Create(primitiveRenderInfo.vertexArrayFlags)));
-            }
-        }
+        o_cooked = Model::Cook(rawModel);
+        if (const auto e_result = saveCookedModel(path, *o_cooked); !e_result)
+            std::cout << "[WARN] failed to save cooked model: " << e_result.error() << std::endl;
     }
 
+    auto model = Model::Create(*this, std::move(*o_cooked));
+
     // C++ 26 will avoid new key allocation if key already exist (remove explicit std::string constructor call).
     // In this function, unnecessary string allocation is not really a problem since we should not try to add two shaders with the same id
     auto [it, inserted] = m_models.try_emplace(std::string(id), std::make_unique<Model>(std::move(model)));
@@ -287,6 +308,17 @@ auto Engine::loadModel(const std::string_view & id, const std::string & path,
     return *it->second;
 }
 
+auto Engine::uploadGeometry(const VertexArrayFlags flags, const std::span<const std::byte> vertices,
+                            const std::span<const GLuint> indices) -> GeometryAllocation
+{
+    const auto allocation = getGeometryArena(flags).append(vertices, indices);
+
+    // The arena binds its vertex array and buffers directly
+    m_state.invalidateVertexArray();
+
+    return allocation;
+}
+
 auto Engine::instantiate() -> Object &
 {
     return m_objects.emplace(*this);
@@ -12,9 +12,15 @@ import std;
 import :Component;
 import :Object;
 import OpenGL;
+import OpenGL.StateCache;
 import Utility;
 import Window;
+import Engine.AnimationLod;
 import Engine.FrameInfo;
+import Engine.Frustum;
+import Engine.PoseCache;
+import Engine.SphericalHarmonics;
+import Engine.TextureStreamer;
 import Time;
 
 export class Camera;
@@ -30,7 +36,8 @@ public:
     using ModelPtr = std::unique_ptr<Model>;
     using ShaderProgramPtr = std::unique_ptr<ShaderProgram>;
 
-    static constexpr size_t MaxTextures = 8;
+    static constexpr size_t MaxTextures = OpenGL::StateCache::MaxTextureUnits;
+    static constexpr size_t MaxUniformBlockBindings = OpenGL::StateCache::MaxUniformBufferBindings;
 
 private:
     Window m_window;
@@ -41,22 +48,20 @@ private:
 
     FrameInfo m_currentFrameInfo{};
 
+    OpenGL::StateCache m_state; // Before every member owning GL objects, they invalidate it when destroyed
+
     StringUnorderedMap<ModelPtr> m_models;
     SlotSet<Object> m_objects;
-    std::unordered_map<VertexArrayFlags, VertexArray> m_vertexArrays;
+    std::unordered_map<VertexArrayFlags, GeometryArena> m_geometryArenas;
 
     ShaderManager m_shaderManager;
-
-    bool m_doubleSided{false};
-    bool m_blendEnabled{false};
-    bool m_depthMaskEnabled{true};
-    GLenum m_polygonMode{GL_FILL};
-    GLuint m_currentShaderProgram{0};
-    GLuint m_currentTextures[MaxTextures]{};
-    GLenum m_currentBoundTextureTarget{0};
-    GLuint m_currentBoundVertexArray{0};
-    GLuint m_currentBoundArrayBuffer{0};
-    GLuint m_currentBoundArrayElementBuffer{0};
+    UniformRing m_uniformRing{&m_state};
+    ThreadPool m_workers;
+    TextureStreamer m_textureStreamer;
+    PoseCache m_poseCache;
+    AnimationLodSettings m_animationLod;
+    Frustum m_frustum;
+    IrradianceSH m_irradiance{};
 
     const Camera * m_camera{nullptr};
 
@@ -72,130 +77,67 @@ public:
 
     [[nodiscard]] auto controls() const noexcept -> Controls { return m_window.getCurrentControls(); }
 
-    [[nodiscard]] auto isDoubleSided() const noexcept -> bool { return m_doubleSided; }
-    [[nodiscard]] auto polygonMode() const noexcept -> GLenum { return m_polygonMode; }
+    [[nodiscard]] auto isDoubleSided() const noexcept -> bool { return !m_state.isEnabled(GL_CULL_FACE); }
+    [[nodiscard]] auto polygonMode() const noexcept -> GLenum { return m_state.polygonMode(); }
 
     auto run() -> std::expected<void, std::string>;
 
-    auto setDoubleSided(const bool value) -> void
-    {
-        if (m_doubleSided != value)
-        {
-            m_doubleSided = value;
-            if (value)
-                glDisable(GL_CULL_FACE);
-            else
-                glEnable(GL_CULL_FACE);
-        }
-    }
+    auto setDoubleSided(const bool value) -> void { m_state.setEnabled(GL_CULL_FACE, !value); }
 
-    auto setBlendEnabled(const bool value) -> void
-    {
-        if (m_blendEnabled != value)
-        {
-            m_blendEnabled = value;
-            if (value)
-                glEnable(GL_BLEND);
-            else
-                glDisable(GL_BLEND);
-        }
-    }
+    auto setBlendEnabled(const bool value) -> void { m_state.setEnabled(GL_BLEND, value); }
 
-    auto setDepthMaskEnabled(const bool value) -> void
-    {
-        if (m_depthMaskEnabled != value)
-        {
-            m_depthMaskEnabled = value;
-            glDepthMask(value ? GL_TRUE : GL_FALSE);
-        }
-    }
+    auto setDepthMaskEnabled(const bool value) -> void { m_state.depthMask(value); }
 
-    auto setPolygoneMode(const GLenum polygonMode) -> void
-    {
-        if (m_polygonMode != polygonMode)
-        {
-            m_polygonMode = polygonMode;
-            glPolygonMode(GL_FRONT_AND_BACK, polygonMode);
-        }
-    }
+    auto setPolygoneMode(const GLenum polygonMode) -> void { m_state.polygonMode(polygonMode); }
 
-    auto useProgram(const ShaderProgram & program) -> void
-    {
-        if (m_currentShaderProgram != program.id())
-        {
-            m_currentShaderProgram = program.id();
-            glUseProgram(m_currentShaderProgram);
-        }
-    }
+    auto useProgram(const ShaderProgram & program) -> void { m_state.useProgram(program.id()); }
 
-    auto bindVertexArray(const VertexArray & vertexArray) -> void
+    auto bindVertexArray(const VertexArray & vertexArray) -> void { m_state.bindVertexArray(vertexArray.id()); }
+
+    auto bindBuffer(const GLenum target, const GLuint id) -> void { m_state.bindBuffer(target, id); }
+
+    auto bindTexture(const GLuint bindingIndex, const GLuint & texture) -> void
     {
-        if (m_currentBoundVertexArray != vertexArray.id())
-        {
-            m_currentBoundVertexArray = vertexArray.id();
-            vertexArray.bind();
-        }
+        m_state.bindTexture(bindingIndex, GL_TEXTURE_2D, texture);
     }
 
-    auto bindBuffer(const GLenum target, const GLuint id) -> void
+    auto bindCubemap(const GLuint bindingIndex, const GLuint & texture) -> void
     {
-        if (target == GL_ARRAY_BUFFER && m_currentBoundArrayBuffer != id)
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, id);
-            m_currentBoundArrayBuffer = id;
-        }
-        else if (target == GL_ELEMENT_ARRAY_BUFFER && m_currentBoundArrayElementBuffer != id)
-        {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
-            m_currentBoundArrayElementBuffer = id;
-        }
-        else
-        {
-            glBindBuffer(target, id);
-        }
+        m_state.bindTexture(bindingIndex, GL_TEXTURE_CUBE_MAP, texture);
     }
 
-    auto bindTexture(const GLuint bindingIndex, const GLuint & texture) -> void
+    auto bindTextureBuffer(const GLuint bindingIndex, const GLuint & texture) -> void
     {
-        assert(bindingIndex < MaxTextures);
-        if (m_currentTextures[bindingIndex] != texture)
-        {
-            const GLenum target = GL_TEXTURE0 + bindingIndex;
-
-            if (m_currentBoundTextureTarget != target)
-            {
-                glActiveTexture(target);
-                m_currentBoundTextureTarget = target;
-            }
-
-            glBindTexture(GL_TEXTURE_2D, texture);
-            m_currentTextures[bindingIndex] = texture;
-        }
+        m_state.bindTexture(bindingIndex, GL_TEXTURE_BUFFER, texture);
     }
 
-    auto bindCubemap(const GLuint bindingIndex, const GLuint & texture) -> void
+    /**
+     * Bind a range of the uniform ring to a uniform block binding point. Ranges are only valid for the current frame.
+     */
+    auto bindUniformBlock(const UniformBlockBinding binding, const RingAllocation & allocation) -> void
     {
-        assert(bindingIndex < MaxTextures);
-        if (m_currentTextures[bindingIndex] != texture)
-        {
-            const GLenum target = GL_TEXTURE0 + bindingIndex;
-
-            if (m_currentBoundTextureTarget != target)
-            {
-                glActiveTexture(target);
-                m_currentBoundTextureTarget = target;
-            }
-
-            glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-            m_currentTextures[bindingIndex] = texture;
-        }
+        const auto index = static_cast<GLuint>(binding);
+        assert(index < MaxUniformBlockBindings);
+
+        m_state.bindUniformBufferRange(index, m_uniformRing.id(), m_uniformRing.bufferOffset(allocation),
+                                       allocation.size);
     }
 
-    auto getVertexArray(const VertexArrayFlags flags) -> VertexArray &
+    /**
+     * Every bind and state change of the context goes through it.
+     */
+    [[nodiscard]] auto stateCache() noexcept -> OpenGL::StateCache & { return m_state; }
+
+    auto getGeometryArena(const VertexArrayFlags flags) -> GeometryArena &
     {
-        return m_vertexArrays[flags];
+        return m_geometryArenas.try_emplace(flags, &m_state, flags).first->second;
     }
 
+    [[nodiscard]]
+    auto
+    uploadGeometry(VertexArrayFlags flags, std::span<const std::byte> vertices, std::span<const GLuint> indices)
+        -> GeometryAllocation;
+
     [[nodiscard]]
     auto
     loadModel(const std::string_view & id, const std::string & path, bool binary)
@@ -213,6 +155,26 @@ public:
 
     [[nodiscard]] auto getShaderManager() -> ShaderManager & { return m_shaderManager; }
 
+    [[nodiscard]] auto uniformRing() -> UniformRing & { return m_uniformRing; }
+
+    [[nodiscard]] auto workers() -> ThreadPool & { return m_workers; }
+
+    [[nodiscard]] auto textureStreamer() -> TextureStreamer & { return m_textureStreamer; }
+
+    [[nodiscard]] auto poseCache() -> PoseCache & { return m_poseCache; }
+
+    [[nodiscard]] auto animationLod() -> AnimationLodSettings & { return m_animationLod; }
+
+    /**
+     * Diffuse light of the environment, sent to every program in the FrameData block.
+     */
+    auto setIrradiance(const IrradianceSH & irradiance) -> void { m_irradiance = irradiance; }
+
+    /**
+     * Camera frustum, computed before the update of the frame.
+     */
+    [[nodiscard]] auto frustum() const -> const Frustum & { return m_frustum; }
+
     [[nodiscard]] auto getModel(const std::string_view & id) const -> std::optional<std::reference_wrapper<Model> >
     {
         const auto it = m_models.find(id);
@@ -262,7 +224,7 @@ static constexpr GLfloat cubeStrip[] = {
 };
 
 // TODO move
-export void renderQuad()
+export void renderQuad(OpenGL::StateCache & state)
 {
     constexpr size_t stride = 5;
 
@@ -271,8 +233,8 @@ export void renderQuad()
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
 
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        state.bindVertexArray(quadVAO);
+        state.bindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadStrip), &quadStrip, GL_STATIC_DRAW);
 
         glEnableVertexAttribArray(0);
@@ -292,12 +254,11 @@ export void renderQuad()
             bufferOffset(3 * sizeof(float)));
     }
 
-    glBindVertexArray(quadVAO);
+    state.bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, std::size(quadStrip) / stride);
-    glBindVertexArray(0);
 }
 
-export void renderCube()
+export void renderCube(OpenGL::StateCache & state)
 {
     constexpr size_t stride = 3;
 
@@ -306,8 +267,8 @@ export void renderCube()
         glGenVertexArrays(1, &cubeVAO);
         glGenBuffers(1, &cubeVBO);
 
-        glBindVertexArray(cubeVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        state.bindVertexArray(cubeVAO);
+        state.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(cubeStrip), &cubeStrip, GL_STATIC_DRAW);
 
         glEnableVertexAttribArray(0);
@@ -320,7 +281,6 @@ export void renderCube()
             nullptr);
     }
 
-    glBindVertexArray(cubeVAO);
+    state.bindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, std::size(cubeStrip) / stride);
-    glBindVertexArray(0);
 }
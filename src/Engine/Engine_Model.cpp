@@ -11,106 +11,248 @@ module;
 module Engine;
 import std;
 import glm;
+import Engine.CookedModel;
+import Engine.CookedTexture;
+import Engine.TextureStreamer;
 import OpenGL;
+import OpenGL.StateCache;
+import OpenGL.Utility;
 import Utility;
 
-static auto makeGlBuffer(Engine & engine, const Buffer * buffers, BufferView & bufferView) -> GLuint
+/**
+ * Convert an accessor to the arena format of its attribute and write it in the interleaved vertices.
+ */
+static auto writeAttribute(const ModelRenderInfo & renderInfo, const AccessorIndex accessorIdx,
+                           const GLuint location, const VertexLayout & layout, std::vector<std::byte> & vertices)
+    -> void
 {
-    if (bufferView.glBuffer.has_value() == 0)
+    const auto & accessor = renderInfo.accessors[accessorIdx];
+    const auto & format = vertexAttributeFormats[location];
+    const auto * src = accessorData(renderInfo, accessor);
+    auto * dst = vertices.data() + layout.offsets[location];
+
+    const auto componentCount = std::min(accessor.componentCount, format.componentCount);
+
+    for (size_t v = 0; v < accessor.count; ++v)
     {
-        GLuint glBuffer = 0;
+        const auto * element = src + v * accessor.byteStride;
+        auto * vertex = dst + v * layout.stride;
 
-        const auto & buffer = buffers[bufferView.buffer];
+        if (format.isInteger)
+        {
+            GLushort values[4]{};
+            for (GLint c = 0; c < componentCount; ++c)
+                values[c] = static_cast<GLushort>(readIndex(element + c * accessor.componentSize,
+                                                            accessor.componentType));
+            std::memcpy(vertex, values, format.size);
+        }
+        else
+        {
+            GLfloat values[4]{0, 0, 0, 1};
+            for (GLint c = 0; c < componentCount; ++c)
+                values[c] = readComponent(element + c * accessor.componentSize, accessor.componentType,
+                                          accessor.normalized);
+            std::memcpy(vertex, values, format.size);
+        }
+    }
+}
+
+static auto buildDrawBatches(MeshRenderInfo & mesh) -> void
+{
+    for (size_t i = 0; i < mesh.primitivesCount; ++i)
+    {
+        const auto & primitive = mesh.primitives[i];
+
+        const bool canBatch = [&mesh, &primitive]()
+        {
+            if (mesh.batches.empty())
+                return false;
+            const auto & first = mesh.primitives[mesh.batches.back().primitive];
+            return first.material == primitive.material
+                   && first.mode == primitive.mode
+                   && first.vertexArrayFlags == primitive.vertexArrayFlags;
+        }();
+
+        auto & batch = canBatch ? mesh.batches.back() : mesh.batches.emplace_back(DrawBatch{.primitive = i});
+        batch.counts.push_back(primitive.geometry.indexCount);
+        batch.indexOffsets.push_back(primitive.geometry.indexOffset());
+        batch.baseVertices.push_back(primitive.geometry.baseVertex);
+    }
+}
 
-        glGenBuffers(1, &glBuffer);
-        engine.bindBuffer(bufferView.target, glBuffer);
-        glBufferData(bufferView.target, bufferView.byteLength, &buffer.data.at(bufferView.byteOffset), GL_STATIC_DRAW);
+static auto restTransformsRecursive(const ModelRenderInfo & renderInfo, const int nodeIndex, glm::mat4 transform,
+                                    std::vector<glm::mat4> & transforms) -> void
+{
+    const NodeRenderInfo & node = renderInfo.nodes[nodeIndex];
 
-        bufferView.glBuffer = glBuffer;
-        return glBuffer;
+    if (const auto * mat = std::get_if<glm::mat4>(&node.transform))
+    {
+        transform *= *mat;
     }
     else
     {
-        return *bufferView.glBuffer;
+        const auto & trs = std::get<TRS>(node.transform);
+        transform = glm::translate(transform, trs.translation);
+        transform *= glm::gtc::mat4_cast(trs.rotation);
+        transform = glm::scale(transform, trs.scale);
     }
+
+    transforms[nodeIndex] = transform;
+
+    for (int i = 0; i < node.childrenCount; ++i)
+        restTransformsRecursive(renderInfo, node.children[i], transform, transforms);
 }
 
-static auto loadTexture(const tinygltf::Model & model, const int & textureId, std::vector<GLuint> & textures,
-                        const GLint internalFormat) -> void
+/**
+ * Mark the detail joints of a subtree. Returns whether the subtree holds a mesh or a joint that is not a detail, its
+ * root must then keep animating.
+ */
+static auto markDetailNodesRecursive(ModelRenderInfo & renderInfo, const int nodeIndex, const int parentIndex,
+                                     const std::vector<glm::mat4> & transforms, const std::vector<bool> & joints,
+                                     const float maxBoneLength) -> bool
 {
-    if (textures[textureId] > 0)
-        return;
+    const NodeRenderInfo & node = renderInfo.nodes[nodeIndex];
 
-    const auto & texture = model.textures[textureId];
-    assert(texture.source >= 0);
+    bool animated = node.mesh >= 0;
+    for (size_t i = 0; i < node.childrenCount; ++i)
+    {
+        if (markDetailNodesRecursive(renderInfo, node.children[i], nodeIndex, transforms, joints, maxBoneLength))
+            animated = true;
+    }
 
-    GLuint glTexture = 0;
-    const auto & image = model.images[texture.source];
+    if (!joints[nodeIndex])
+        return animated;
+    if (animated || parentIndex < 0)
+        return true;
+
+    const float boneLength = glm::length(glm::vec3(transforms[nodeIndex][3]) - glm::vec3(transforms[parentIndex][3]));
+    if (boneLength >= maxBoneLength)
+        return true;
 
-    if (!image.image.empty())
+    renderInfo.detailNodes[nodeIndex] = true;
+    return false;
+}
+
+/**
+ * Bounding sphere of the rest pose from the POSITION min / max, and detail nodes: skin joints whose bone, to their
+ * parent, is shorter than a tenth of the bounding radius, and whose child joints are all details. Nodes above a mesh
+ * are never details.
+ */
+static auto computeBounds(const tinygltf::Model & model, ModelRenderInfo & renderInfo) -> void
+{
+    constexpr float DetailNodeRatio = 0.1f;
+    constexpr float SkinnedBoundsMargin = 1.25f; // Animations may move vertices out of the rest pose bounds
+
+    std::vector<glm::mat4> transforms(renderInfo.nodesCount, glm::identity<glm::mat4>());
+    for (int i = 0; i < renderInfo.rootNodesCount; ++i)
+        restTransformsRecursive(renderInfo, renderInfo.rootNodes[i], glm::identity<glm::mat4>(), transforms);
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    bool skinned = false;
+
+    for (int nodeIndex = 0; nodeIndex < renderInfo.nodesCount; ++nodeIndex)
     {
-        glGenTextures(1, &glTexture);
-        glBindTexture(GL_TEXTURE_2D, glTexture);
+        const auto & node = renderInfo.nodes[nodeIndex];
+        if (node.mesh < 0)
+            continue;
+
+        // Skinned meshes ignore their node transform, vertices are placed by the joints
+        const glm::mat4 transform = node.skin > -1 ? glm::identity<glm::mat4>() : transforms[nodeIndex];
+        skinned |= node.skin > -1;
 
-        if (texture.sampler >= 0)
+        for (const auto & primitive: model.meshes[node.mesh].primitives)
         {
-            const auto & sampler = model.samplers[texture.sampler];
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-            if (sampler.minFilter > -1)
-            {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
-            }
-            if (sampler.magFilter > -1)
+            const auto & accessor = model.accessors[primitive.attributes.at("POSITION")];
+            if (accessor.minValues.size() != 3 || accessor.maxValues.size() != 3)
+                continue;
+
+            for (int corner = 0; corner < 8; ++corner)
             {
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+                const glm::vec3 point(
+                    (corner & 1 ? accessor.maxValues : accessor.minValues)[0],
+                    (corner & 2 ? accessor.maxValues : accessor.minValues)[1],
+                    (corner & 4 ? accessor.maxValues : accessor.minValues)[2]);
+                const glm::vec3 transformed = transform * glm::vec4(point, 1.0f);
+                min = glm::min(min, transformed);
+                max = glm::max(max, transformed);
             }
         }
-        else
-        {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        }
+    }
 
-        GLenum format = GL_RGBA;
-        if (image.component == 1)
-        {
-            format = GL_RED;
-        }
-        else if (image.component == 2)
-        {
-            format = GL_RG;
-        }
-        else if (image.component == 3)
-        {
-            format = GL_RGB;
-        }
+    if (min.x > max.x)
+        return;
 
-        GLenum type = GL_UNSIGNED_BYTE;
-        if (image.bits == 16)
-        {
-            type = GL_UNSIGNED_SHORT;
-        }
-        else if (image.bits == 32)
-        {
-            type = GL_UNSIGNED_INT;
-        }
+    renderInfo.boundsCenter = (min + max) * 0.5f;
+    renderInfo.boundsRadius = glm::length(max - min) * 0.5f * (skinned ? SkinnedBoundsMargin : 1.0f);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format,
-                     type, image.image.data());
-        glGenerateMipmap(GL_TEXTURE_2D);
+    std::vector<bool> joints(renderInfo.nodesCount, false);
+    for (size_t i = 0; i < renderInfo.skinsCount; ++i)
+    {
+        for (const int joint: renderInfo.skins[i].joints)
+            joints[joint] = true;
     }
 
-    textures[textureId] = glTexture;
+    renderInfo.detailNodes.assign(renderInfo.nodesCount, false);
+    for (size_t i = 0; i < renderInfo.rootNodesCount; ++i)
+    {
+        markDetailNodesRecursive(renderInfo, renderInfo.rootNodes[i], -1, transforms, joints,
+                                 renderInfo.boundsRadius * DetailNodeRatio);
+    }
 }
 
-auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
+/**
+ * Neutral texel shown until the texture is loaded, the material factors alone.
+ */
+static auto placeholderTexel(const TextureUsage usage) -> std::array<std::uint8_t, 4>
 {
-    std::vector<GLuint> textures;
-    std::vector<Animation> animations;
-    ModelRenderInfo renderInfo;
+    switch (usage)
+    {
+        case TextureUsage::Normal:
+            return {128, 128, 255, 255};
+        case TextureUsage::Emissive:
+            return {0, 0, 0, 255};
+        default:
+            return {255, 255, 255, 255};
+    }
+}
 
-    textures.resize(model.textures.size(), 0);
+/**
+ * Keep the encoded image of the texture, with the usage of its first material slot.
+ */
+static auto addTextureSource(const tinygltf::Model & model, const int & textureId,
+                             std::vector<ModelTexture> & textures, const TextureUsage usage) -> void
+{
+    if (!textures[textureId].image.empty())
+        return;
+
+    const auto & texture = model.textures[textureId];
+    assert(texture.source >= 0);
+
+    const auto & image = model.images[texture.source];
+    if (image.image.empty())
+        return;
+
+    // Images are kept encoded, see keepEncodedImage
+    assert(image.as_is);
+    auto & source = textures[textureId];
+    source.image.assign(reinterpret_cast<const std::byte *>(image.image.data()),
+                        reinterpret_cast<const std::byte *>(image.image.data() + image.image.size()));
+    source.usage = usage;
+    if (texture.sampler >= 0)
+    {
+        const auto & sampler = model.samplers[texture.sampler];
+        source.sampler = {sampler.wrapS, sampler.wrapT, sampler.minFilter, sampler.magFilter};
+    }
+}
+
+auto Model::Cook(const tinygltf::Model & model) -> CookedModel
+{
+    CookedModel cooked;
+    auto & renderInfo = cooked.renderInfo;
+    auto & textures = cooked.textures;
+
+    textures.resize(model.textures.size());
 
     renderInfo.nodesCount = model.nodes.size();
     if (renderInfo.nodesCount > 0)
@@ -244,15 +386,7 @@ auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
 
             skinRenderInfo.skeleton = skin.skeleton;
             skinRenderInfo.joints = skin.joints;
-
-            glGenBuffers(1, &skinRenderInfo.glBuffer);
-            engine.bindBuffer(GL_UNIFORM_BUFFER, skinRenderInfo.glBuffer);
             assert(skinRenderInfo.joints.size() <= MAX_JOINTS && "Too many joints");
-            glBufferData(GL_UNIFORM_BUFFER,
-                         static_cast<GLsizeiptr>(skinRenderInfo.joints.size() * sizeof(glm::mat4)),
-                         nullptr,
-                         GL_DYNAMIC_DRAW);
-            glBindBuffer(GL_UNIFORM_BUFFER, 0);
         }
     }
 
@@ -275,18 +409,9 @@ auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
 
                 VertexArrayFlags vertexArrayFlags = VertexArrayHasNone;
 
-                if (primitive.indices >= 0)
-                {
-                    makeGlBuffer(engine, renderInfo.buffers.get(),
-                                 renderInfo.bufferViews[renderInfo.accessors[primitive.indices].bufferView]);
-                }
-
                 primitiveRenderInfo.attributes.reserve(primitive.attributes.size());
                 for (const auto & [attributeName, accessorId]: primitive.attributes)
                 {
-                    makeGlBuffer(engine, renderInfo.buffers.get(),
-                                 renderInfo.bufferViews[renderInfo.accessors[accessorId].bufferView]);
-
                     PrimitiveAttributeType type{PrimitiveAttributeType::Invalid};
 
                     if (attributeName == "POSITION")
@@ -337,6 +462,39 @@ auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
                 primitiveRenderInfo.mode = primitive.mode;
                 primitiveRenderInfo.indices = primitive.indices;
                 primitiveRenderInfo.vertexArrayFlags = vertexArrayFlags;
+
+                assert((vertexArrayFlags & VertexArrayHasPosition) && "A primitive must have positions");
+
+                const auto layout = VertexLayout::From(vertexArrayFlags);
+                const auto vertexCount = renderInfo.accessors[primitive.attributes.at("POSITION")].count;
+
+                std::vector<std::byte> vertices(vertexCount * layout.stride);
+                for (const auto & attribute: primitiveRenderInfo.attributes)
+                {
+                    if (attribute.type != PrimitiveAttributeType::Invalid)
+                    {
+                        assert(renderInfo.accessors[attribute.accessor].count == vertexCount);
+                        writeAttribute(renderInfo, attribute.accessor, static_cast<GLuint>(attribute.type), layout,
+                                       vertices);
+                    }
+                }
+
+                std::vector<GLuint> indices;
+                if (primitive.indices >= 0)
+                {
+                    const auto & accessor = renderInfo.accessors[primitive.indices];
+                    const auto * data = accessorData(renderInfo, accessor);
+                    indices.resize(accessor.count);
+                    for (size_t k = 0; k < accessor.count; ++k)
+                        indices[k] = readIndex(data + k * accessor.byteStride, accessor.componentType);
+                }
+                else
+                {
+                    indices.resize(vertexCount);
+                    std::iota(indices.begin(), indices.end(), 0u);
+                }
+
+                cooked.geometries.push_back({std::move(vertices), std::move(indices)});
             }
         }
     }
@@ -371,33 +529,28 @@ auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
 
             if (material.pbr.baseColorTexture.index >= 0)
             {
-                loadTexture(model, material.pbr.baseColorTexture.index, textures, GL_SRGB_ALPHA);
+                addTextureSource(model, material.pbr.baseColorTexture.index, textures, TextureUsage::BaseColor);
                 material.shaderFlags |= ShaderFlags::HasBaseColorMap;
             }
             if (material.pbr.metallicRoughnessTexture.index >= 0)
             {
-                loadTexture(model, material.pbr.metallicRoughnessTexture.index, textures, GL_RGB);
+                addTextureSource(model, material.pbr.metallicRoughnessTexture.index, textures,
+                            TextureUsage::MetallicRoughness);
                 material.shaderFlags |= ShaderFlags::HasMetalRoughnessMap;
             }
             if (material.normalTexture.index >= 0)
             {
-                loadTexture(model, material.normalTexture.index, textures, GL_RGB);
+                addTextureSource(model, material.normalTexture.index, textures, TextureUsage::Normal);
                 material.shaderFlags |= ShaderFlags::HasNormalMap;
             }
             if (material.emissiveTexture.index >= 0)
             {
-                loadTexture(model, material.emissiveTexture.index, textures, GL_SRGB);
+                addTextureSource(model, material.emissiveTexture.index, textures, TextureUsage::Emissive);
                 material.shaderFlags |= ShaderFlags::HasEmissiveMap;
             }
         }
     }
 
-    animations.reserve(model.animations.size());
-    for (const auto & animation: model.animations)
-    {
-        animations.emplace_back(Animation::Create(renderInfo, animation));
-    }
-
     assert(!model.scenes.empty() && "Library GLTF are not supported");
     assert(model.defaultScene != -1 && "A default scene is required");
     const auto & scene = model.scenes[model.defaultScene];
@@ -408,8 +561,53 @@ auto Model::Create(Engine & engine, const tinygltf::Model & model) -> Model
     static_assert(std::is_trivially_copyable_v<NodeIndex>);
     std::memcpy(renderInfo.rootNodes.get(), scene.nodes.data(), sizeof(NodeIndex) * renderInfo.rootNodesCount);
 
+    computeBounds(model, renderInfo);
+
+    cooked.animations.reserve(model.animations.size());
+    for (const auto & animation: model.animations)
+    {
+        cooked.animations.emplace_back(Animation::Create(renderInfo, animation));
+    }
+
+    return cooked;
+}
+
+auto Model::Create(Engine & engine, CookedModel && cooked) -> Model
+{
+    static const bool s3tc = OpenGL::hasExtension("GL_EXT_texture_compression_s3tc");
+    static const bool s3tcSrgb = s3tc && OpenGL::hasExtension("GL_EXT_texture_sRGB");
+
+    auto & renderInfo = cooked.renderInfo;
+
+    size_t geometryIdx = 0;
+    for (size_t i = 0; i < renderInfo.meshesCount; ++i)
+    {
+        auto & mesh = renderInfo.meshes[i];
+        for (size_t j = 0; j < mesh.primitivesCount; ++j)
+        {
+            auto & primitive = mesh.primitives[j];
+            const auto & geometry = cooked.geometries[geometryIdx++];
+            primitive.geometry = engine.uploadGeometry(primitive.vertexArrayFlags, geometry.vertices,
+                                                       geometry.indices);
+        }
+
+        buildDrawBatches(mesh);
+    }
+
+    std::vector<GLuint> textures(cooked.textures.size(), 0);
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        const auto & texture = cooked.textures[i];
+        if (texture.image.empty())
+            continue;
+
+        textures[i] = engine.textureStreamer().request(engine.stateCache(), texture.image,
+                                                       cookSettings(texture, s3tc, s3tcSrgb),
+                                                       placeholderTexel(texture.usage));
+    }
+
     return {
-        std::move(textures), std::move(animations), std::move(renderInfo)
+        std::move(textures), std::move(cooked.animations), std::move(renderInfo)
     };
 }
 
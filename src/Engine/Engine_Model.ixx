@@ -10,6 +10,7 @@ module;
 export module Engine:Mesh;
 import std;
 import Engine.Animation;
+import Engine.CookedModel;
 import Engine.RenderInfo;
 import :Engine;
 import OpenGL;
@@ -22,7 +23,16 @@ private:
     ModelRenderInfo m_renderInfo;
 
 public:
-    static auto Create(Engine & engine, const tinygltf::Model & model) -> Model;
+    /**
+     * Convert the glTF model to the render info, vertices and animations of the engine. No GL call, cooking also
+     * runs without a context.
+     */
+    static auto Cook(const tinygltf::Model & model) -> CookedModel;
+
+    /**
+     * Upload the geometry and start streaming the textures of a cooked model.
+     */
+    static auto Create(Engine & engine, CookedModel && cooked) -> Model;
 
     Model(std::vector<GLuint> && textures, std::vector<Animation> && animations,
           ModelRenderInfo && renderInfo) : m_textures(std::move(textures)),
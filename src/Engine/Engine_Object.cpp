@@ -18,6 +18,12 @@ auto Object::update(Engine& engine) -> void
         component->onUpdate(engine);
 }
 
+auto Object::preRender(Engine& engine) -> void
+{
+    for (auto& component : m_components)
+        component->onPreRender(engine);
+}
+
 auto Object::render(Engine& engine) -> void
 {
     for (auto& component : m_components)
@@ -38,6 +38,7 @@ private:
 
     auto willUpdate(Engine& engine) -> void;
     auto update(Engine& engine) -> void;
+    auto preRender(Engine& engine) -> void;
     auto render(Engine& engine) -> void;
     auto postRender(Engine& engine) -> void;
 
@@ -0,0 +1,440 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "42runConfig.h"
+#include "glad/gl.h"
+
+module Engine.EnvironmentBake;
+import std;
+import glm;
+import DataCache;
+import Engine.SphericalHarmonics;
+import OpenGL.PixelPacking;
+import Utility.Simd;
+
+namespace
+{
+    constexpr float Pi = std::numbers::pi_v<float>;
+    constexpr float MaxHdrValue = 20.0f; // Same clamp as prefilter.frag
+    constexpr std::size_t RowsPerJob = 4;
+    constexpr std::uint32_t BrdfSampleCount = 1024;
+
+    auto radicalInverse(std::uint32_t bits) -> float
+    {
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return static_cast<float>(bits) * 2.3283064365386963e-10f; // / 0x100000000
+    }
+
+    auto hammersley(const std::uint32_t i, const std::uint32_t count) -> glm::vec2
+    {
+        return {static_cast<float>(i) / static_cast<float>(count), radicalInverse(i)};
+    }
+
+    /**
+     * Half vector in the tangent space of the normal, z is the normal.
+     */
+    auto importanceSampleGgx(const glm::vec2 xi, const float roughness) -> glm::vec3
+    {
+        const float a = roughness * roughness;
+
+        const float phi = 2.0f * Pi * xi.x;
+        const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+        return {std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta};
+    }
+
+    /**
+     * Tangent and bitangent around a normal, chosen as the shaders choose them.
+     */
+    auto tangentFrame(const glm::vec3 & normal) -> std::pair<glm::vec3, glm::vec3>
+    {
+        const glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        const glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+        return {tangent, glm::cross(normal, tangent)};
+    }
+
+    /**
+     * Direction through the center of a texel, from the cube map face selection table of the GL specification.
+     */
+    auto texelDirection(const GLuint face, const std::size_t i, const std::size_t j, const std::size_t size)
+        -> glm::vec3
+    {
+        const float s = 2.0f * (static_cast<float>(i) + 0.5f) / static_cast<float>(size) - 1.0f;
+        const float t = 2.0f * (static_cast<float>(j) + 0.5f) / static_cast<float>(size) - 1.0f;
+        switch (face)
+        {
+            case 0:
+                return glm::normalize(glm::vec3(1.0f, -t, -s));
+            case 1:
+                return glm::normalize(glm::vec3(-1.0f, -t, s));
+            case 2:
+                return glm::normalize(glm::vec3(s, 1.0f, t));
+            case 3:
+                return glm::normalize(glm::vec3(s, -1.0f, -t));
+            case 4:
+                return glm::normalize(glm::vec3(s, -t, 1.0f));
+            default:
+                return glm::normalize(glm::vec3(-s, -t, -1.0f));
+        }
+    }
+
+    /**
+     * GL_LINEAR with GL_CLAMP_TO_EDGE, u and v in [0, 1].
+     */
+    auto sampleBilinear(const float * texels, const std::size_t width, const std::size_t height,
+                        const std::size_t channels, const float u, const float v) -> glm::vec3
+    {
+        const float x = u * static_cast<float>(width) - 0.5f;
+        const float y = v * static_cast<float>(height) - 0.5f;
+        const float x0 = std::floor(x);
+        const float y0 = std::floor(y);
+        const float fx = x - x0;
+        const float fy = y - y0;
+
+        const auto maxX = static_cast<float>(width - 1);
+        const auto maxY = static_cast<float>(height - 1);
+        const auto ix0 = static_cast<std::size_t>(std::clamp(x0, 0.0f, maxX));
+        const auto ix1 = static_cast<std::size_t>(std::clamp(x0 + 1.0f, 0.0f, maxX));
+        const auto iy0 = static_cast<std::size_t>(std::clamp(y0, 0.0f, maxY));
+        const auto iy1 = static_cast<std::size_t>(std::clamp(y0 + 1.0f, 0.0f, maxY));
+
+        const auto texel = [&](const std::size_t ix, const std::size_t iy)
+        {
+            const float * p = texels + (iy * width + ix) * channels;
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+        return glm::mix(glm::mix(texel(ix0, iy0), texel(ix1, iy0), fx),
+                        glm::mix(texel(ix0, iy1), texel(ix1, iy1), fx), fy);
+    }
+
+    /**
+     * Light directions of prefilter.frag in tangent space, with V = N. They only depend on the roughness, so they
+     * are computed once per level. Samples below the horizon have no weight and are dropped. The lanes are padded to
+     * a multiple of 4 with the normal and no weight.
+     */
+    struct PrefilterSamples
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> weight;
+        float totalWeight{0.0f};
+
+        PrefilterSamples(const float roughness, const std::uint32_t count)
+        {
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                const glm::vec3 h = importanceSampleGgx(hammersley(i, count), roughness);
+                const glm::vec3 l = glm::normalize(2.0f * h.z * h - glm::vec3(0.0f, 0.0f, 1.0f));
+                if (l.z <= 0.0f)
+                    continue;
+
+                x.push_back(l.x);
+                y.push_back(l.y);
+                z.push_back(l.z);
+                weight.push_back(l.z);
+                totalWeight += l.z;
+            }
+
+            while (weight.size() % 4 != 0)
+            {
+                x.push_back(0.0f);
+                y.push_back(0.0f);
+                z.push_back(1.0f);
+                weight.push_back(0.0f);
+            }
+        }
+    };
+}
+
+auto irradianceCacheKey(const std::filesystem::path & hdrPath) -> std::expected<std::filesystem::path, std::string>
+{
+    CacheKey key("sh9", 1);
+    TRY(key.addFile(hdrPath));
+    return key.path();
+}
+
+auto prefilterCacheKey(const std::filesystem::path & hdrPath, const EnvironmentSettings & settings)
+    -> std::expected<std::filesystem::path, std::string>
+{
+    CacheKey key("prefilter", 2);
+    TRY(key.addFile(hdrPath));
+    TRY(key.addFile(RESOURCE_PATH"shaders/cubemap.vert"));
+    TRY(key.addFile(RESOURCE_PATH"shaders/equirectangular.frag"));
+    TRY(key.addFile(RESOURCE_PATH"shaders/prefilter.frag"));
+    key.add(settings.cubemapSize).add(settings.prefilterSize).add(settings.prefilterMaxLevel)
+       .add(settings.prefilterFormat);
+    return key.path();
+}
+
+auto brdfCacheKey(const EnvironmentSettings & settings) -> std::expected<std::filesystem::path, std::string>
+{
+    CacheKey key("brdf", 1);
+    TRY(key.addFile(RESOURCE_PATH"shaders/texcoord.vert"));
+    TRY(key.addFile(RESOURCE_PATH"shaders/brdf.frag"));
+    key.add(settings.cubemapSize).add(GL_RG).add(GL_HALF_FLOAT);
+    return key.path();
+}
+
+CubemapImage::CubemapImage(const GLuint size, const GLuint maxLevel) : m_size(size), m_maxLevel(maxLevel)
+{
+    m_faces.reserve((maxLevel + 1) * 6);
+    for (GLuint level = 0; level <= maxLevel; ++level)
+    {
+        for (GLuint face = 0; face < 6; ++face)
+            m_faces.emplace_back(static_cast<std::size_t>(levelSize(level)) * levelSize(level) * 3);
+    }
+}
+
+auto CubemapImage::sample(const Float4 x, const Float4 y, const Float4 z) const -> std::array<Float4, 3>
+{
+    const Float4 zero = Float4::broadcast(0.0f);
+    const Float4 ax = abs(x);
+    const Float4 ay = abs(y);
+    const Float4 az = abs(z);
+
+    // Face selection of the GL specification, every major axis is computed and one is selected per lane
+    const Mask4 majorX = (ax >= ay) & (ax >= az);
+    const Mask4 majorY = ay >= az;
+    const Mask4 positiveX = x > zero;
+    const Mask4 positiveY = y > zero;
+    const Mask4 positiveZ = z > zero;
+
+    const auto broadcast = [](const std::uint32_t value) { return UInt4::broadcast(value); };
+    const UInt4 faceIndices = select(majorX, select(positiveX, broadcast(0), broadcast(1)),
+                                     select(majorY, select(positiveY, broadcast(2), broadcast(3)),
+                                            select(positiveZ, broadcast(4), broadcast(5))));
+    const Float4 sc = select(majorX, select(positiveX, zero - z, z),
+                             select(majorY, x, select(positiveZ, x, zero - x)));
+    const Float4 tc = select(majorX, zero - y, select(majorY, select(positiveY, z, zero - z), zero - y));
+    const Float4 ma = select(majorX, ax, select(majorY, ay, az));
+
+    // GL_LINEAR with GL_CLAMP_TO_EDGE, as sampleBilinear
+    const Float4 half = Float4::broadcast(0.5f);
+    const Float4 one = Float4::broadcast(1.0f);
+    const Float4 size = Float4::broadcast(static_cast<float>(m_size));
+    const Float4 maxCoordinate = Float4::broadcast(static_cast<float>(m_size - 1));
+    const Float4 px = half * (sc / ma + one) * size - half;
+    const Float4 py = half * (tc / ma + one) * size - half;
+    const Float4 x0 = floor(px);
+    const Float4 y0 = floor(py);
+    const Float4 fx = px - x0;
+    const Float4 fy = py - y0;
+
+    const auto index = [&](const Float4 coordinate)
+    {
+        std::array<std::uint32_t, 4> indices;
+        truncate(min(max(coordinate, zero), maxCoordinate)).store(indices.data());
+        return indices;
+    };
+    const auto ix0 = index(x0);
+    const auto ix1 = index(x0 + one);
+    const auto iy0 = index(y0);
+    const auto iy1 = index(y0 + one);
+
+    std::array<std::uint32_t, 4> faces;
+    faceIndices.store(faces.data());
+
+    // No gather instruction, each lane reads its own face
+    const auto texels = [&](const std::array<std::uint32_t, 4> & ix, const std::array<std::uint32_t, 4> & iy)
+    {
+        std::array<const float *, 4> p;
+        for (std::size_t lane = 0; lane < 4; ++lane)
+            p[lane] = m_faces[faces[lane]].data() + (static_cast<std::size_t>(iy[lane]) * m_size + ix[lane]) * 3;
+
+        return std::array{Float4::set(p[0][0], p[1][0], p[2][0], p[3][0]),
+                          Float4::set(p[0][1], p[1][1], p[2][1], p[3][1]),
+                          Float4::set(p[0][2], p[1][2], p[2][2], p[3][2])};
+    };
+    const auto mix = [](const std::array<Float4, 3> & a, const std::array<Float4, 3> & b, const Float4 t)
+    {
+        const Float4 s = Float4::broadcast(1.0f) - t;
+        return std::array{a[0] * s + b[0] * t, a[1] * s + b[1] * t, a[2] * s + b[2] * t};
+    };
+
+    return mix(mix(texels(ix0, iy0), texels(ix1, iy0), fx), mix(texels(ix0, iy1), texels(ix1, iy1), fx), fy);
+}
+
+auto CubemapImage::encode(const GLint internalFormat) const -> std::vector<std::byte>
+{
+    const auto pixelSize = OpenGL::rgbEncoding(internalFormat).pixelSize;
+
+    std::vector<std::byte> pixels;
+    for (const auto & texels: m_faces)
+    {
+        const std::size_t offset = pixels.size();
+        pixels.resize(offset + texels.size() / 3 * pixelSize);
+        OpenGL::encodeRgb(internalFormat, texels, std::span(pixels).subspan(offset));
+    }
+    return pixels;
+}
+
+auto equirectangularToCubemap(const Image & equirectangular, const GLuint size, ThreadPool & workers)
+    -> std::expected<CubemapImage, std::string>
+{
+    if (!equirectangular.isHdr() || equirectangular.nrChannels() < 3)
+    {
+        return std::unexpected<std::string>(std::in_place, "environment needs an RGB HDR image");
+    }
+
+    const auto width = static_cast<std::size_t>(equirectangular.width());
+    const auto height = static_cast<std::size_t>(equirectangular.height());
+    const auto channels = static_cast<std::size_t>(equirectangular.nrChannels());
+    const auto * pixels = static_cast<const float *>(equirectangular.data());
+
+    CubemapImage cubemap(size, 0);
+    workers.parallelFor(6 * static_cast<std::size_t>(size), RowsPerJob, [&](const std::size_t row)
+    {
+        const auto face = static_cast<GLuint>(row / size);
+        const std::size_t j = row % size;
+        float * out = cubemap.face(0, face).data() + j * size * 3;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            const glm::vec3 v = texelDirection(face, i, j, size);
+            // Same constants as c_invAtan
+            const float u = std::atan2(v.z, v.x) * 0.1591f + 0.5f;
+            const float t = std::asin(v.y) * 0.3183f + 0.5f;
+            const glm::vec3 color = sampleBilinear(pixels, width, height, channels, u, t);
+            out[i * 3] = color.r;
+            out[i * 3 + 1] = color.g;
+            out[i * 3 + 2] = color.b;
+        }
+    });
+    return cubemap;
+}
+
+/**
+ * The environment has a single level, as on the GPU path, so the level selection of prefilter.frag from the pdf of
+ * the samples always ends up on it and is skipped.
+ */
+auto prefilterCubemap(const CubemapImage & environment, const GLsizei size, const GLuint maxLevel,
+                      ThreadPool & workers) -> CubemapImage
+{
+    CubemapImage prefiltered(static_cast<GLuint>(size), maxLevel);
+    for (GLuint level = 0; level <= maxLevel; ++level)
+    {
+        const float roughness = maxLevel > 0 ? static_cast<float>(level) / static_cast<float>(maxLevel) : 0.0f;
+        const auto sampleCount = static_cast<std::uint32_t>(32.0f + (4096.0f - 32.0f) * roughness * roughness);
+        const PrefilterSamples samples(roughness, sampleCount);
+        const std::size_t count = samples.weight.size();
+        const std::size_t levelSize = prefiltered.levelSize(level);
+
+        workers.parallelFor(6 * levelSize, RowsPerJob, [&](const std::size_t row)
+        {
+            const auto face = static_cast<GLuint>(row / levelSize);
+            const std::size_t j = row % levelSize;
+            float * out = prefiltered.face(level, face).data() + j * levelSize * 3;
+
+            const Float4 maxValue = Float4::broadcast(MaxHdrValue);
+            for (std::size_t i = 0; i < levelSize; ++i)
+            {
+                const glm::vec3 n = texelDirection(face, i, j, levelSize);
+                const auto [tangent, bitangent] = tangentFrame(n);
+
+                std::array<Float4, 3> sum{Float4::broadcast(0.0f), Float4::broadcast(0.0f), Float4::broadcast(0.0f)};
+                for (std::size_t k = 0; k < count; k += 4)
+                {
+                    const Float4 sx = Float4::load(samples.x.data() + k);
+                    const Float4 sy = Float4::load(samples.y.data() + k);
+                    const Float4 sz = Float4::load(samples.z.data() + k);
+                    const auto direction = [&](const float t, const float b, const float normal)
+                    {
+                        return Float4::broadcast(t) * sx + Float4::broadcast(b) * sy + Float4::broadcast(normal) * sz;
+                    };
+
+                    const auto sample = environment.sample(direction(tangent.x, bitangent.x, n.x),
+                                                           direction(tangent.y, bitangent.y, n.y),
+                                                           direction(tangent.z, bitangent.z, n.z));
+                    const Float4 weight = Float4::load(samples.weight.data() + k);
+                    for (std::size_t c = 0; c < 3; ++c)
+                        sum[c] = sum[c] + min(sample[c], maxValue) * weight;
+                }
+
+                const glm::vec3 color = glm::vec3(reduceAdd(sum[0]), reduceAdd(sum[1]), reduceAdd(sum[2]))
+                                        / (samples.totalWeight + 0.0001f);
+
+                out[i * 3] = color.r;
+                out[i * 3 + 1] = color.g;
+                out[i * 3 + 2] = color.b;
+            }
+        });
+    }
+    return prefiltered;
+}
+
+auto integrateBrdf(const GLuint size, ThreadPool & workers) -> std::vector<std::byte>
+{
+    std::vector<float> rg(static_cast<std::size_t>(size) * size * 2);
+    workers.parallelFor(size, RowsPerJob, [&](const std::size_t j)
+    {
+        const float roughness = (static_cast<float>(j) + 0.5f) / static_cast<float>(size);
+        const float k = roughness * roughness / 2.0f;
+
+        // N is +Z, its tangent frame maps the tangent space sample (x, y, z) to (y, -x, z). V lies in the XZ plane,
+        // the y of the half vectors is never used.
+        std::array<float, BrdfSampleCount> hx;
+        std::array<float, BrdfSampleCount> hz;
+        for (std::uint32_t i = 0; i < BrdfSampleCount; ++i)
+        {
+            const glm::vec3 h = importanceSampleGgx(hammersley(i, BrdfSampleCount), roughness);
+            hx[i] = h.y;
+            hz[i] = h.z;
+        }
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            const float nDotV = (static_cast<float>(i) + 0.5f) / static_cast<float>(size);
+            const float vx = std::sqrt(1.0f - nDotV * nDotV);
+            const float gV = nDotV / (nDotV * (1.0f - k) + k);
+
+            float a = 0.0f;
+            float b = 0.0f;
+            for (std::uint32_t s = 0; s < BrdfSampleCount; ++s)
+            {
+                const float vDotH = vx * hx[s] + nDotV * hz[s];
+                const float nDotL = std::max(2.0f * vDotH * hz[s] - nDotV, 0.0f);
+                const float clampedVDotH = std::max(vDotH, 0.0f);
+
+                const float gL = nDotL / (nDotL * (1.0f - k) + k);
+                const float gVis = gV * gL * clampedVDotH / (hz[s] * nDotV);
+                const float fc = std::pow(1.0f - clampedVDotH, 5.0f);
+
+                a += nDotL > 0.0f ? (1.0f - fc) * gVis : 0.0f;
+                b += nDotL > 0.0f ? fc * gVis : 0.0f;
+            }
+
+            rg[(j * size + i) * 2] = a / static_cast<float>(BrdfSampleCount);
+            rg[(j * size + i) * 2 + 1] = b / static_cast<float>(BrdfSampleCount);
+        }
+    });
+
+    std::vector<std::byte> pixels(rg.size() * sizeof(std::uint16_t));
+    OpenGL::packHalf(rg, {reinterpret_cast<std::uint16_t *>(pixels.data()), rg.size()});
+    return pixels;
+}
+
+auto bakeEnvironment(const std::filesystem::path & hdrPath, const Image & equirectangular,
+                     const EnvironmentSettings & settings, ThreadPool & workers) -> std::expected<void, std::string>
+{
+    TRY_V(const auto, irradiancePath, irradianceCacheKey(hdrPath));
+    TRY_V(const auto, prefilterPath, prefilterCacheKey(hdrPath, settings));
+    TRY_V(const auto, brdfPath, brdfCacheKey(settings));
+
+    TRY_V(const auto, irradiance, IrradianceSH::Project(equirectangular, workers));
+    TRY(irradiance.saveCache(irradiancePath));
+
+    TRY_V(const auto, environment, equirectangularToCubemap(equirectangular, settings.cubemapSize, workers));
+    const auto prefiltered = prefilterCubemap(environment, settings.prefilterSize, settings.prefilterMaxLevel, workers);
+    TRY(DataCache::writeFile(prefilterPath, prefiltered.encode(settings.prefilterFormat)));
+
+    TRY(DataCache::writeFile(brdfPath, integrateBrdf(settings.cubemapSize, workers)));
+    return {};
+}
@@ -0,0 +1,99 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module Engine.EnvironmentBake;
+import std;
+import glm;
+import Image;
+import Utility.Simd;
+import Utility.ThreadPool;
+
+/**
+ * Sizes and formats of the image based lighting maps. They are part of the cache keys, the game and the cook tool
+ * must use the same settings to share the maps.
+ */
+export struct EnvironmentSettings
+{
+    GLuint cubemapSize{512}; // Environment cubemap, and BRDF lookup table
+    GLsizei prefilterSize{512};
+    GLuint prefilterMaxLevel{4};
+    GLint prefilterFormat{GL_RGB16F};
+};
+
+/**
+ * The keys name the shaders of the GPU path, the CPU path computes the same maps and stores them under the same keys.
+ */
+export auto irradianceCacheKey(const std::filesystem::path & hdrPath)
+    -> std::expected<std::filesystem::path, std::string>;
+
+export auto prefilterCacheKey(const std::filesystem::path & hdrPath, const EnvironmentSettings & settings)
+    -> std::expected<std::filesystem::path, std::string>;
+
+export auto brdfCacheKey(const EnvironmentSettings & settings) -> std::expected<std::filesystem::path, std::string>;
+
+/**
+ * RGB float faces of a cubemap in CPU memory, in the face order and texel layout of GL.
+ */
+export class CubemapImage
+{
+private:
+    GLuint m_size;
+    GLuint m_maxLevel;
+    std::vector<std::vector<float>> m_faces; // level * 6 + face
+
+public:
+    CubemapImage(GLuint size, GLuint maxLevel);
+
+    [[nodiscard]] auto size() const -> GLuint { return m_size; }
+    [[nodiscard]] auto maxLevel() const -> GLuint { return m_maxLevel; }
+    [[nodiscard]] auto levelSize(const GLuint level) const -> GLuint { return std::max(m_size >> level, 1u); }
+
+    [[nodiscard]] auto face(const GLuint level, const GLuint face) -> std::span<float>
+    {
+        return m_faces[level * 6 + face];
+    }
+
+    [[nodiscard]] auto face(const GLuint level, const GLuint face) const -> std::span<const float>
+    {
+        return m_faces[level * 6 + face];
+    }
+
+    /**
+     * Bilinear samples of the first level in 4 directions at once, clamped to the edges of the faces. Returns the
+     * red, green and blue of each direction.
+     */
+    [[nodiscard]] auto sample(Float4 x, Float4 y, Float4 z) const -> std::array<Float4, 3>;
+
+    /**
+     * Levels in the layout of Cubemap::saveCache, packed to internalFormat.
+     */
+    [[nodiscard]] auto encode(GLint internalFormat) const -> std::vector<std::byte>;
+};
+
+/**
+ * CPU versions of equirectangular.frag, prefilter.frag and brdf.frag. Texel rows are split between the workers, the
+ * prefilter samples the environment in 4 directions per instruction. No GL context is needed.
+ */
+export auto equirectangularToCubemap(const Image & equirectangular, GLuint size, ThreadPool & workers)
+    -> std::expected<CubemapImage, std::string>;
+
+export auto prefilterCubemap(const CubemapImage & environment, GLsizei size, GLuint maxLevel, ThreadPool & workers)
+    -> CubemapImage;
+
+/**
+ * Scale and bias of F0 per NdotV (columns) and roughness (rows), as GL_RG and GL_HALF_FLOAT texels.
+ */
+export auto integrateBrdf(GLuint size, ThreadPool & workers) -> std::vector<std::byte>;
+
+/**
+ * Compute every map of an environment on the CPU and store them in the data cache. The image is loaded flipped
+ * vertically, as the game loads it.
+ */
+export auto bakeEnvironment(const std::filesystem::path & hdrPath, const Image & equirectangular,
+                            const EnvironmentSettings & settings, ThreadPool & workers)
+    -> std::expected<void, std::string>;
@@ -14,4 +14,7 @@ export struct FrameInfo
     DurationType time{};
     DurationType deltaTime{};
     float timeScale{1.0f};
+    // GL state calls of the previous frame, sent to the driver or elided by the state cache
+    uint32_t stateCallsIssued{0};
+    uint32_t stateCallsElided{0};
 };
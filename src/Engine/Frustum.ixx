@@ -0,0 +1,40 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+export module Engine.Frustum;
+import std;
+import glm;
+
+export class Frustum
+{
+private:
+    std::array<glm::vec4, 6> m_planes{}; // Normals point inside
+
+public:
+    /**
+     * Planes of a projection * view matrix (Gribb-Hartmann), in world space.
+     */
+    static auto FromMatrix(const glm::mat4 & projectionView) -> Frustum
+    {
+        const glm::mat4 m = glm::transpose(projectionView);
+
+        Frustum frustum;
+        frustum.m_planes = {
+            m[3] + m[0], m[3] - m[0],
+            m[3] + m[1], m[3] - m[1],
+            m[3] + m[2], m[3] - m[2],
+        };
+        for (auto & plane: frustum.m_planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    [[nodiscard]] auto intersectsSphere(const glm::vec3 & center, const float radius) const -> bool
+    {
+        return std::ranges::all_of(m_planes, [&](const glm::vec4 & plane)
+        {
+            return glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+        });
+    }
+};
@@ -0,0 +1,254 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+module Engine.LocalPose;
+import std;
+import glm;
+import Engine.AnimationCompression;
+import Utility.Simd;
+
+namespace
+{
+    // Below this |dot|, keys are more than ~23 degrees apart and nlerp drifts too much from slerp
+    constexpr float NlerpThreshold = 0.98f;
+
+    auto paddedSize(const std::size_t count) -> std::size_t
+    {
+        return (count + LocalPose::Width - 1) / LocalPose::Width * LocalPose::Width;
+    }
+
+    /**
+     * r = normalize(a * (1 - t) + b * t), b being negated first if on the other hemisphere. r may alias a.
+     */
+    auto nlerp(const std::size_t size,
+               const float * ax, const float * ay, const float * az, const float * aw,
+               const float * bx, const float * by, const float * bz, const float * bw,
+               const float * t,
+               float * rx, float * ry, float * rz, float * rw) -> void
+    {
+        const Float4 zero = Float4::broadcast(0.0f);
+        const Float4 one = Float4::broadcast(1.0f);
+
+        for (std::size_t i = 0; i < size; i += Float4::Width)
+        {
+            const Float4 x0 = Float4::load(ax + i), y0 = Float4::load(ay + i);
+            const Float4 z0 = Float4::load(az + i), w0 = Float4::load(aw + i);
+            const Float4 x1 = Float4::load(bx + i), y1 = Float4::load(by + i);
+            const Float4 z1 = Float4::load(bz + i), w1 = Float4::load(bw + i);
+            const Float4 factor = Float4::load(t + i);
+
+            const Float4 dot = x0 * x1 + y0 * y1 + z0 * z1 + w0 * w1;
+            const Float4 wa = one - factor;
+            const Float4 wb = select(dot < zero, zero - factor, factor);
+
+            const Float4 x = x0 * wa + x1 * wb;
+            const Float4 y = y0 * wa + y1 * wb;
+            const Float4 z = z0 * wa + z1 * wb;
+            const Float4 w = w0 * wa + w1 * wb;
+            const Float4 invLength = one / sqrt(x * x + y * y + z * z + w * w);
+
+            (x * invLength).store(rx + i);
+            (y * invLength).store(ry + i);
+            (z * invLength).store(rz + i);
+            (w * invLength).store(rw + i);
+        }
+    }
+
+    auto lerp(const std::size_t size, const float * a, const float * b, const float t, float * r) -> void
+    {
+        const Float4 factor = Float4::broadcast(t);
+        for (std::size_t i = 0; i < size; i += Float4::Width)
+        {
+            const Float4 from = Float4::load(a + i);
+            (from + (Float4::load(b + i) - from) * factor).store(r + i);
+        }
+    }
+}
+
+auto LocalPose::toMatrices(const std::span<glm::mat4> out) const -> void
+{
+    assert(out.size() >= m_count);
+
+    enum Column : std::size_t { M00, M01, M02, M10, M11, M12, M20, M21, M22, ColumnCount };
+
+    thread_local std::vector<float> columns;
+    columns.resize(m_stride * ColumnCount);
+    const auto column = [&](const Column c) { return columns.data() + c * m_stride; };
+
+    const float * x = lane(RX);
+    const float * y = lane(RY);
+    const float * z = lane(RZ);
+    const float * w = lane(RW);
+    const float * sx = lane(SX);
+    const float * sy = lane(SY);
+    const float * sz = lane(SZ);
+
+    float * m00 = column(M00);
+    float * m01 = column(M01);
+    float * m02 = column(M02);
+    float * m10 = column(M10);
+    float * m11 = column(M11);
+    float * m12 = column(M12);
+    float * m20 = column(M20);
+    float * m21 = column(M21);
+    float * m22 = column(M22);
+
+    // Rotation matrix scaled per column, the translation is copied as is
+    const Float4 one = Float4::broadcast(1.0f);
+    const Float4 two = Float4::broadcast(2.0f);
+    for (std::size_t i = 0; i < m_stride; i += Float4::Width)
+    {
+        const Float4 qx = Float4::load(x + i), qy = Float4::load(y + i);
+        const Float4 qz = Float4::load(z + i), qw = Float4::load(w + i);
+        const Float4 scaleX = Float4::load(sx + i), scaleY = Float4::load(sy + i), scaleZ = Float4::load(sz + i);
+
+        const Float4 xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        const Float4 xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        const Float4 wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+        ((one - two * (yy + zz)) * scaleX).store(m00 + i);
+        (two * (xy + wz) * scaleX).store(m01 + i);
+        (two * (xz - wy) * scaleX).store(m02 + i);
+        (two * (xy - wz) * scaleY).store(m10 + i);
+        ((one - two * (xx + zz)) * scaleY).store(m11 + i);
+        (two * (yz + wx) * scaleY).store(m12 + i);
+        (two * (xz + wy) * scaleZ).store(m20 + i);
+        (two * (yz - wx) * scaleZ).store(m21 + i);
+        ((one - two * (xx + yy)) * scaleZ).store(m22 + i);
+    }
+
+    const float * tx = lane(TX);
+    const float * ty = lane(TY);
+    const float * tz = lane(TZ);
+
+    for (std::size_t i = 0; i < m_count; ++i)
+    {
+        out[i] = glm::mat4(
+            m00[i], m01[i], m02[i], 0.0f,
+            m10[i], m11[i], m12[i], 0.0f,
+            m20[i], m21[i], m22[i], 0.0f,
+            tx[i], ty[i], tz[i], 1.0f);
+    }
+}
+
+auto blendPoses(const LocalPose & from, const LocalPose & to, const float weight, LocalPose & out) -> void
+{
+    assert(from.stride() == to.stride() && from.stride() == out.stride());
+
+    const std::size_t size = out.stride();
+
+    for (const auto lane: {LocalPose::TX, LocalPose::TY, LocalPose::TZ, LocalPose::SX, LocalPose::SY, LocalPose::SZ})
+        lerp(size, from.lane(lane), to.lane(lane), weight, out.lane(lane));
+
+    thread_local std::vector<float> weights;
+    weights.assign(size, weight);
+
+    nlerp(size,
+          from.lane(LocalPose::RX), from.lane(LocalPose::RY), from.lane(LocalPose::RZ), from.lane(LocalPose::RW),
+          to.lane(LocalPose::RX), to.lane(LocalPose::RY), to.lane(LocalPose::RZ), to.lane(LocalPose::RW),
+          weights.data(),
+          out.lane(LocalPose::RX), out.lane(LocalPose::RY), out.lane(LocalPose::RZ), out.lane(LocalPose::RW));
+}
+
+auto Vec3Batch::resize(const std::size_t count) -> void
+{
+    this->count = count;
+
+    const std::size_t size = paddedSize(count);
+    for (auto * lane: {&ax, &ay, &az, &bx, &by, &bz, &t, &minX, &minY, &minZ, &stepX, &stepY, &stepZ})
+        lane->assign(size, 0.0f);
+}
+
+auto Vec3Batch::set(const std::size_t index, const std::uint16_t * a, const std::uint16_t * b, const glm::vec3 & min,
+                    const glm::vec3 & step, const float factor) -> void
+{
+    ax[index] = a[0];
+    ay[index] = a[1];
+    az[index] = a[2];
+    bx[index] = b[0];
+    by[index] = b[1];
+    bz[index] = b[2];
+    minX[index] = min.x;
+    minY[index] = min.y;
+    minZ[index] = min.z;
+    stepX[index] = step.x;
+    stepY[index] = step.y;
+    stepZ[index] = step.z;
+    t[index] = factor;
+}
+
+auto Vec3Batch::lerp() -> void
+{
+    const std::size_t size = ax.size();
+    const auto unpack = [size](float * value, const float * b, const float * t, const float * min, const float * step)
+    {
+        for (std::size_t i = 0; i < size; i += Float4::Width)
+        {
+            const Float4 a = Float4::load(value + i);
+            const Float4 quantized = a + (Float4::load(b + i) - a) * Float4::load(t + i);
+            (Float4::load(min + i) + quantized * Float4::load(step + i)).store(value + i);
+        }
+    };
+
+    unpack(ax.data(), bx.data(), t.data(), minX.data(), stepX.data());
+    unpack(ay.data(), by.data(), t.data(), minY.data(), stepY.data());
+    unpack(az.data(), bz.data(), t.data(), minZ.data(), stepZ.data());
+}
+
+auto QuatBatch::resize(const std::size_t count) -> void
+{
+    this->count = count;
+
+    const std::size_t size = paddedSize(count);
+    for (auto * lane: {&ax, &ay, &az, &aw, &bx, &by, &bz, &bw, &t})
+        lane->resize(size);
+    t.assign(size, 0.0f);
+
+    // Identity in the padding, so it normalizes cleanly
+    const PackedQuat identity = packQuat(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    for (auto * lane: {&aLow, &bLow})
+        lane->assign(size, identity[0] | static_cast<std::uint32_t>(identity[1]) << 16);
+    for (auto * lane: {&aHigh, &bHigh})
+        lane->assign(size, identity[2]);
+}
+
+auto QuatBatch::set(const std::size_t index, const std::uint16_t * a, const std::uint16_t * b, const float factor)
+    -> void
+{
+    aLow[index] = a[0] | static_cast<std::uint32_t>(a[1]) << 16;
+    aHigh[index] = a[2];
+    bLow[index] = b[0] | static_cast<std::uint32_t>(b[1]) << 16;
+    bHigh[index] = b[2];
+    t[index] = factor;
+}
+
+auto QuatBatch::interpolate() -> void
+{
+    const std::size_t size = t.size();
+    unpackQuats(size, aLow.data(), aHigh.data(), ax.data(), ay.data(), az.data(), aw.data());
+    unpackQuats(size, bLow.data(), bHigh.data(), bx.data(), by.data(), bz.data(), bw.data());
+
+    // Rare far apart pairs are slerped up front, then b = result and t = 1 let the nlerp pass keep them unchanged
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float dot = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+        if (std::abs(dot) >= NlerpThreshold)
+            continue;
+
+        const glm::quat result = glm::slerp(glm::quat(aw[i], ax[i], ay[i], az[i]),
+                                            glm::quat(bw[i], bx[i], by[i], bz[i]),
+                                            t[i]);
+        bx[i] = result.x;
+        by[i] = result.y;
+        bz[i] = result.z;
+        bw[i] = result.w;
+        t[i] = 1.0f;
+    }
+
+    nlerp(size,
+          ax.data(), ay.data(), az.data(), aw.data(),
+          bx.data(), by.data(), bz.data(), bw.data(),
+          t.data(),
+          ax.data(), ay.data(), az.data(), aw.data());
+}
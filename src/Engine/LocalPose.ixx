@@ -0,0 +1,129 @@
+//
+// Created by Simon Cros on 3/11/26.
+//
+
+export module Engine.LocalPose;
+import std;
+import glm;
+
+/**
+ * Local transform of every node stored as SoA lanes (x[], y[], z[]...), each padded to a multiple of Width. Kernels
+ * working on poses run Float4::Width nodes per instruction over whole lanes, without a scalar tail.
+ */
+export class LocalPose
+{
+public:
+    enum Lane : std::size_t
+    {
+        TX, TY, TZ,
+        RX, RY, RZ, RW,
+        SX, SY, SZ,
+        LaneCount,
+    };
+
+    static constexpr std::size_t Width = 8;
+
+private:
+    std::size_t m_count{0};
+    std::size_t m_stride{0};
+    std::vector<float> m_data;
+
+public:
+    LocalPose() = default;
+
+    explicit LocalPose(const std::size_t count) : m_count(count),
+                                                  m_stride((count + Width - 1) / Width * Width),
+                                                  m_data(m_stride * LaneCount, 0.0f)
+    {
+        std::fill_n(lane(RW), m_stride, 1.0f);
+        std::fill_n(lane(SX), m_stride * 3, 1.0f);
+    }
+
+    [[nodiscard]] auto count() const -> std::size_t { return m_count; }
+
+    /**
+     * Padded size of each lane.
+     */
+    [[nodiscard]] auto stride() const -> std::size_t { return m_stride; }
+
+    [[nodiscard]] auto lane(const Lane lane) -> float * { return m_data.data() + lane * m_stride; }
+    [[nodiscard]] auto lane(const Lane lane) const -> const float * { return m_data.data() + lane * m_stride; }
+
+    auto setTranslation(const std::size_t node, const glm::vec3 & translation) -> void
+    {
+        lane(TX)[node] = translation.x;
+        lane(TY)[node] = translation.y;
+        lane(TZ)[node] = translation.z;
+    }
+
+    auto setRotation(const std::size_t node, const glm::quat & rotation) -> void
+    {
+        lane(RX)[node] = rotation.x;
+        lane(RY)[node] = rotation.y;
+        lane(RZ)[node] = rotation.z;
+        lane(RW)[node] = rotation.w;
+    }
+
+    auto setScale(const std::size_t node, const glm::vec3 & scale) -> void
+    {
+        lane(SX)[node] = scale.x;
+        lane(SY)[node] = scale.y;
+        lane(SZ)[node] = scale.z;
+    }
+
+    /**
+     * Local matrix of every node, out must hold count() matrices.
+     */
+    auto toMatrices(std::span<glm::mat4> out) const -> void;
+};
+
+/**
+ * out = from * (1 - weight) + to * weight, with nlerp for rotations. out may alias from or to.
+ */
+export auto blendPoses(const LocalPose & from, const LocalPose & to, float weight, LocalPose & out) -> void;
+
+/**
+ * Batch of vec3 keys to interpolate, lanes are filled per channel then lerp() runs on all of them at once. Keys are
+ * set packed, see PackedVec3, and interpolated before being unpacked with the range of their track.
+ */
+export struct Vec3Batch
+{
+    std::size_t count{0};
+    std::vector<float> ax, ay, az, bx, by, bz, t;
+    std::vector<float> minX, minY, minZ, stepX, stepY, stepZ;
+
+    auto resize(std::size_t count) -> void;
+    auto set(std::size_t index, const std::uint16_t * a, const std::uint16_t * b, const glm::vec3 & min,
+             const glm::vec3 & step, float factor) -> void;
+
+    /**
+     * Result is written over a.
+     */
+    auto lerp() -> void;
+
+    [[nodiscard]] auto result(const std::size_t index) const -> glm::vec3 { return {ax[index], ay[index], az[index]}; }
+};
+
+/**
+ * Same as Vec3Batch for rotations, interpolated with nlerp. Pairs too far apart for nlerp to be accurate are
+ * slerped instead. Keys are set packed, see PackedQuat, and all unpacked at once by interpolate().
+ */
+export struct QuatBatch
+{
+    std::size_t count{0};
+    std::vector<std::uint32_t> aLow, aHigh, bLow, bHigh;
+    std::vector<float> ax, ay, az, aw, bx, by, bz, bw, t;
+
+    auto resize(std::size_t count) -> void;
+    auto set(std::size_t index, const std::uint16_t * a, const std::uint16_t * b, float factor) -> void;
+
+    /**
+     * Result is written over a.
+     */
+    auto interpolate() -> void;
+
+    [[nodiscard]] auto result(const std::size_t index) const -> glm::quat
+    {
+        return {aw[index], ax[index], ay[index], az[index]};
+    }
+};
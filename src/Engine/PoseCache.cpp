@@ -0,0 +1,301 @@
+//
+// Created by Simon Cros on 3/10/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+module Engine.PoseCache;
+import std;
+import glm;
+import Engine.LocalPose;
+
+namespace
+{
+    auto composeRecursive(const ModelRenderInfo & model, const std::vector<glm::mat4> & locals, const int nodeIndex,
+                          const glm::mat4 & parent, std::vector<glm::mat4> & nodeTransforms) -> void
+    {
+        const NodeRenderInfo & node = model.nodes[nodeIndex];
+
+        const auto * matrix = std::get_if<glm::mat4>(&node.transform);
+        const glm::mat4 transform = parent * (matrix != nullptr ? *matrix : locals[nodeIndex]);
+
+        nodeTransforms[nodeIndex] = transform;
+
+        for (int i = 0; i < node.childrenCount; ++i)
+            composeRecursive(model, locals, node.children[i], transform, nodeTransforms);
+    }
+
+    auto quantize(const float time, const float step) -> float
+    {
+        return step > 0 ? std::floor(time / step) * step : time;
+    }
+
+    auto restPose(const ModelRenderInfo & model) -> LocalPose
+    {
+        LocalPose pose(model.nodesCount);
+        for (int nodeIndex = 0; nodeIndex < model.nodesCount; ++nodeIndex)
+        {
+            if (const auto * trs = std::get_if<TRS>(&model.nodes[nodeIndex].transform))
+            {
+                pose.setTranslation(nodeIndex, trs->translation);
+                pose.setRotation(nodeIndex, trs->rotation);
+                pose.setScale(nodeIndex, trs->scale);
+            }
+        }
+        return pose;
+    }
+}
+
+auto PoseCache::evaluateSampled(const ModelRenderInfo & model, Pose & pose) -> void
+{
+    thread_local std::vector<glm::mat4> locals;
+
+    const bool reduced = pose.key.reduced;
+
+    LocalPose local = pose.layerBase != nullptr ? *pose.layerBase : restPose(model);
+    pose.layer.animation->sample(pose.layer.time, pose.layer.cursors, local, reduced);
+    if (!reduced)
+        pose.sampled = local;
+
+    if (pose.fromLayer.animation != nullptr)
+    {
+        LocalPose from = pose.fromLayerBase != nullptr ? *pose.fromLayerBase : restPose(model);
+        pose.fromLayer.animation->sample(pose.fromLayer.time, pose.fromLayer.cursors, from, reduced);
+        blendPoses(from, local, static_cast<float>(pose.key.fade) / FadeSteps, local);
+    }
+
+    locals.resize(model.nodesCount);
+    local.toMatrices(locals);
+
+    pose.nodeTransforms.resize(model.nodesCount);
+    for (int i = 0; i < model.rootNodesCount; ++i)
+        composeRecursive(model, locals, model.rootNodes[i], glm::identity<glm::mat4>(), pose.nodeTransforms);
+
+    pose.jointMatrices.resize(model.skinsCount);
+    for (int skinIndex = 0; skinIndex < model.skinsCount; ++skinIndex)
+    {
+        const auto & skin = model.skins[skinIndex];
+        auto & jointMatrices = pose.jointMatrices[skinIndex];
+
+        jointMatrices.resize(skin.joints.size());
+        for (int i = 0; i < skin.joints.size(); ++i)
+            jointMatrices[i] = pose.nodeTransforms[skin.joints[i]] * skin.inverseBindMatrices[i];
+    }
+}
+
+auto PoseCache::evaluateInterpolated(Pose & pose) -> void
+{
+    const Pose & from = *pose.interpolateFrom;
+    const Pose & to = *pose.interpolateTo;
+    const float t = static_cast<float>(pose.key.fade) / FadeSteps;
+
+    // Component wise, the slight shear is not noticeable at the distances interpolated poses are used
+    const auto mix = [t](const std::vector<glm::mat4> & a, const std::vector<glm::mat4> & b,
+                         std::vector<glm::mat4> & out)
+    {
+        out.resize(a.size());
+        for (size_t i = 0; i < a.size(); ++i)
+            out[i] = a[i] + (b[i] - a[i]) * t;
+    };
+
+    mix(from.nodeTransforms, to.nodeTransforms, pose.nodeTransforms);
+    pose.jointMatrices.resize(from.jointMatrices.size());
+    for (size_t skinIndex = 0; skinIndex < from.jointMatrices.size(); ++skinIndex)
+        mix(from.jointMatrices[skinIndex], to.jointMatrices[skinIndex], pose.jointMatrices[skinIndex]);
+}
+
+auto PoseCache::find(const PoseKey & key) -> std::pair<Pose &, bool>
+{
+    auto [it, inserted] = m_poses.try_emplace(key);
+    auto & pose = it->second;
+
+    if (inserted)
+    {
+        pose.key = key;
+        ++m_stats.misses;
+    }
+    else
+    {
+        ++m_stats.hits;
+    }
+
+    pose.lastUsedFrame = m_frame;
+    touchDetailPoses(key);
+    return {pose, inserted};
+}
+
+auto PoseCache::touchDetailPoses(const PoseKey & key) -> void
+{
+    for (const auto * animation: {key.animation, key.fromAnimation})
+    {
+        if (const auto it = m_detailPoses.find(animation); it != m_detailPoses.end())
+            it->second.lastUsedFrame = m_frame;
+    }
+}
+
+auto PoseCache::detailPose(const ModelRenderInfo & model, const Animation * animation) const -> const LocalPose *
+{
+    const auto it = m_detailPoses.find(animation);
+    if (it == m_detailPoses.end() || it->second.local.count() != static_cast<std::size_t>(model.nodesCount))
+        return nullptr;
+    return &it->second.local;
+}
+
+auto PoseCache::acquire(const ModelRenderInfo & model, const PoseLayer & layer, const bool reduced) -> const Pose &
+{
+    return acquire(model, PoseLayer{}, layer, 1.0f, reduced);
+}
+
+auto PoseCache::acquire(const ModelRenderInfo & model, const PoseLayer & fromLayer, const PoseLayer & layer,
+                        const float fade, const bool reduced) -> const Pose &
+{
+    PoseLayer target = layer;
+    target.time = quantize(target.time, m_timeStep);
+
+    PoseLayer from = fromLayer;
+    PoseKey key{.model = &model, .animation = target.animation, .time = target.time, .reduced = reduced};
+
+    const auto fadeStep = static_cast<std::uint8_t>(std::lround(std::clamp(fade, 0.0f, 1.0f) * FadeSteps));
+    if (from.animation != nullptr && fadeStep < FadeSteps)
+    {
+        from.time = quantize(from.time, m_timeStep);
+        key.fromAnimation = from.animation;
+        key.fromTime = from.time;
+        key.fade = fadeStep;
+    }
+    else
+    {
+        from = PoseLayer{};
+    }
+
+    auto [pose, inserted] = find(key);
+    if (inserted)
+    {
+        pose.layer = target;
+        pose.fromLayer = from;
+    }
+    return pose;
+}
+
+auto PoseCache::acquireInterpolated(const ModelRenderInfo & model, const PoseLayer & layer, const float period,
+                                    const bool reduced) -> const Pose &
+{
+    const float duration = layer.animation->duration();
+    const float previousTime = quantize(layer.time, period);
+    const float nextTime = std::fmod(previousTime + period, duration);
+    const float t = std::clamp((layer.time - previousTime) / period, 0.0f, 1.0f);
+
+    // Only the first sample advances the instance cursors, both may be evaluated at the same time
+    const auto & previous = acquire(model, PoseLayer{layer.animation, previousTime, layer.cursors}, reduced);
+    const auto & next = acquire(model, PoseLayer{layer.animation, nextTime, {}}, reduced);
+
+    const auto fadeStep = static_cast<std::uint8_t>(std::lround(t * FadeSteps));
+    if (fadeStep == 0)
+        return previous;
+    if (fadeStep == FadeSteps)
+        return next;
+
+    auto [pose, inserted] = find(PoseKey{
+        .model = &model,
+        .animation = layer.animation,
+        .time = next.key.time,
+        .fromAnimation = layer.animation,
+        .fromTime = previous.key.time,
+        .fade = fadeStep,
+        .kind = PoseKind::Interpolated,
+        .reduced = reduced,
+    });
+    if (inserted)
+    {
+        pose.interpolateFrom = &previous;
+        pose.interpolateTo = &next;
+    }
+    return pose;
+}
+
+auto PoseCache::retain(const Pose & pose) -> const Pose &
+{
+    const auto it = m_poses.find(pose.key);
+    assert(it != m_poses.end() && "Pose was not used during the previous frame");
+
+    ++m_stats.hits;
+    it->second.lastUsedFrame = m_frame;
+    touchDetailPoses(it->first);
+    return it->second;
+}
+
+auto PoseCache::evaluatePass(ThreadPool & workers, UniformRing & uniformRing, const PoseKind kind) -> void
+{
+    for (auto & [key, pose]: m_poses)
+    {
+        if (key.kind != kind)
+            continue;
+
+        // Palettes are uploaded every frame as the ring only keeps the current frame
+        pose.palettes.resize(key.model->skinsCount);
+        for (int skinIndex = 0; skinIndex < key.model->skinsCount; ++skinIndex)
+        {
+            const auto size = key.model->skins[skinIndex].joints.size() * sizeof(glm::mat4);
+            pose.palettes[skinIndex] = uniformRing.allocate(static_cast<GLsizeiptr>(size));
+        }
+
+        // Read by the workers, the detail poses are only replaced once they are done
+        if (!pose.evaluated && key.reduced && kind == PoseKind::Sampled)
+        {
+            pose.layerBase = detailPose(*key.model, pose.layer.animation);
+            pose.fromLayerBase = detailPose(*key.model, pose.fromLayer.animation);
+        }
+
+        workers.submit([&key, &pose, &uniformRing]
+        {
+            if (!pose.evaluated)
+            {
+                if (key.kind == PoseKind::Sampled)
+                    evaluateSampled(*key.model, pose);
+                else
+                    evaluateInterpolated(pose);
+
+                pose.layer.cursors = {};
+                pose.fromLayer.cursors = {};
+                pose.interpolateFrom = nullptr;
+                pose.interpolateTo = nullptr;
+                pose.layerBase = nullptr;
+                pose.fromLayerBase = nullptr;
+                pose.evaluated = true;
+            }
+
+            for (int skinIndex = 0; skinIndex < pose.palettes.size(); ++skinIndex)
+            {
+                if (pose.palettes[skinIndex].has_value())
+                {
+                    std::memcpy(uniformRing.data(*pose.palettes[skinIndex]), pose.jointMatrices[skinIndex].data(),
+                                pose.palettes[skinIndex]->size);
+                }
+            }
+        });
+    }
+
+    workers.wait();
+
+    for (auto & [key, pose]: m_poses)
+    {
+        if (pose.sampled.count() > 0)
+            m_detailPoses[key.animation] = DetailPose{std::exchange(pose.sampled, LocalPose()), m_frame};
+    }
+}
+
+auto PoseCache::evaluate(ThreadPool & workers, UniformRing & uniformRing) -> void
+{
+    std::erase_if(m_poses, [this](const auto & entry) { return entry.second.lastUsedFrame != m_frame; });
+    std::erase_if(m_detailPoses, [this](const auto & entry) { return entry.second.lastUsedFrame != m_frame; });
+
+    // Interpolated poses read the sampled ones, which must be done first
+    evaluatePass(workers, uniformRing, PoseKind::Sampled);
+    evaluatePass(workers, uniformRing, PoseKind::Interpolated);
+
+    m_stats.poses = m_poses.size();
+    m_lastStats = std::exchange(m_stats, PoseCacheStats{});
+    ++m_frame;
+}
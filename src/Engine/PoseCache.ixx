@@ -0,0 +1,182 @@
+//
+// Created by Simon Cros on 3/10/26.
+//
+
+export module Engine.PoseCache;
+import std;
+import glm;
+import Engine.Animation;
+import Engine.AnimationSampler;
+import Engine.LocalPose;
+import Engine.RenderInfo;
+import OpenGL;
+import Utility;
+
+/**
+ * One animation played at a given time. cursors holds one sampler cursor per animation sampler for the calling
+ * instance, they are advanced if the pose has to be sampled.
+ */
+export struct PoseLayer
+{
+    const Animation * animation{nullptr};
+    float time{0};
+    std::span<AnimationSampler::Cursor> cursors;
+};
+
+export enum class PoseKind : std::uint8_t
+{
+    Sampled, // Sampled from animation, cross faded from fromAnimation if set
+    Interpolated, // Matrices interpolated between the sampled poses at fromTime and time
+};
+
+/**
+ * Times are stored already quantized.
+ */
+export struct PoseKey
+{
+    const ModelRenderInfo * model{nullptr};
+    const Animation * animation{nullptr};
+    float time{0};
+    const Animation * fromAnimation{nullptr};
+    float fromTime{0};
+    std::uint8_t fade{0};
+    PoseKind kind{PoseKind::Sampled};
+    bool reduced{false};
+
+    auto operator==(const PoseKey &) const -> bool = default;
+};
+
+export struct PoseKeyHash
+{
+    auto operator()(const PoseKey & key) const noexcept -> std::size_t
+    {
+        std::size_t hash = 0;
+        const auto combine = [&hash](const std::size_t value)
+        {
+            hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        };
+        combine(std::hash<const void *>{}(key.model));
+        combine(std::hash<const void *>{}(key.animation));
+        combine(std::hash<float>{}(key.time));
+        combine(std::hash<const void *>{}(key.fromAnimation));
+        combine(std::hash<float>{}(key.fromTime));
+        combine(key.fade);
+        combine(static_cast<std::size_t>(key.kind) << 1 | key.reduced);
+        return hash;
+    }
+};
+
+/**
+ * Pose of a model, shared by every instance playing the same animation at the same quantized time. Node transforms
+ * are in model space, joint matrices do not depend on the instance world transform either, as it cancels out with
+ * the inverse applied to the skin.
+ */
+export struct Pose
+{
+    PoseKey key;
+    PoseLayer layer;
+    PoseLayer fromLayer; // Animation is null when not cross fading
+    const Pose * interpolateFrom{nullptr}; // Sources of an interpolated pose
+    const Pose * interpolateTo{nullptr};
+    const LocalPose * layerBase{nullptr}; // Transforms the detail nodes of a reduced pose keep, rest pose when null
+    const LocalPose * fromLayerBase{nullptr};
+    LocalPose sampled; // Local transforms of layer once sampled, until the cache keeps them for reduced poses
+    bool evaluated{false};
+    std::uint64_t lastUsedFrame{0};
+    std::vector<glm::mat4> nodeTransforms;
+    std::vector<std::vector<glm::mat4>> jointMatrices;
+    std::vector<std::optional<RingAllocation>> palettes;
+};
+
+export struct PoseCacheStats
+{
+    std::size_t hits{0};
+    std::size_t misses{0};
+    std::size_t poses{0};
+};
+
+/**
+ * Poses are acquired during update, then evaluated on the workers and uploaded once per frame, before the render
+ * phase. A pose not acquired during a frame is dropped, references returned by acquire() are valid until the next
+ * evaluate().
+ */
+export class PoseCache
+{
+public:
+    static constexpr int FadeSteps = std::numeric_limits<std::uint8_t>::max();
+
+private:
+    struct DetailPose
+    {
+        LocalPose local;
+        std::uint64_t lastUsedFrame{0};
+    };
+
+    std::unordered_map<PoseKey, Pose, PoseKeyHash> m_poses;
+    std::unordered_map<const Animation *, DetailPose> m_detailPoses; // Last full pose sampled from each animation
+    float m_timeStep{0};
+    std::uint64_t m_frame{0};
+    PoseCacheStats m_stats{};
+    PoseCacheStats m_lastStats{};
+
+    static auto evaluateInterpolated(Pose & pose) -> void;
+
+    auto find(const PoseKey & key) -> std::pair<Pose &, bool>;
+    auto touchDetailPoses(const PoseKey & key) -> void;
+    auto detailPose(const ModelRenderInfo & model, const Animation * animation) const -> const LocalPose *;
+    auto evaluatePass(ThreadPool & workers, UniformRing & uniformRing, PoseKind kind) -> void;
+
+public:
+    /**
+     * Sample pose.layer, cross faded from pose.fromLayer, and compute its node transforms and joint matrices. Does
+     * not touch the cache, offline bakes use it directly. Layers start from pose.layerBase and pose.fromLayerBase,
+     * or from the rest pose.
+     */
+    static auto evaluateSampled(const ModelRenderInfo & model, Pose & pose) -> void;
+
+    /**
+     * Animation time is rounded down to a multiple of timeStep (in seconds) before sampling, so instances close in
+     * time share a pose. 0 only shares poses sampled at exactly the same time.
+     */
+    auto setTimeStep(const float timeStep) -> void { m_timeStep = std::max(timeStep, 0.0f); }
+
+    [[nodiscard]] auto timeStep() const -> float { return m_timeStep; }
+
+    /**
+     * Frame the next acquired poses belong to.
+     */
+    [[nodiscard]] auto frame() const -> std::uint64_t { return m_frame; }
+
+    /**
+     * reduced skips the animation channels of ModelRenderInfo::detailNodes. They keep the transforms of the last full
+     * pose sampled from the same animation, or the rest pose if there is none.
+     */
+    [[nodiscard]] auto acquire(const ModelRenderInfo & model, const PoseLayer & layer, bool reduced = false)
+        -> const Pose &;
+
+    /**
+     * Cross fade from fromLayer to layer, fade going from 0 (only fromLayer) to 1 (only layer). The fade is
+     * quantized to FadeSteps.
+     */
+    [[nodiscard]] auto acquire(const ModelRenderInfo & model, const PoseLayer & fromLayer, const PoseLayer & layer,
+                               float fade, bool reduced = false) -> const Pose &;
+
+    /**
+     * Sample layer only every period seconds, and interpolate the matrices of the two surrounding samples in between.
+     * Samples are shared by every instance using the same period.
+     */
+    [[nodiscard]] auto acquireInterpolated(const ModelRenderInfo & model, const PoseLayer & layer, float period,
+                                           bool reduced = false) -> const Pose &;
+
+    /**
+     * Keep a pose acquired during the previous frame alive without any new evaluation.
+     */
+    [[nodiscard]] auto retain(const Pose & pose) -> const Pose &;
+
+    auto evaluate(ThreadPool & workers, UniformRing & uniformRing) -> void;
+
+    /**
+     * Counters of the last evaluated frame.
+     */
+    [[nodiscard]] auto stats() const -> const PoseCacheStats & { return m_lastStats; }
+};
@@ -27,7 +27,6 @@ export struct Buffer
 
 export struct BufferView
 {
-    std::optional<GLint> glBuffer;
     BufferIndex buffer;
     int target;
     size_t byteOffset{0};
@@ -106,20 +105,32 @@ export struct PrimitiveRenderInfo
     int mode{-1};
     AccessorIndex indices{-1};
     VertexArrayFlags vertexArrayFlags{VertexArrayHasNone};
+    GeometryAllocation geometry;
     SlotSetIndex programIndex;
 };
 
+/**
+ * Consecutive primitives of a mesh sharing material, attributes and mode, submitted with a single multi-draw.
+ */
+export struct DrawBatch
+{
+    size_t primitive{0}; // First primitive of the batch, holds the state shared by the whole batch
+    std::vector<GLsizei> counts;
+    std::vector<const void *> indexOffsets;
+    std::vector<GLint> baseVertices;
+};
+
 export struct MeshRenderInfo
 {
     size_t primitivesCount{0};
     std::unique_ptr<PrimitiveRenderInfo[]> primitives{nullptr};
+    std::vector<DrawBatch> batches;
 };
 
 export struct SkinRenderInfo
 {
     std::vector<glm::mat4> inverseBindMatrices{glm::identity<glm::mat4>()};
     std::vector<int> joints;
-    GLuint glBuffer{0};
     int skeleton{-1};
 };
 
@@ -157,4 +168,86 @@ export struct ModelRenderInfo
     std::unique_ptr<NodeRenderInfo[]> nodes{nullptr};
     std::unique_ptr<NodeIndex[]> rootNodes{nullptr};
     std::unique_ptr<Material[]> materials{nullptr};
+
+    // Bounding sphere in model space, around the rest pose
+    glm::vec3 boundsCenter{0};
+    float boundsRadius{0};
+
+    // Nodes too small to be noticed from afar (fingers, face...), skipped by reduced animation LODs
+    std::vector<bool> detailNodes;
 };
+
+/**
+ * First element of an accessor in the CPU copy of its buffer, elements are byteStride bytes apart.
+ */
+export auto accessorData(const ModelRenderInfo & renderInfo, const AccessorRenderInfo & accessor) -> const unsigned char *
+{
+    const auto & bufferView = renderInfo.bufferViews[accessor.bufferView];
+    const auto & buffer = renderInfo.buffers[bufferView.buffer];
+    return buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+}
+
+export auto readComponent(const unsigned char * data, const int componentType, const bool normalized) -> float
+{
+    switch (componentType)
+    {
+        case GL_FLOAT:
+        {
+            float value;
+            std::memcpy(&value, data, sizeof(float));
+            return value;
+        }
+        case GL_UNSIGNED_BYTE:
+            return normalized ? static_cast<float>(*data) / 255.0f : static_cast<float>(*data);
+        case GL_BYTE:
+        {
+            const auto value = static_cast<float>(static_cast<int8_t>(*data));
+            return normalized ? std::max(value / 127.0f, -1.0f) : value;
+        }
+        case GL_UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            std::memcpy(&value, data, sizeof(uint16_t));
+            return normalized ? static_cast<float>(value) / 65535.0f : static_cast<float>(value);
+        }
+        case GL_SHORT:
+        {
+            int16_t value;
+            std::memcpy(&value, data, sizeof(int16_t));
+            return normalized ? std::max(static_cast<float>(value) / 32767.0f, -1.0f) : static_cast<float>(value);
+        }
+        case GL_UNSIGNED_INT:
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(uint32_t));
+            return static_cast<float>(value);
+        }
+        default:
+            assert(false && "Unsupported component type");
+            return 0;
+    }
+}
+
+export auto readIndex(const unsigned char * data, const int componentType) -> GLuint
+{
+    switch (componentType)
+    {
+        case GL_UNSIGNED_BYTE:
+            return *data;
+        case GL_UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            std::memcpy(&value, data, sizeof(uint16_t));
+            return value;
+        }
+        case GL_UNSIGNED_INT:
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(uint32_t));
+            return value;
+        }
+        default:
+            assert(false && "Unsupported index type");
+            return 0;
+    }
+}
@@ -0,0 +1,232 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include <cstdio>
+
+module Engine.SphericalHarmonics;
+import std;
+import glm;
+import DataCache;
+import Utility.Simd;
+
+namespace
+{
+    constexpr size_t TermCount = 9;
+    constexpr size_t RowsPerJob = 16;
+    constexpr float Pi = std::numbers::pi_v<float>;
+
+    /**
+     * The sun would otherwise ring over the whole sphere, and make the opposite side negative.
+     */
+    constexpr float MaxHdrValue = 20.0f;
+
+    /**
+     * Constants of the basis functions, and cosine lobe convolution divided by PI for each band.
+     */
+    constexpr std::array<float, TermCount> BasisConstants = {
+        0.282095f,
+        0.488603f, 0.488603f, 0.488603f,
+        1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f,
+    };
+    constexpr std::array<float, TermCount> BandConvolution = {
+        1.0f,
+        2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+        0.25f, 0.25f, 0.25f, 0.25f, 0.25f,
+    };
+
+    /**
+     * Sums of radiance * polynomial * solid angle of a range of rows, per term, channel and column. Columns are only
+     * added together at the end, every loop is element-wise and runs 4 columns per instruction. Lanes are padded to a
+     * multiple of 4 columns, the padding has no color and adds nothing.
+     */
+    class RowsProjection
+    {
+    private:
+        size_t m_width;
+        size_t m_stride;
+        std::vector<float> m_sums;
+        std::vector<float> m_basis;
+        std::vector<float> m_color;
+
+        auto sums(const size_t term, const size_t channel) -> float *
+        {
+            return m_sums.data() + (term * 3 + channel) * m_stride;
+        }
+
+    public:
+        explicit RowsProjection(const size_t width) : m_width(width), m_stride(paddedWidth(width)),
+                                                      m_sums(TermCount * 3 * m_stride), m_basis(TermCount * m_stride),
+                                                      m_color(3 * m_stride) {}
+
+        [[nodiscard]] static auto paddedWidth(const size_t width) -> size_t { return (width + 3) / 4 * 4; }
+
+        /**
+         * Polynomials of the direction of each texel, in the same order as pbr.frag. cosPhi and sinPhi hold
+         * paddedWidth() values.
+         */
+        auto addRow(const float * row, const size_t channels, const float y, const float radius, const float weight,
+                    const std::span<const float> cosPhi, const std::span<const float> sinPhi) -> void
+        {
+            float * const b = m_basis.data();
+            const size_t s = m_stride;
+            const Float4 one = Float4::broadcast(1.0f);
+            const Float4 three = Float4::broadcast(3.0f);
+            const Float4 ys = Float4::broadcast(y);
+            const Float4 radiuses = Float4::broadcast(radius);
+            for (size_t i = 0; i < s; i += 4)
+            {
+                const Float4 x = radiuses * Float4::load(cosPhi.data() + i);
+                const Float4 z = radiuses * Float4::load(sinPhi.data() + i);
+                one.store(b + i);
+                ys.store(b + s + i);
+                z.store(b + 2 * s + i);
+                x.store(b + 3 * s + i);
+                (x * ys).store(b + 4 * s + i);
+                (ys * z).store(b + 5 * s + i);
+                (three * z * z - one).store(b + 6 * s + i);
+                (x * z).store(b + 7 * s + i);
+                (x * x - ys * ys).store(b + 8 * s + i);
+            }
+
+            float * const red = m_color.data();
+            float * const green = red + s;
+            float * const blue = green + s;
+            const Float4 maxValue = Float4::broadcast(MaxHdrValue);
+            const Float4 weights = Float4::broadcast(weight);
+            size_t i = 0;
+            if (channels == 3)
+            {
+                for (; i + 4 <= m_width; i += 4)
+                {
+                    const auto texels = loadTriplets(row + i * 3);
+                    (min(texels[0], maxValue) * weights).store(red + i);
+                    (min(texels[1], maxValue) * weights).store(green + i);
+                    (min(texels[2], maxValue) * weights).store(blue + i);
+                }
+            }
+            for (; i < m_width; ++i)
+            {
+                for (size_t channel = 0; channel < 3; ++channel)
+                    m_color[channel * s + i] = std::min(row[i * channels + channel], MaxHdrValue) * weight;
+            }
+
+            for (size_t term = 0; term < TermCount; ++term)
+            {
+                const float * const basis = b + term * s;
+                for (size_t channel = 0; channel < 3; ++channel)
+                {
+                    const float * const color = m_color.data() + channel * s;
+                    float * const out = sums(term, channel);
+                    for (size_t j = 0; j < s; j += 4)
+                    {
+                        const Float4 sum = Float4::load(out + j) + Float4::load(basis + j) * Float4::load(color + j);
+                        sum.store(out + j);
+                    }
+                }
+            }
+        }
+
+        auto addTo(std::array<std::array<double, 3>, TermCount> & total) -> void
+        {
+            for (size_t term = 0; term < TermCount; ++term)
+            {
+                for (size_t channel = 0; channel < 3; ++channel)
+                {
+                    const float * const values = sums(term, channel);
+                    total[term][channel] += std::accumulate(values, values + m_width, 0.0);
+                }
+            }
+        }
+    };
+}
+
+auto IrradianceSH::Project(const Image & equirectangular, ThreadPool & workers)
+    -> std::expected<IrradianceSH, std::string>
+{
+    if (!equirectangular.isHdr() || equirectangular.nrChannels() < 3)
+    {
+        return std::unexpected<std::string>(std::in_place, "irradiance needs an RGB HDR image");
+    }
+
+    const auto width = static_cast<size_t>(equirectangular.width());
+    const auto height = static_cast<size_t>(equirectangular.height());
+    const auto channels = static_cast<size_t>(equirectangular.nrChannels());
+    const auto * pixels = static_cast<const float *>(equirectangular.data());
+
+    // Longitude of each column, u = atan(z, x) / 2PI + 0.5
+    std::vector<float> cosPhi(RowsProjection::paddedWidth(width));
+    std::vector<float> sinPhi(RowsProjection::paddedWidth(width));
+    for (size_t i = 0; i < width; ++i)
+    {
+        const float phi = 2.0f * Pi * ((static_cast<float>(i) + 0.5f) / static_cast<float>(width) - 0.5f);
+        cosPhi[i] = std::cos(phi);
+        sinPhi[i] = std::sin(phi);
+    }
+
+    const float texelAngle = 2.0f * Pi / static_cast<float>(width) * Pi / static_cast<float>(height);
+
+    const size_t jobCount = (height + RowsPerJob - 1) / RowsPerJob;
+    std::vector<std::optional<RowsProjection>> projections(jobCount);
+    workers.parallelFor(jobCount, 1, [&](const size_t job)
+    {
+        auto & projection = projections[job].emplace(width);
+        for (size_t j = job * RowsPerJob; j < std::min((job + 1) * RowsPerJob, height); ++j)
+        {
+            // Latitude of the row, v = asin(y) / PI + 0.5
+            const float latitude = Pi * ((static_cast<float>(j) + 0.5f) / static_cast<float>(height) - 0.5f);
+            const float radius = std::cos(latitude);
+            projection.addRow(pixels + j * width * channels, channels, std::sin(latitude), radius,
+                              texelAngle * radius, cosPhi, sinPhi);
+        }
+    });
+
+    // Summed in job order, the result does not depend on the scheduling
+    std::array<std::array<double, 3>, TermCount> total{};
+    for (auto & projection: projections)
+        projection->addTo(total);
+
+    IrradianceSH irradiance;
+    for (size_t term = 0; term < TermCount; ++term)
+    {
+        const double scale = BandConvolution[term] * BasisConstants[term] * BasisConstants[term];
+        irradiance.coefficients[term] = glm::vec4(static_cast<float>(total[term][0] * scale),
+                                                  static_cast<float>(total[term][1] * scale),
+                                                  static_cast<float>(total[term][2] * scale), 0.0f);
+    }
+    return irradiance;
+}
+
+auto IrradianceSH::FromCache(const std::filesystem::path & path) -> std::optional<IrradianceSH>
+{
+    const auto oe_result = DataCache::readFile(path);
+
+    if (!oe_result)
+    {
+        return std::nullopt;
+    }
+
+    if (!oe_result->has_value())
+    {
+        std::println(stderr, "Failed to load irradiance from {}: {}", path.c_str(), oe_result->error());
+        return std::nullopt;
+    }
+
+    const auto & data = oe_result->value();
+    IrradianceSH irradiance;
+    if (data.size() != sizeof(irradiance.coefficients))
+    {
+        std::println(stderr, "Failed to load irradiance from {}: invalid size", path.c_str());
+        return std::nullopt;
+    }
+
+    std::memcpy(irradiance.coefficients.data(), data.data(), data.size());
+    return irradiance;
+}
+
+auto IrradianceSH::saveCache(const std::filesystem::path & path) const -> std::expected<void, std::string>
+{
+    return DataCache::writeFile(path, std::as_bytes(std::span(coefficients)));
+}
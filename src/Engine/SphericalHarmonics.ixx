@@ -0,0 +1,32 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module Engine.SphericalHarmonics;
+import std;
+import glm;
+import Image;
+import Utility.ThreadPool;
+
+/**
+ * Diffuse irradiance of an environment as its projection on the 9 first real spherical harmonics, convolved with the
+ * cosine lobe and divided by PI, so that albedo * irradiance(N) is the diffuse light. The basis constants are folded
+ * into the coefficients, pbr.frag only evaluates the polynomials of N.
+ *
+ * Laid out as the FrameData uniform block, one vec4 per coefficient with w unused.
+ */
+export struct IrradianceSH
+{
+    std::array<glm::vec4, 9> coefficients{};
+
+    /**
+     * Project an HDR equirectangular image, sampled as equirectangular.frag samples it. Rows are split between the
+     * workers.
+     */
+    [[nodiscard]] static auto Project(const Image & equirectangular, ThreadPool & workers)
+        -> std::expected<IrradianceSH, std::string>;
+
+    [[nodiscard]] static auto FromCache(const std::filesystem::path & path) -> std::optional<IrradianceSH>;
+
+    [[nodiscard]] auto saveCache(const std::filesystem::path & path) const -> std::expected<void, std::string>;
+};
@@ -0,0 +1,253 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module Engine.TextureCompression;
+import std.compat;
+import Utility.Simd;
+import Utility.ThreadPool;
+
+namespace
+{
+    constexpr size_t BlockRowsPerJob = 4;
+
+    /**
+     * Pixels of a 4x4 block as separate channel lanes of 4 Float4. Values are whole numbers and every sum below stays
+     * under 2^24, so the float arithmetic is exact and gives the results of the integer formulas.
+     */
+    struct Block
+    {
+        std::array<float, 16> r;
+        std::array<float, 16> g;
+        std::array<float, 16> b;
+        std::array<float, 16> a;
+    };
+
+    auto loadBlock(const std::span<const uint8_t> rgba, const uint32_t width, const uint32_t height,
+                   const uint32_t blockX, const uint32_t blockY) -> Block
+    {
+        const UInt4 byteMask = UInt4::broadcast(0xff);
+
+        Block block{};
+        for (uint32_t row = 0; row < 4; ++row)
+        {
+            // Blocks past the edge of the image repeat its last row and column
+            const uint32_t y = std::min(blockY * 4 + row, height - 1);
+            std::array<uint32_t, 4> pixels;
+            for (uint32_t column = 0; column < 4; ++column)
+            {
+                const uint32_t x = std::min(blockX * 4 + column, width - 1);
+                std::memcpy(&pixels[column], rgba.data() + (static_cast<size_t>(y) * width + x) * 4, 4);
+            }
+
+            // Little endian, red is the low byte
+            const UInt4 bits = UInt4::load(pixels.data());
+            toFloat(bits & byteMask).store(block.r.data() + row * 4);
+            toFloat(shiftRight<8>(bits) & byteMask).store(block.g.data() + row * 4);
+            toFloat(shiftRight<16>(bits) & byteMask).store(block.b.data() + row * 4);
+            toFloat(shiftRight<24>(bits)).store(block.a.data() + row * 4);
+        }
+        return block;
+    }
+
+    template<class T>
+    auto store(std::byte * out, const T value) -> void
+    {
+        // Blocks are little endian, as are the hosts we run on
+        std::memcpy(out, &value, sizeof(T));
+    }
+
+    auto minMax(const std::array<float, 16> & values) -> std::pair<float, float>
+    {
+        Float4 low = Float4::load(values.data());
+        Float4 high = low;
+        for (size_t i = 4; i < 16; i += 4)
+        {
+            const Float4 group = Float4::load(values.data() + i);
+            low = min(low, group);
+            high = max(high, group);
+        }
+        return {reduceMin(low), reduceMax(high)};
+    }
+
+    /**
+     * Indices of steps going from the first endpoint to the second, both formats use 0 and 1 for the endpoints and
+     * number the steps in between from 2.
+     */
+    auto stepIndices(const UInt4 steps, const uint32_t lastStep) -> UInt4
+    {
+        const UInt4 one = UInt4::broadcast(1);
+        return select(steps == UInt4::broadcast(0), steps,
+                      select(steps == UInt4::broadcast(lastStep), one, steps + one));
+    }
+
+    template<size_t Bits>
+    auto packIndices(const std::array<uint32_t, 16> & indices) -> uint64_t
+    {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < 16; ++i)
+            bits |= static_cast<uint64_t>(indices[i]) << (Bits * i);
+        return bits;
+    }
+
+    /**
+     * BC4: two 8-bit endpoints and 3-bit indices. The endpoints are the extremes of the block, with max first for
+     * the mode interpolating 6 values between them.
+     */
+    auto encodeChannel(const std::array<float, 16> & values, std::byte * out) -> void
+    {
+        const auto [low, high] = minMax(values);
+        out[0] = static_cast<std::byte>(static_cast<uint8_t>(high));
+        out[1] = static_cast<std::byte>(static_cast<uint8_t>(low));
+
+        const auto range = static_cast<int>(high - low);
+        uint64_t bits = 0;
+        if (range > 0)
+        {
+            const Float4 top = Float4::broadcast(high);
+            const Float4 seven = Float4::broadcast(7.0f);
+            const Float4 halfRange = Float4::broadcast(static_cast<float>(range / 2));
+            const Float4 divisor = Float4::broadcast(static_cast<float>(range));
+
+            std::array<uint32_t, 16> indices;
+            for (size_t i = 0; i < 16; i += 4)
+            {
+                // Step 0 is the max, 7 the min
+                const Float4 step = ((top - Float4::load(values.data() + i)) * seven + halfRange) / divisor;
+                stepIndices(truncate(step), 7).store(indices.data() + i);
+            }
+            bits = packIndices<3>(indices);
+        }
+        std::memcpy(out + 2, &bits, 6);
+    }
+
+    auto packColor(const int r, const int g, const int b) -> uint16_t
+    {
+        return static_cast<uint16_t>((r * 31 + 127) / 255 << 11 | (g * 63 + 127) / 255 << 5 | (b * 31 + 127) / 255);
+    }
+
+    auto unpackColor(const uint16_t color) -> std::array<int, 3>
+    {
+        const int r = color >> 11 & 31;
+        const int g = color >> 5 & 63;
+        const int b = color & 31;
+        return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2};
+    }
+
+    /**
+     * BC1: two RGB565 endpoints and 2-bit indices, always in the opaque mode with 2 interpolated colors. The endpoints
+     * are the corners of the inset bounding box of the block, along the diagonal following the channels covariance.
+     */
+    auto encodeColor(const Block & block, std::byte * out) -> void
+    {
+        const std::array<const std::array<float, 16> *, 3> channels{&block.r, &block.g, &block.b};
+
+        std::array<int, 3> low{};
+        std::array<int, 3> high{};
+        std::array<int, 3> mean{};
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const auto [min, max] = minMax(*channels[c]);
+            // The extremes are rarely worth their error on the rest of the block
+            const int inset = (static_cast<int>(max) - static_cast<int>(min)) >> 4;
+            low[c] = static_cast<int>(min) + inset;
+            high[c] = static_cast<int>(max) - inset;
+
+            Float4 sum = Float4::broadcast(0.0f);
+            for (size_t i = 0; i < 16; i += 4)
+                sum = sum + Float4::load(channels[c]->data() + i);
+            mean[c] = static_cast<int>(reduceAdd(sum)) / 16;
+        }
+
+        // Green has the most weight, red and blue follow its direction or go against it
+        const Float4 meanGreen = Float4::broadcast(static_cast<float>(mean[1]));
+        for (const size_t c: {size_t{0}, size_t{2}})
+        {
+            const Float4 meanChannel = Float4::broadcast(static_cast<float>(mean[c]));
+            Float4 covariance = Float4::broadcast(0.0f);
+            for (size_t i = 0; i < 16; i += 4)
+            {
+                covariance = covariance + (Float4::load(channels[c]->data() + i) - meanChannel)
+                                          * (Float4::load(block.g.data() + i) - meanGreen);
+            }
+            if (reduceAdd(covariance) < 0)
+                std::swap(low[c], high[c]);
+        }
+
+        uint16_t color0 = packColor(high[0], high[1], high[2]);
+        uint16_t color1 = packColor(low[0], low[1], low[2]);
+        uint32_t bits = 0;
+
+        if (color0 != color1)
+        {
+            // color0 > color1 selects the opaque mode
+            if (color0 < color1)
+                std::swap(color0, color1);
+
+            const auto end0 = unpackColor(color0);
+            const auto end1 = unpackColor(color1);
+            const std::array axis{end1[0] - end0[0], end1[1] - end0[1], end1[2] - end0[2]};
+            const int length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+            const auto broadcast = [](const int value) { return Float4::broadcast(static_cast<float>(value)); };
+            const Float4 halfLength = broadcast(length / 2);
+            const Float4 divisor = broadcast(length);
+            const Float4 three = Float4::broadcast(3.0f);
+            const std::array start{broadcast(end0[0]), broadcast(end0[1]), broadcast(end0[2])};
+            const std::array direction{broadcast(axis[0]), broadcast(axis[1]), broadcast(axis[2])};
+
+            std::array<uint32_t, 16> indices;
+            for (size_t i = 0; i < 16; i += 4)
+            {
+                const Float4 projection = (Float4::load(block.r.data() + i) - start[0]) * direction[0]
+                                          + (Float4::load(block.g.data() + i) - start[1]) * direction[1]
+                                          + (Float4::load(block.b.data() + i) - start[2]) * direction[2];
+                const Float4 step = (projection * three + halfLength) / divisor;
+                stepIndices(truncate(min(max(step, Float4::broadcast(0.0f)), three)), 3).store(indices.data() + i);
+            }
+            bits = static_cast<uint32_t>(packIndices<2>(indices));
+        }
+
+        store(out, color0);
+        store(out + 2, color1);
+        store(out + 4, bits);
+    }
+
+    auto encodeBlock(const BlockFormat format, const Block & block, std::byte * out) -> void
+    {
+        switch (format)
+        {
+            case BlockFormat::BC1:
+                encodeColor(block, out);
+                break;
+            case BlockFormat::BC3:
+                encodeChannel(block.a, out);
+                encodeColor(block, out + 8);
+                break;
+            case BlockFormat::BC5:
+                encodeChannel(block.r, out);
+                encodeChannel(block.g, out + 8);
+                break;
+        }
+    }
+}
+
+auto compressImage(ThreadPool & workers, const std::span<const uint8_t> rgba, const uint32_t width,
+                   const uint32_t height, const BlockFormat format, const std::span<std::byte> out) -> void
+{
+    assert(rgba.size() == static_cast<size_t>(width) * height * 4);
+    assert(out.size() == compressedSize(format, width, height));
+
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const size_t rowSize = blocksX * blockSize(format);
+
+    workers.parallelFor(blocksY, BlockRowsPerJob, [&](const size_t blockY) {
+        std::byte * row = out.data() + blockY * rowSize;
+        for (uint32_t blockX = 0; blockX < blocksX; ++blockX)
+        {
+            const Block block = loadBlock(rgba, width, height, blockX, static_cast<uint32_t>(blockY));
+            encodeBlock(format, block, row + blockX * blockSize(format));
+        }
+    });
+}
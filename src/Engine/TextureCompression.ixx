@@ -0,0 +1,34 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module Engine.TextureCompression;
+import std.compat;
+import Utility.ThreadPool;
+
+/**
+ * Block formats of the encoder, every block covers 4x4 pixels.
+ */
+export enum class BlockFormat : uint32_t
+{
+    BC1, // RGB endpoints and 2-bit indices, 8 bytes
+    BC3, // A BC4 alpha block followed by a BC1 color block, 16 bytes
+    BC5, // Two BC4 blocks for red and green, 16 bytes. Used for normal maps, blue is rebuilt in the shader
+};
+
+export [[nodiscard]] constexpr auto blockSize(const BlockFormat format) -> size_t
+{
+    return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+export [[nodiscard]] constexpr auto compressedSize(const BlockFormat format, const uint32_t width,
+                                                   const uint32_t height) -> size_t
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+/**
+ * Encode an RGBA8 image into out, which holds compressedSize() bytes. Block rows are encoded on the workers.
+ */
+export auto compressImage(ThreadPool & workers, std::span<const uint8_t> rgba, uint32_t width, uint32_t height,
+                          BlockFormat format, std::span<std::byte> out) -> void;
@@ -0,0 +1,261 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include <cstdio>
+#include "glad/gl.h"
+
+// GL_EXT_texture_compression_s3tc and GL_EXT_texture_sRGB are not part of the generated loader
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+
+module Engine.TextureStreamer;
+import std;
+import Engine.CookedTexture;
+import OpenGL.StateCache;
+import Utility.ThreadPool;
+
+namespace
+{
+    constexpr GLintptr UploadAlignment = 16;
+
+    auto internalFormat(const CookedTexture & texture) -> GLenum
+    {
+        const bool srgb = texture.colorSpace() == ColorSpace::Srgb;
+        switch (texture.encoding())
+        {
+            case TextureEncoding::RGBA8:
+                return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+            case TextureEncoding::BC1:
+                return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case TextureEncoding::BC3:
+                return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case TextureEncoding::BC5:
+                return GL_COMPRESSED_RG_RGTC2;
+        }
+        return GL_NONE;
+    }
+
+    auto applySampler(const TextureSampler & sampler) -> void
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
+        if (sampler.minFilter > -1)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+        }
+        if (sampler.magFilter > -1)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+        }
+    }
+
+    /**
+     * data is a pointer, or an offset in the bound pixel unpack buffer.
+     */
+    auto uploadLevel(const CookedTexture & texture, const std::uint32_t level, const void * data) -> void
+    {
+        const auto [width, height, bytes] = texture.level(level);
+        if (texture.encoding() == TextureEncoding::RGBA8)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, static_cast<GLsizei>(width),
+                            static_cast<GLsizei>(height), GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        else
+        {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, static_cast<GLsizei>(width),
+                                      static_cast<GLsizei>(height), internalFormat(texture),
+                                      static_cast<GLsizei>(bytes.size()), data);
+        }
+    }
+
+    /**
+     * Specify every level without data, the texture keeps sampling only its uploaded levels through the base level.
+     */
+    auto allocateLevels(const CookedTexture & texture) -> void
+    {
+        const GLenum format = internalFormat(texture);
+        for (std::uint32_t level = 0; level < texture.levelCount(); ++level)
+        {
+            const auto [width, height, bytes] = texture.level(level);
+            if (texture.encoding() == TextureEncoding::RGBA8)
+            {
+                glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), static_cast<GLint>(format),
+                             static_cast<GLsizei>(width), static_cast<GLsizei>(height), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             nullptr);
+            }
+            else
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, static_cast<GLsizei>(width),
+                                       static_cast<GLsizei>(height), 0, static_cast<GLsizei>(bytes.size()), nullptr);
+            }
+        }
+
+        const auto lastLevel = static_cast<GLint>(texture.levelCount() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, lastLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // Queued loads are skipped, m_decoders then waits for the running ones
+    m_stopping = true;
+
+    for (const auto fence: m_fences)
+    {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    }
+    if (m_buffer != 0)
+        glDeleteBuffers(1, &m_buffer);
+}
+
+auto TextureStreamer::request(OpenGL::StateCache & state, const std::span<const std::byte> source,
+                              const CookSettings & settings, const std::array<std::uint8_t, 4> & placeholder) -> GLuint
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    state.bindTexture(GL_TEXTURE_2D, texture);
+    applySampler(settings.sampler);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder.data());
+
+    m_decoders.submit([this, texture, settings, source = std::vector(source.begin(), source.end())] {
+        if (m_stopping)
+            return;
+
+        auto e_cooked = loadCookedTexture(source, settings);
+        std::lock_guard lock(m_mutex);
+        m_loaded.push_back({texture, std::move(e_cooked)});
+    });
+    return texture;
+}
+
+auto TextureStreamer::beginFrame(OpenGL::StateCache & state) -> void
+{
+    if (m_buffer == 0)
+    {
+        glGenBuffers(1, &m_buffer);
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, SegmentSize * FramesInFlight, nullptr, GL_STREAM_DRAW);
+    }
+
+    m_frame = (m_frame + 1) % FramesInFlight;
+    if (m_fences[m_frame] != nullptr)
+    {
+        // Should almost never wait, the segment was used FramesInFlight frames ago
+        glClientWaitSync(m_fences[m_frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(m_fences[m_frame]);
+        m_fences[m_frame] = nullptr;
+    }
+    m_head = 0;
+}
+
+auto TextureStreamer::endFrame() -> void
+{
+    if (m_head > 0)
+        m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+auto TextureStreamer::uploadLevels(OpenGL::StateCache & state, Upload & upload) -> bool
+{
+    const auto & cooked = upload.cooked;
+    state.bindTexture(GL_TEXTURE_2D, upload.texture);
+
+    if (!upload.allocated)
+    {
+        // Started only if its smallest level fits, so the texture is never left without levels
+        if (cooked.level(cooked.levelCount() - 1).data.size() > static_cast<std::size_t>(SegmentSize - m_head))
+            return false;
+
+        state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        allocateLevels(cooked);
+        upload.allocated = true;
+    }
+
+    while (upload.nextLevel > 0)
+    {
+        const std::uint32_t level = upload.nextLevel - 1;
+        const auto data = cooked.level(level).data;
+        const auto size = static_cast<GLsizeiptr>(data.size());
+
+        if (size <= SegmentSize - m_head)
+        {
+            const GLintptr offset = static_cast<GLintptr>(m_frame) * SegmentSize + m_head;
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+
+            bool staged = false;
+            if (void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+                                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                                 GL_MAP_UNSYNCHRONIZED_BIT); mapped != nullptr)
+            {
+                std::memcpy(mapped, data.data(), data.size());
+                // GL_FALSE if the buffer content was lost while mapped
+                staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+            }
+
+            if (staged)
+            {
+                uploadLevel(cooked, level, reinterpret_cast<const void *>(offset));
+                m_head += (size + UploadAlignment - 1) / UploadAlignment * UploadAlignment;
+            }
+            else
+            {
+                // The map failed, out of memory for example, the level still has its data in client memory
+                state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                uploadLevel(cooked, level, data.data());
+            }
+        }
+        else if (m_head == 0)
+        {
+            // Larger than a segment, uploaded alone from client memory
+            state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadLevel(cooked, level, data.data());
+            m_head = SegmentSize;
+        }
+        else
+        {
+            return false;
+        }
+
+        upload.nextLevel = level;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level));
+    }
+    return true;
+}
+
+auto TextureStreamer::update(OpenGL::StateCache & state) -> void
+{
+    {
+        std::lock_guard lock(m_mutex);
+        for (auto & [texture, e_cooked]: m_loaded)
+        {
+            if (!e_cooked)
+            {
+                std::println(stderr, "Failed to load texture: {}", e_cooked.error());
+                continue;
+            }
+            const std::uint32_t levelCount = e_cooked->levelCount();
+            m_uploads.push_back({texture, std::move(*e_cooked), levelCount});
+        }
+        m_loaded.clear();
+    }
+
+    if (m_uploads.empty())
+        return;
+
+    beginFrame(state);
+    while (!m_uploads.empty() && uploadLevels(state, m_uploads.front()))
+        m_uploads.pop_front();
+    endFrame();
+
+    // Other uploads pass client memory pointers
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
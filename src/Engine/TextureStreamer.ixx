@@ -0,0 +1,85 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module Engine.TextureStreamer;
+import std;
+import Engine.CookedTexture;
+import OpenGL.StateCache;
+import Utility.ThreadPool;
+
+/**
+ * Loads textures in the background. Images are decoded and cooked on dedicated threads, so the engine workers and
+ * the frame never wait for them. Textures show a 1x1 placeholder until their levels are uploaded.
+ *
+ * Uploads go through a ring of pixel unpack buffer segments, with a fence per frame like the uniform ring. Each frame
+ * uploads at most one segment worth of levels, smallest first, lowering the base level of the texture as they
+ * arrive.
+ */
+export class TextureStreamer
+{
+public:
+    static constexpr GLuint FramesInFlight = 3;
+    static constexpr GLsizeiptr SegmentSize = 8 * 1024 * 1024;
+
+private:
+    struct Loaded
+    {
+        GLuint texture;
+        std::expected<CookedTexture, std::string> e_cooked;
+    };
+
+    struct Upload
+    {
+        GLuint texture;
+        CookedTexture cooked;
+        std::uint32_t nextLevel; // Levels above it are uploaded
+        bool allocated{false};
+    };
+
+    std::mutex m_mutex;
+    std::vector<Loaded> m_loaded;
+    std::deque<Upload> m_uploads;
+
+    GLuint m_buffer{0};
+    GLuint m_frame{0};
+    GLintptr m_head{0};
+    std::array<GLsync, FramesInFlight> m_fences{};
+
+    std::atomic<bool> m_stopping{false};
+    ThreadPool m_decoders{std::max(ThreadPool::defaultThreadCount() / 2, 1u)}; // Last, its jobs use the members above
+
+    auto beginFrame(OpenGL::StateCache & state) -> void;
+
+    auto endFrame() -> void;
+
+    /**
+     * Upload the remaining levels of the texture that fit in the segment. Returns whether all were uploaded.
+     */
+    auto uploadLevels(OpenGL::StateCache & state, Upload & upload) -> bool;
+
+public:
+    TextureStreamer() = default;
+
+    TextureStreamer(const TextureStreamer &) = delete;
+
+    ~TextureStreamer();
+
+    auto operator=(const TextureStreamer &) -> TextureStreamer & = delete;
+
+    /**
+     * Create the texture with the placeholder texel, and start loading the encoded image (PNG, JPEG...).
+     */
+    [[nodiscard]] auto request(OpenGL::StateCache & state, std::span<const std::byte> source,
+                               const CookSettings & settings, const std::array<std::uint8_t, 4> & placeholder)
+        -> GLuint;
+
+    /**
+     * Upload the textures loaded since the last call, within the budget of a segment. Once per frame.
+     */
+    auto update(OpenGL::StateCache & state) -> void;
+};
@@ -0,0 +1,206 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include <cstdio>
+#include "glad/gl.h"
+
+module Engine.VertexAnimation;
+import std;
+import glm;
+import Engine.PoseCache;
+
+namespace
+{
+    auto findAttribute(const PrimitiveRenderInfo & primitive, const PrimitiveAttributeType type) -> AccessorIndex
+    {
+        for (const auto & attribute: primitive.attributes)
+        {
+            if (attribute.type == type)
+                return attribute.accessor;
+        }
+        return -1;
+    }
+
+    /**
+     * Missing accessors and components keep the values of value.
+     */
+    auto readVec4(const ModelRenderInfo & model, const AccessorIndex accessorIndex, const size_t index,
+                  glm::vec4 value) -> glm::vec4
+    {
+        if (accessorIndex < 0)
+            return value;
+
+        const auto & accessor = model.accessors[accessorIndex];
+        const auto * element = accessorData(model, accessor) + index * accessor.byteStride;
+        for (GLint c = 0; c < std::min(accessor.componentCount, 4); ++c)
+            value[c] = readComponent(element + c * accessor.componentSize, accessor.componentType, accessor.normalized);
+        return value;
+    }
+
+    auto collectDrawsRecursive(const ModelRenderInfo & model, const NodeIndex nodeIndex,
+                               std::vector<VertexAnimationDraw> & draws, GLint & vertexCount) -> void
+    {
+        const NodeRenderInfo & node = model.nodes[nodeIndex];
+
+        if (node.mesh > -1)
+        {
+            const auto & mesh = model.meshes[node.mesh];
+            for (size_t i = 0; i < mesh.primitivesCount; ++i)
+            {
+                const auto & primitive = mesh.primitives[i];
+                const AccessorIndex position = findAttribute(primitive, PrimitiveAttributeType::Position);
+                if (position < 0)
+                    continue;
+
+                draws.push_back({
+                    .node = nodeIndex,
+                    .mesh = node.mesh,
+                    .primitive = i,
+                    .vertexOffset = vertexCount - primitive.geometry.baseVertex,
+                });
+                vertexCount += static_cast<GLint>(model.accessors[position].count);
+            }
+        }
+
+        for (int i = 0; i < node.childrenCount; ++i)
+            collectDrawsRecursive(model, node.children[i], draws, vertexCount);
+    }
+}
+
+auto VertexAnimation::bake(ThreadPool & workers, const ModelRenderInfo & model, const Animation & animation,
+                           const std::span<const VertexAnimationDraw> draws, const GLint vertexCount,
+                           const GLint frameCount) -> std::vector<glm::vec4>
+{
+    const size_t texelCount = 2 * static_cast<size_t>(vertexCount) * frameCount;
+    const size_t height = (texelCount + TextureWidth - 1) / TextureWidth;
+    std::vector<glm::vec4> texels(height * TextureWidth, glm::vec4(0));
+
+    // Frames are independent, each one is sampled without cursors
+    workers.parallelFor(frameCount, 1, [&](const size_t frame)
+    {
+        Pose pose;
+        pose.layer = PoseLayer{
+            .animation = &animation,
+            .time = animation.duration() * static_cast<float>(frame) / static_cast<float>(frameCount),
+        };
+        PoseCache::evaluateSampled(model, pose);
+
+        auto * out = texels.data() + 2 * frame * vertexCount;
+        for (const auto & draw: draws)
+        {
+            const auto & node = model.nodes[draw.node];
+            const auto & primitive = model.meshes[draw.mesh].primitives[draw.primitive];
+            const glm::mat4 & nodeTransform = pose.nodeTransforms[draw.node];
+            const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(nodeTransform)));
+
+            const AccessorIndex positions = findAttribute(primitive, PrimitiveAttributeType::Position);
+            const AccessorIndex normals = findAttribute(primitive, PrimitiveAttributeType::Normal);
+            const AccessorIndex joints = findAttribute(primitive, PrimitiveAttributeType::Joints0);
+            const AccessorIndex weights = findAttribute(primitive, PrimitiveAttributeType::Weights0);
+            const bool skinned = node.skin > -1 && joints >= 0 && weights >= 0;
+
+            const GLint firstVertex = draw.vertexOffset + primitive.geometry.baseVertex;
+            const size_t count = model.accessors[positions].count;
+            for (size_t v = 0; v < count; ++v)
+            {
+                const glm::vec3 position = readVec4(model, positions, v, glm::vec4(0));
+                const glm::vec3 normal = readVec4(model, normals, v, glm::vec4(0));
+
+                glm::mat4 skinMatrix = glm::identity<glm::mat4>();
+                if (skinned)
+                {
+                    const auto & jointMatrices = pose.jointMatrices[node.skin];
+                    const glm::vec4 jointIndices = readVec4(model, joints, v, glm::vec4(0));
+                    const glm::vec4 jointWeights = readVec4(model, weights, v, glm::vec4(0));
+
+                    skinMatrix = glm::mat4(0);
+                    for (int j = 0; j < 4; ++j)
+                        skinMatrix += jointWeights[j] * jointMatrices[static_cast<size_t>(jointIndices[j])];
+                }
+
+                // Same transforms as pbr.vert, a blend of joints needs the inverse transpose of the whole matrix
+                const glm::mat3 skinnedNormalMatrix = skinned
+                    ? glm::transpose(glm::inverse(glm::mat3(nodeTransform) * glm::mat3(skinMatrix)))
+                    : normalMatrix;
+                const glm::vec3 skinnedNormal = skinnedNormalMatrix * normal;
+                const float normalLength = glm::length(skinnedNormal);
+
+                auto * texel = out + 2 * (firstVertex + v);
+                texel[0] = glm::vec4(glm::vec3(nodeTransform * skinMatrix * glm::vec4(position, 1)), 1);
+                texel[1] = glm::vec4(normalLength > 0 ? skinnedNormal / normalLength : skinnedNormal, 0);
+            }
+        }
+    });
+
+    return texels;
+}
+
+auto VertexAnimation::Create(OpenGL::StateCache * stateCache, ThreadPool & workers, const ModelRenderInfo & model,
+                             const Animation & animation, const float frameRate,
+                             const std::filesystem::path & cachePath) -> std::expected<VertexAnimation, std::string>
+{
+    std::vector<VertexAnimationDraw> draws;
+    GLint vertexCount = 0;
+    for (int i = 0; i < model.rootNodesCount; ++i)
+        collectDrawsRecursive(model, model.rootNodes[i], draws, vertexCount);
+
+    if (vertexCount == 0)
+        return std::unexpected<std::string>("Model has no vertex to bake");
+    if (animation.duration() <= 0)
+        return std::unexpected<std::string>("Animation is empty");
+
+    const GLint frameCount = std::max(static_cast<GLint>(std::lround(animation.duration() * frameRate)), 1);
+    const size_t texelCount = 2 * static_cast<size_t>(vertexCount) * frameCount;
+    const auto height = static_cast<GLsizei>((texelCount + TextureWidth - 1) / TextureWidth);
+
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (height > maxTextureSize)
+    {
+        return std::unexpected<std::string>(
+            std::format("Vertex animation needs {} rows, only {} are supported", height, maxTextureSize));
+    }
+
+    TRY_V(auto, texture, OpenGL::Texture2D::builder(stateCache)
+        .internalFormat(GL_RGBA32F)
+        .size(TextureWidth, height)
+        .filtering(GL_NEAREST, GL_NEAREST)
+        .debugLabel("Vertex Animation")
+        .build());
+
+    if (!texture.fromCache(cachePath, GL_RGBA, GL_FLOAT))
+    {
+        const auto texels = bake(workers, model, animation, draws, vertexCount, frameCount);
+        texture.fromRaw(GL_RGBA, GL_FLOAT, texels.data());
+        TRY_LOG(texture.saveCache(cachePath, GL_RGBA, GL_FLOAT));
+    }
+
+    return std::expected<VertexAnimation, std::string>{
+        std::in_place, std::move(texture), std::move(draws), vertexCount, frameCount, animation.duration()
+    };
+}
+
+auto VertexAnimation::prepareShaderPrograms(ShaderManager & manager, const ModelRenderInfo & model,
+                                            const SlotSetIndex vertexShaderFile,
+                                            const SlotSetIndex fragmentShaderFile) -> std::expected<void, std::string>
+{
+    for (auto & draw: m_draws)
+    {
+        const auto & primitive = model.meshes[draw.mesh].primitives[draw.primitive];
+
+        // Skinning is already baked, the skin attributes are left unused. Tangents are not baked, they would not
+        // follow the animation, so normal maps are ignored.
+        ShaderFlags shaderFlags = ShaderFlags::HasVertexAnimation;
+        if (primitive.material != -1)
+            shaderFlags |= model.materials[primitive.material].shaderFlags & ~ShaderFlags::HasNormalMap;
+
+        TRY_V(const SlotSetIndex, programIndex,
+              manager.getOrCreateShaderProgram(vertexShaderFile, fragmentShaderFile, shaderFlags));
+        draw.programIndex = programIndex;
+    }
+
+    return {};
+}
@@ -0,0 +1,82 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module Engine.VertexAnimation;
+import std;
+import glm;
+import Engine.Animation;
+import Engine.RenderInfo;
+import OpenGL;
+import OpenGL.StateCache;
+import OpenGL.Texture2D;
+import Utility;
+import Utility.SlotSet;
+
+/**
+ * Primitive of a mesh node, its vertices start at vertexOffset + gl_VertexID in each baked frame.
+ */
+export struct VertexAnimationDraw
+{
+    NodeIndex node{-1};
+    int mesh{-1};
+    size_t primitive{0};
+    GLint vertexOffset{0}; // First baked vertex minus the base vertex of the primitive in its arena
+    SlotSetIndex programIndex;
+};
+
+/**
+ * Positions and normals of every mesh node of a model, skinned in model space at each frame of an animation. Vertex v
+ * of frame f is stored in texels 2 * (f * vertexCount + v) (position) and 2 * (f * vertexCount + v) + 1 (normal),
+ * row by row in a TextureWidth wide RGBA32F texture. The bake is cached, it only runs on the first launch.
+ */
+export class VertexAnimation
+{
+public:
+    static constexpr GLsizei TextureWidth = 4096;
+
+private:
+    OpenGL::Texture2D m_texture;
+    std::vector<VertexAnimationDraw> m_draws;
+    GLint m_vertexCount{0};
+    GLint m_frameCount{0};
+    float m_duration{0};
+
+    static auto bake(ThreadPool & workers, const ModelRenderInfo & model, const Animation & animation,
+                     std::span<const VertexAnimationDraw> draws, GLint vertexCount, GLint frameCount)
+        -> std::vector<glm::vec4>;
+
+public:
+    /**
+     * Frames are spread evenly over the animation so it loops seamlessly, at about frameRate frames per second.
+     */
+    static auto Create(OpenGL::StateCache * stateCache, ThreadPool & workers, const ModelRenderInfo & model,
+                       const Animation & animation, float frameRate, const std::filesystem::path & cachePath)
+        -> std::expected<VertexAnimation, std::string>;
+
+    VertexAnimation(OpenGL::Texture2D && texture, std::vector<VertexAnimationDraw> && draws, const GLint vertexCount,
+                    const GLint frameCount, const float duration) : m_texture(std::move(texture)),
+                                                                    m_draws(std::move(draws)),
+                                                                    m_vertexCount(vertexCount),
+                                                                    m_frameCount(frameCount),
+                                                                    m_duration(duration)
+    {}
+
+    /**
+     * Same programs as the primitives, with the HasVertexAnimation variant of the vertex shader and without normal
+     * maps.
+     */
+    [[nodiscard]] auto prepareShaderPrograms(ShaderManager & manager, const ModelRenderInfo & model,
+                                             SlotSetIndex vertexShaderFile, SlotSetIndex fragmentShaderFile)
+        -> std::expected<void, std::string>;
+
+    [[nodiscard]] auto texture() const -> const OpenGL::Texture2D & { return m_texture; }
+    [[nodiscard]] auto draws() const -> const std::vector<VertexAnimationDraw> & { return m_draws; }
+    [[nodiscard]] auto vertexCount() const -> GLint { return m_vertexCount; }
+    [[nodiscard]] auto frameCount() const -> GLint { return m_frameCount; }
+    [[nodiscard]] auto duration() const -> float { return m_duration; }
+};
@@ -10,6 +10,8 @@ export module InterfaceBlocks:AnimationInterfaceBlock;
 import std.compat;
 import Components;
 import Engine;
+import Engine.PoseCache;
+import Time;
 
 export class AnimationInterfaceBlock : public InterfaceBlock
 {
@@ -38,6 +40,16 @@ public:
 
         if (ImGui::Combo("##animation", &selectedIndex, m_animationsNames.data(),
                          static_cast<int>(m_animationsNames.size())))
-            m_animator->setAnimation(selectedIndex - 1);
+            m_animator->crossFade(selectedIndex - 1, DurationType(0.3f));
+
+        auto & poseCache = engine.poseCache();
+        float timeStep = poseCache.timeStep() * 1000.0f;
+
+        ImGui::Text("Pose time step (ms)");
+        if (ImGui::SliderFloat("##poseTimeStep", &timeStep, 0.0f, 100.0f, "%.1f"))
+            poseCache.setTimeStep(timeStep / 1000.0f);
+
+        const auto & stats = poseCache.stats();
+        ImGui::Text("Poses: %zu, hits: %zu, misses: %zu", stats.poses, stats.hits, stats.misses);
     }
 };
@@ -14,8 +14,7 @@ namespace OpenGL
         GLuint id;
         glGenBuffers(1, &id);
 
-        if (m_stateCache->setBoundBuffer(m_target, id))
-            glBindBuffer(m_target, id);
+        m_stateCache->bindBuffer(m_target, id);
 
         glBufferData(m_target, m_size, m_data, m_usage);
 
@@ -53,7 +53,7 @@ export namespace OpenGL
             if (m_id != 0)
             {
                 glDeleteBuffers(1, &m_id);
-                m_stateCache->invalidateBuffer(m_target, m_id);
+                m_stateCache->invalidateBuffer(m_id);
                 m_id = 0;
                 m_target = 0;
             }
@@ -61,8 +61,7 @@ export namespace OpenGL
 
         auto bind() const -> void
         {
-            if (m_stateCache->setBoundBuffer(m_target, m_id))
-                glBindBuffer(m_target, m_id);
+            m_stateCache->bindBuffer(m_target, m_id);
         }
 
         [[nodiscard]]
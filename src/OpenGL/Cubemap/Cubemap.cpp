@@ -11,34 +11,16 @@ module OpenGL.Cubemap;
 import DataCache;
 import glm;
 import OpenGL;
-import OpenGL.Utility;
+import OpenGL.PixelPacking;
 import Engine;
 
-static auto textureSizeInMemoryForLevel(const GLenum format,
-                                        const GLenum type,
-                                        const uint32_t baseWidth,
-                                        const uint32_t baseHeight,
-                                        const uint32_t level) -> uint32_t
+/**
+ * Bytes of a face at level in the cache encoding.
+ */
+static auto faceSize(const GLint internalFormat, const GLsizei size, const GLuint level) -> size_t
 {
-    const uint32_t pixelSize = OpenGL::formatComponentsCount(format) * OpenGL::typeSize(type);
-    const uint32_t levelsSize = (baseWidth * baseHeight) >> level;
-    return pixelSize * levelsSize;
-}
-
-static auto textureSizeInMemory(const GLenum format,
-                                const GLenum type,
-                                const uint32_t baseWidth,
-                                const uint32_t baseHeight,
-                                const uint32_t baseLevel,
-                                const uint32_t maxLevel) -> uint32_t
-{
-    const uint32_t pixelSize = OpenGL::formatComponentsCount(format) * OpenGL::typeSize(type);
-    uint32_t levelsSize = 0;
-    for (uint32_t level = baseLevel; level <= maxLevel; ++level)
-    {
-        levelsSize += (baseWidth * baseHeight) >> level;
-    }
-    return pixelSize * levelsSize;
+    const auto levelSize = static_cast<size_t>(std::max(size >> level, 1));
+    return OpenGL::rgbEncoding(internalFormat).pixelSize * levelSize * levelSize;
 }
 
 namespace OpenGL
@@ -53,22 +35,14 @@ namespace OpenGL
             return std::unexpected<std::string>("Failed to generate texture");
         }
 
-        if (m_stateCache->setActiveTexture(GL_TEXTURE0))
-        {
-            glActiveTexture(GL_TEXTURE0);
-        }
-
-        if (m_stateCache->setBoundTexture(id))
-        {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, id);
-        }
+        m_stateCache->bindTexture(0, GL_TEXTURE_CUBE_MAP, id);
 
         // if (m_debugLabel != nullptr)
         // {
         //     glObjectLabel(GL_TEXTURE, id, static_cast<GLint>(std::strlen(m_debugLabel)), m_debugLabel);
         // }
 
-        for (GLint l = 0; l < 5; ++l)
+        for (GLint l = 0; l <= static_cast<GLint>(m_maxLevel); ++l)
         {
             for (GLuint i = 0; i < 6; ++i)
             {
@@ -92,12 +66,14 @@ namespace OpenGL
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, m_baseLevel);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, m_maxLevel);
 
-        return std::expected<Cubemap, std::string>{std::in_place, m_stateCache, id, m_size, m_baseLevel, m_maxLevel};
+        return std::expected<Cubemap, std::string>{
+            std::in_place, m_stateCache, id, m_internalFormat, m_size, m_baseLevel, m_maxLevel
+        };
     }
 
-    auto Cubemap::fromCache(const std::filesystem::path & path, const GLenum format, const GLenum type) -> bool
+    auto Cubemap::fromCache(const std::filesystem::path & path) -> bool
     {
-        const auto oe_result = DataCache::readFile(path);
+        const auto oe_result = DataCache::mapFile(path);
 
         if (!oe_result)
         {
@@ -110,42 +86,55 @@ namespace OpenGL
             return false;
         }
 
-        const uint32_t saveSize = textureSizeInMemory(format, type, size(), size(), m_baseLevel, m_maxLevel) * 6;
+        // Uploaded straight from the mapped pages
+        const auto pixels = oe_result->value().data();
 
-        if (oe_result->value().size() != saveSize)
+        size_t saveSize = 0;
+        for (GLuint level = m_baseLevel; level <= m_maxLevel; ++level)
         {
-            std::println(stderr, "Failed to load texture from {}: unexpected size", path.c_str(),
-                         oe_result->value().size());
+            saveSize += faceSize(m_internalFormat, m_size, level) * 6;
+        }
+
+        if (pixels.size() != saveSize)
+        {
+            std::println(stderr, "Failed to load texture from {}: unexpected size {}", path.c_str(), pixels.size());
             return false;
         }
 
-        uint32_t offset = 0;
+        const auto [format, type, pixelSize] = rgbEncoding(m_internalFormat);
+        size_t offset = 0;
         for (GLuint level = m_baseLevel; level <= m_maxLevel; ++level)
         {
             for (GLuint face = 0; face < 6; ++face)
             {
-                fromRaw(format, type, oe_result->value().data() + offset, level, face);
-                offset += textureSizeInMemoryForLevel(format, type, size(), size(), level);
+                fromRaw(format, type, pixels.data() + offset, level, face);
+                offset += faceSize(m_internalFormat, m_size, level);
             }
         }
         return true;
     }
 
-    auto Cubemap::saveCache(const std::filesystem::path & path, const GLenum format,
-                            const GLenum type) const -> std::expected<void, std::string>
+    /**
+     * Levels are read back as floats and packed on the CPU, drivers often convert to packed types on a slow path.
+     */
+    auto Cubemap::saveCache(const std::filesystem::path & path) const -> std::expected<void, std::string>
     {
-        const uint32_t saveSize = textureSizeInMemory(format, type, size(), size(), m_baseLevel, m_maxLevel) * 6;
-
-        std::vector<std::byte> pixels(saveSize);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+        std::vector<std::byte> pixels;
+        std::vector<float> rgb;
+        m_stateCache->bindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+        m_stateCache->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-        uint32_t offset = 0;
         for (GLuint level = m_baseLevel; level <= m_maxLevel; ++level)
         {
+            const auto levelSize = static_cast<size_t>(std::max(m_size >> level, 1));
+            rgb.resize(levelSize * levelSize * 3);
             for (GLuint face = 0; face < 6; ++face)
             {
-                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, format, type, pixels.data() + offset);
-                offset += textureSizeInMemoryForLevel(format, type, size(), size(), level);
+                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, rgb.data());
+
+                const size_t offset = pixels.size();
+                pixels.resize(offset + faceSize(m_internalFormat, m_size, level));
+                encodeRgb(m_internalFormat, rgb, std::span(pixels).subspan(offset));
             }
         }
 
@@ -156,22 +145,38 @@ namespace OpenGL
     auto Cubemap::fromRaw(const GLenum format, const GLenum type, const void * const pixels,
                           const GLint level, const GLuint face) -> void
     {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+        m_stateCache->bindTexture(GL_TEXTURE_CUBE_MAP, m_id);
         glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, m_size >> level, m_size >> level, format, type, pixels);
     }
 
+    auto Cubemap::fromRgb(const std::span<const float> rgb, const GLint level, const GLuint face) -> void
+    {
+        const auto levelSize = static_cast<size_t>(std::max(m_size >> level, 1));
+        assert(rgb.size() == levelSize * levelSize * 3);
+
+        const auto [format, type, pixelSize] = rgbEncoding(m_internalFormat);
+        if (type == GL_FLOAT)
+        {
+            fromRaw(format, type, rgb.data(), level, face);
+            return;
+        }
+
+        std::vector<std::byte> pixels(faceSize(m_internalFormat, m_size, level));
+        encodeRgb(m_internalFormat, rgb, pixels);
+        fromRaw(format, type, pixels.data(), level, face);
+    }
+
     auto Cubemap::fromEquirectangular(ShaderProgram & converter,
                                       const Texture2D & equirectangular) -> std::expected<void, std::string>
     {
         GLuint captureFBO;
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+        m_stateCache->bindTexture(0, GL_TEXTURE_CUBE_MAP, m_id);
 
-        glDisable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, false);
         glGenFramebuffers(1, &captureFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-        glViewport(0, 0, m_size, m_size);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        m_stateCache->viewport(0, 0, m_size, m_size);
 
         const std::array<glm::mat4, 6> captureViews = {
             glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
@@ -184,29 +189,29 @@ namespace OpenGL
 
         const glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
 
-        glUseProgram(converter.id()); // Bad way to use
-        converter.setInt("u_equirectangularMap", 0);
+        m_stateCache->useProgram(converter.id());
+        converter.setInt(Uniform::EquirectangularMap, 0);
 
-        equirectangular.bind(GL_TEXTURE0);
+        equirectangular.bind(0);
 
         for (unsigned int i = 0; i < 6; ++i)
         {
-            converter.setMat4("u_projectionView", captureProjection * captureViews[i]);
+            converter.setMat4(Uniform::ProjectionView, captureProjection * captureViews[i]);
             glFramebufferTexture2D(GL_FRAMEBUFFER,
                                    GL_COLOR_ATTACHMENT0,
                                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                                    m_id,
                                    0);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderCube();
+            renderCube(*m_stateCache);
         }
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+        m_stateCache->bindTexture(GL_TEXTURE_CUBE_MAP, m_id);
         glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, 0);
         glDeleteFramebuffers(1, &captureFBO);
-        glEnable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, true);
 
         return {};
     }
@@ -215,12 +220,17 @@ namespace OpenGL
     auto Cubemap::fromCubemap(ShaderProgram & converter, const Cubemap & cubemap,
                               const GLint level) -> std::expected<void, std::string>
     {
+        if (m_internalFormat == GL_RGB9_E5)
+        {
+            return std::unexpected<std::string>(std::in_place, "GL_RGB9_E5 is not color-renderable, use fromRgb");
+        }
+
         GLuint captureFBO;
 
-        glDisable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, false);
         glGenFramebuffers(1, &captureFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-        glViewport(0, 0, m_size >> level, m_size >> level);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        m_stateCache->viewport(0, 0, m_size >> level, m_size >> level);
 
         const std::array<glm::mat4, 6> captureViews = {
             glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)),
@@ -233,31 +243,31 @@ namespace OpenGL
 
         const glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
 
-        glUseProgram(converter.id()); // Bad way to use
-        converter.setInt("u_cubemap", 0);
+        m_stateCache->useProgram(converter.id());
+        converter.setInt(Uniform::Cubemap, 0);
 
-        cubemap.bind(GL_TEXTURE0);
+        cubemap.bind(0);
 
         // ------------ TMP ------------
-        float roughness = (float) level / (float) (5 - 1);
-        converter.setFloat("u_roughness", roughness);
+        float roughness = m_maxLevel > 0 ? (float) level / (float) m_maxLevel : 0.0f;
+        converter.setFloat(Uniform::Roughness, roughness);
         // ------------ TMP ------------
 
         for (unsigned int i = 0; i < 6; ++i)
         {
-            converter.setMat4("u_projectionView", captureProjection * captureViews[i]);
+            converter.setMat4(Uniform::ProjectionView, captureProjection * captureViews[i]);
             glFramebufferTexture2D(GL_FRAMEBUFFER,
                                    GL_COLOR_ATTACHMENT0,
                                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                                    m_id,
                                    level);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderCube();
+            renderCube(*m_stateCache);
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, 0);
         glDeleteFramebuffers(1, &captureFBO);
-        glEnable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, true);
 
         return {};
     }
@@ -20,6 +20,7 @@ export namespace OpenGL
     {
     private:
         StateCache * m_stateCache;
+        GLint m_internalFormat;
         GLsizei m_size;
         GLuint m_id;
         GLuint m_baseLevel;
@@ -28,11 +29,13 @@ export namespace OpenGL
     public:
         Cubemap() = delete;
 
-        explicit Cubemap(std::nullptr_t) noexcept : m_stateCache(nullptr), m_id(0), m_size(0)
+        explicit Cubemap(std::nullptr_t) noexcept : m_stateCache(nullptr), m_internalFormat(0), m_id(0), m_size(0)
         {}
 
-        explicit Cubemap(StateCache * stateCache, const GLuint id, const GLsizei size, const GLuint baseLevel, const GLuint maxLevel) noexcept
-            : m_stateCache(stateCache), m_size(size), m_id(id), m_baseLevel(baseLevel), m_maxLevel(maxLevel)
+        explicit Cubemap(StateCache * stateCache, const GLuint id, const GLint internalFormat, const GLsizei size,
+                         const GLuint baseLevel, const GLuint maxLevel) noexcept
+            : m_stateCache(stateCache), m_internalFormat(internalFormat), m_size(size), m_id(id),
+              m_baseLevel(baseLevel), m_maxLevel(maxLevel)
         {}
 
         Cubemap(const Cubemap &) = delete;
@@ -41,6 +44,7 @@ export namespace OpenGL
 
         Cubemap(Cubemap && other) noexcept
             : m_stateCache(std::exchange(other.m_stateCache, nullptr)),
+              m_internalFormat(std::exchange(other.m_internalFormat, 0)),
               m_size(std::exchange(other.m_size, 0)),
               m_id(std::exchange(other.m_id, 0)),
               m_baseLevel(std::exchange(other.m_baseLevel, 0)),
@@ -52,6 +56,7 @@ export namespace OpenGL
             if (this != &other)
             {
                 std::swap(m_stateCache, other.m_stateCache);
+                std::swap(m_internalFormat, other.m_internalFormat);
                 std::swap(m_size, other.m_size);
                 std::swap(m_id, other.m_id);
                 std::swap(m_baseLevel, other.m_baseLevel);
@@ -65,17 +70,17 @@ export namespace OpenGL
             if (m_id != 0)
             {
                 glDeleteTextures(1, &m_id);
-                m_stateCache->invalidateBoundTexturesCache();
+                m_stateCache->invalidateTexture(m_id);
                 m_id = 0;
             }
         }
 
+        /**
+         * unit is an index, not GL_TEXTURE0 + index.
+         */
         auto bind(const GLuint unit) const -> void
         {
-            if (m_stateCache->setActiveTexture(unit))
-                glActiveTexture(unit);
-            if (m_stateCache->setBoundTexture(m_id))
-                glBindTexture(GL_TEXTURE_CUBE_MAP, m_id);
+            m_stateCache->bindTexture(unit, GL_TEXTURE_CUBE_MAP, m_id);
         }
 
         [[nodiscard]]
@@ -84,13 +89,22 @@ export namespace OpenGL
             return CubemapBuilder(stateCache);
         }
 
+        /**
+         * Cache files hold the levels in the encoding of the internal format (see rgbEncoding), so they are uploaded
+         * as is.
+         */
         [[nodiscard]]
-        auto fromCache(const std::filesystem::path & path, GLenum format, GLenum type) -> bool;
+        auto fromCache(const std::filesystem::path & path) -> bool;
         [[nodiscard]]
-        auto saveCache(const std::filesystem::path & path, GLenum format, GLenum type) const -> std::expected<void, std::string>;
+        auto saveCache(const std::filesystem::path & path) const -> std::expected<void, std::string>;
 
         auto fromRaw(GLenum format, GLenum type, const void * pixels, GLint level, GLuint face) -> void;
 
+        /**
+         * Upload RGB float texels, packed to the internal format on the CPU.
+         */
+        auto fromRgb(std::span<const float> rgb, GLint level, GLuint face) -> void;
+
         [[nodiscard]]
         auto fromEquirectangular(ShaderProgram & converter, const Texture2D & equirectangular)
             -> std::expected<void, std::string>;
@@ -104,6 +118,12 @@ export namespace OpenGL
 
         [[nodiscard]]
         constexpr auto size() const noexcept -> GLsizei { return m_size; }
+
+        [[nodiscard]]
+        constexpr auto internalFormat() const noexcept -> GLint { return m_internalFormat; }
+
+        [[nodiscard]]
+        constexpr auto maxLevel() const noexcept -> GLuint { return m_maxLevel; }
     };
 }
 
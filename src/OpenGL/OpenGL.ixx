@@ -5,12 +5,17 @@
 export module OpenGL;
 
 export import :Debug;
+export import :GeometryArena;
 export import :IndicesBuffer;
+export import :UniformRing;
 export import :VertexArray;
 export import :VertexBuffer;
 
+export import ParallelShaderCompile;
 export import Shader;
 export import ShaderFile;
 export import ShaderFlags;
 export import ShaderManager;
 export import ShaderProgram;
+export import UniformBlockBinding;
+export import UniformId;
@@ -0,0 +1,257 @@
+//
+// Created by Simon Cros on 3/8/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module OpenGL:GeometryArena;
+import std;
+import OpenGL.StateCache;
+import :VertexArray;
+
+export struct VertexAttributeFormat
+{
+    GLint componentCount;
+    GLenum componentType;
+    GLsizei size;
+    bool isInteger;
+};
+
+/**
+ * Every arena stores its vertices interleaved, attribute by attribute in location order, using the formats below.
+ * glTF accessors are converted to these formats at import time, so a single VAO describes the whole arena.
+ */
+export constexpr VertexAttributeFormat vertexAttributeFormats[] = {
+    {3, GL_FLOAT, 3 * sizeof(GLfloat), false}, // Position
+    {3, GL_FLOAT, 3 * sizeof(GLfloat), false}, // Normal
+    {4, GL_FLOAT, 4 * sizeof(GLfloat), false}, // Color0
+    {2, GL_FLOAT, 2 * sizeof(GLfloat), false}, // TexCoord0
+    {2, GL_FLOAT, 2 * sizeof(GLfloat), false}, // TexCoord1
+    {4, GL_FLOAT, 4 * sizeof(GLfloat), false}, // Tangent
+    {4, GL_UNSIGNED_SHORT, 4 * sizeof(GLushort), true}, // Joints0
+    {4, GL_FLOAT, 4 * sizeof(GLfloat), false}, // Weights0
+};
+
+export struct VertexLayout
+{
+    GLsizei stride{0};
+    GLsizei offsets[std::size(vertexAttributeFormats)]{};
+
+    static constexpr auto From(const VertexArrayFlags flags) -> VertexLayout
+    {
+        VertexLayout layout;
+        for (GLuint location = 0; location < std::size(vertexAttributeFormats); ++location)
+        {
+            if (flags & (1 << location))
+            {
+                layout.offsets[location] = layout.stride;
+                layout.stride += vertexAttributeFormats[location].size;
+            }
+        }
+        return layout;
+    }
+};
+
+export struct GeometryAllocation
+{
+    GLint baseVertex{0};
+    GLuint firstIndex{0};
+    GLsizei indexCount{0};
+
+    [[nodiscard]] auto indexOffset() const -> const void *
+    {
+        return reinterpret_cast<const void *>(static_cast<std::uintptr_t>(firstIndex) * sizeof(GLuint));
+    }
+};
+
+/**
+ * Suballocates the static geometry of every model sharing the same attributes set into one vertex buffer and one
+ * index buffer. Indices are always GL_UNSIGNED_INT and relative to the allocation, draws use the base vertex. Binds go
+ * through the state cache, which must outlive the arena.
+ */
+export class GeometryArena
+{
+public:
+    static constexpr GLsizeiptr InitialVertexCapacity = 1 << 16;
+    static constexpr GLsizeiptr InitialIndexCapacity = 1 << 18;
+
+private:
+    OpenGL::StateCache * m_stateCache;
+    VertexArrayFlags m_flags{VertexArrayHasNone};
+    VertexLayout m_layout{};
+    VertexArray m_vertexArray;
+    GLuint m_vertexBuffer{0};
+    GLuint m_indexBuffer{0};
+    GLsizeiptr m_vertexCapacity{0};
+    GLsizeiptr m_vertexCount{0};
+    GLsizeiptr m_indexCapacity{0};
+    GLsizeiptr m_indexCount{0};
+
+    auto grow(GLuint & buffer, const GLsizeiptr usedSize, const GLsizeiptr newSize) const -> void
+    {
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        m_stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+        if (buffer != 0)
+        {
+            if (usedSize > 0)
+            {
+                m_stateCache->bindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+            }
+            glDeleteBuffers(1, &buffer);
+            m_stateCache->invalidateBuffer(buffer);
+        }
+
+        buffer = newBuffer;
+    }
+
+    auto setupVertexArray() const -> void
+    {
+        m_stateCache->bindVertexArray(m_vertexArray.id());
+        m_stateCache->bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+        m_stateCache->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+        for (GLuint location = 0; location < std::size(vertexAttributeFormats); ++location)
+        {
+            if (!(m_flags & (1 << location)))
+                continue;
+
+            const auto & format = vertexAttributeFormats[location];
+            const auto offset = reinterpret_cast<const void *>(static_cast<std::uintptr_t>(m_layout.offsets[location]));
+            if (format.isInteger)
+                glVertexAttribIPointer(location, format.componentCount, format.componentType, m_layout.stride, offset);
+            else
+                glVertexAttribPointer(location, format.componentCount, format.componentType, GL_FALSE,
+                                      m_layout.stride, offset);
+        }
+
+        m_stateCache->bindVertexArray(0);
+    }
+
+    auto reserve(const GLsizeiptr vertexCount, const GLsizeiptr indexCount) -> void
+    {
+        bool changed = false;
+
+        if (m_vertexCount + vertexCount > m_vertexCapacity)
+        {
+            auto capacity = std::max(m_vertexCapacity, InitialVertexCapacity);
+            while (capacity < m_vertexCount + vertexCount)
+                capacity *= 2;
+            grow(m_vertexBuffer, m_vertexCount * m_layout.stride, capacity * m_layout.stride);
+            m_vertexCapacity = capacity;
+            changed = true;
+        }
+
+        if (m_indexCount + indexCount > m_indexCapacity)
+        {
+            auto capacity = std::max(m_indexCapacity, InitialIndexCapacity);
+            while (capacity < m_indexCount + indexCount)
+                capacity *= 2;
+            grow(m_indexBuffer, m_indexCount * static_cast<GLsizeiptr>(sizeof(GLuint)),
+                 capacity * static_cast<GLsizeiptr>(sizeof(GLuint)));
+            m_indexCapacity = capacity;
+            changed = true;
+        }
+
+        if (changed)
+            setupVertexArray();
+    }
+
+public:
+    GeometryArena(OpenGL::StateCache * stateCache, const VertexArrayFlags flags) : m_stateCache(stateCache),
+        m_flags(flags), m_layout(VertexLayout::From(flags)), m_vertexArray(VertexArray::Create(flags))
+    {
+        // Create() binds the new vertex array directly
+        m_stateCache->invalidateVertexArray();
+        m_stateCache->bindVertexArray(0);
+    }
+
+    GeometryArena(const GeometryArena &) = delete;
+
+    GeometryArena(GeometryArena && other) noexcept : m_stateCache(other.m_stateCache),
+                                                     m_flags(other.m_flags),
+                                                     m_layout(other.m_layout),
+                                                     m_vertexArray(std::move(other.m_vertexArray)),
+                                                     m_vertexBuffer(std::exchange(other.m_vertexBuffer, 0)),
+                                                     m_indexBuffer(std::exchange(other.m_indexBuffer, 0)),
+                                                     m_vertexCapacity(std::exchange(other.m_vertexCapacity, 0)),
+                                                     m_vertexCount(std::exchange(other.m_vertexCount, 0)),
+                                                     m_indexCapacity(std::exchange(other.m_indexCapacity, 0)),
+                                                     m_indexCount(std::exchange(other.m_indexCount, 0))
+    {}
+
+    ~GeometryArena()
+    {
+        for (const GLuint buffer: {m_vertexBuffer, m_indexBuffer})
+        {
+            if (buffer != 0)
+            {
+                glDeleteBuffers(1, &buffer);
+                m_stateCache->invalidateBuffer(buffer);
+            }
+        }
+        // Deleted by its member right after, its id may be reused
+        if (m_vertexArray.id() != 0)
+            m_stateCache->invalidateVertexArray();
+    }
+
+    auto operator=(const GeometryArena &) -> GeometryArena & = delete;
+
+    auto operator=(GeometryArena && other) noexcept -> GeometryArena &
+    {
+        std::swap(m_stateCache, other.m_stateCache);
+        std::swap(m_flags, other.m_flags);
+        std::swap(m_layout, other.m_layout);
+        std::swap(m_vertexArray, other.m_vertexArray);
+        std::swap(m_vertexBuffer, other.m_vertexBuffer);
+        std::swap(m_indexBuffer, other.m_indexBuffer);
+        std::swap(m_vertexCapacity, other.m_vertexCapacity);
+        std::swap(m_vertexCount, other.m_vertexCount);
+        std::swap(m_indexCapacity, other.m_indexCapacity);
+        std::swap(m_indexCount, other.m_indexCount);
+        return *this;
+    }
+
+    /**
+     * Append interleaved vertices (laid out following layout()) and their indices. Leaves the vertex array unbound.
+     */
+    [[nodiscard]] auto append(const std::span<const std::byte> vertices,
+                              const std::span<const GLuint> indices) -> GeometryAllocation
+    {
+        assert(vertices.size() % m_layout.stride == 0 && "Vertices do not match the arena layout");
+
+        const auto vertexCount = static_cast<GLsizeiptr>(vertices.size() / m_layout.stride);
+        const auto indexCount = static_cast<GLsizeiptr>(indices.size());
+
+        reserve(vertexCount, indexCount);
+
+        const GeometryAllocation allocation{
+            .baseVertex = static_cast<GLint>(m_vertexCount),
+            .firstIndex = static_cast<GLuint>(m_indexCount),
+            .indexCount = static_cast<GLsizei>(indexCount),
+        };
+
+        m_stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, m_vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, m_vertexCount * m_layout.stride,
+                        static_cast<GLsizeiptr>(vertices.size()), vertices.data());
+        m_stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, m_indexCount * static_cast<GLsizeiptr>(sizeof(GLuint)),
+                        static_cast<GLsizeiptr>(indices.size_bytes()), indices.data());
+
+        m_vertexCount += vertexCount;
+        m_indexCount += indexCount;
+
+        return allocation;
+    }
+
+    [[nodiscard]] auto flags() const -> VertexArrayFlags { return m_flags; }
+    [[nodiscard]] auto layout() const -> const VertexLayout & { return m_layout; }
+    [[nodiscard]] auto vertexArray() const -> const VertexArray & { return m_vertexArray; }
+    [[nodiscard]] auto vertexCount() const -> GLsizeiptr { return m_vertexCount; }
+    [[nodiscard]] auto indexCount() const -> GLsizeiptr { return m_indexCount; }
+};
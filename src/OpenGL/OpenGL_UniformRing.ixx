@@ -0,0 +1,204 @@
+//
+// Created by Simon Cros on 3/9/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module OpenGL:UniformRing;
+import std;
+import OpenGL.StateCache;
+
+export struct RingAllocation
+{
+    GLintptr offset{0};
+    GLsizeiptr size{0};
+};
+
+/**
+ * Streaming uniform buffer split in FramesInFlight segments. Each frame writes in its own segment, a fence is placed
+ * at the end of the frame and waited for before the segment is reused, so uploads never touch memory the GPU may
+ * still read.
+ *
+ * Allocations are written in a CPU staging copy of the segment, flush() uploads everything allocated since the
+ * previous flush with a single unsynchronized map. Allocations must be flushed before the draws using them.
+ */
+export class UniformRing
+{
+public:
+    static constexpr GLuint FramesInFlight = 3;
+    static constexpr GLsizeiptr DefaultSegmentSize = 4 * 1024 * 1024;
+
+private:
+    OpenGL::StateCache * m_stateCache;
+    GLuint m_buffer{0};
+    GLsizeiptr m_segmentSize{DefaultSegmentSize};
+    GLintptr m_alignment{256};
+    GLuint m_frame{0};
+    GLintptr m_head{0};
+    GLintptr m_flushed{0};
+    bool m_overflowed{false};
+    std::array<GLsync, FramesInFlight> m_fences{};
+    std::vector<std::byte> m_staging;
+
+    auto waitFence(const GLuint frame) -> void
+    {
+        if (m_fences[frame] != nullptr)
+        {
+            // Should almost never wait, the segment was used FramesInFlight frames ago
+            glClientWaitSync(m_fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(m_fences[frame]);
+            m_fences[frame] = nullptr;
+        }
+    }
+
+    auto create(const GLsizeiptr segmentSize) -> void
+    {
+        for (GLuint frame = 0; frame < FramesInFlight; ++frame)
+            waitFence(frame);
+
+        if (m_buffer != 0)
+        {
+            glDeleteBuffers(1, &m_buffer);
+            m_stateCache->invalidateBuffer(m_buffer);
+        }
+
+        GLint alignment;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_alignment = alignment;
+
+        m_segmentSize = segmentSize;
+        m_staging.resize(m_segmentSize);
+
+        glGenBuffers(1, &m_buffer);
+        m_stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_segmentSize * FramesInFlight, nullptr, GL_STREAM_DRAW);
+    }
+
+    [[nodiscard]] auto segmentOffset() const -> GLintptr
+    {
+        return static_cast<GLintptr>(m_frame) * m_segmentSize;
+    }
+
+public:
+    /**
+     * Buffer binds go through stateCache, which must outlive the ring.
+     */
+    explicit UniformRing(OpenGL::StateCache * stateCache, const GLsizeiptr segmentSize = DefaultSegmentSize)
+        : m_stateCache(stateCache), m_segmentSize(segmentSize)
+    {}
+
+    UniformRing(const UniformRing &) = delete;
+
+    ~UniformRing()
+    {
+        for (const auto fence: m_fences)
+        {
+            if (fence != nullptr)
+                glDeleteSync(fence);
+        }
+        if (m_buffer != 0)
+        {
+            glDeleteBuffers(1, &m_buffer);
+            m_stateCache->invalidateBuffer(m_buffer);
+        }
+    }
+
+    auto operator=(const UniformRing &) -> UniformRing & = delete;
+
+    /**
+     * Switch to the next segment, waiting for the GPU to be done with it. Grows the ring if the previous frame did
+     * not fit.
+     */
+    auto beginFrame() -> void
+    {
+        if (m_buffer == 0 || m_overflowed)
+        {
+            create(m_buffer == 0 ? m_segmentSize : m_segmentSize * 2);
+            m_overflowed = false;
+        }
+
+        m_frame = (m_frame + 1) % FramesInFlight;
+        waitFence(m_frame);
+        m_head = 0;
+        m_flushed = 0;
+    }
+
+    auto endFrame() -> void
+    {
+        flush();
+        m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /**
+     * Reserve size bytes for the current frame. Returns std::nullopt when the segment is full, the ring is then
+     * grown at the next beginFrame().
+     */
+    [[nodiscard]] auto allocate(const GLsizeiptr size) -> std::optional<RingAllocation>
+    {
+        const GLintptr offset = (m_head + m_alignment - 1) / m_alignment * m_alignment;
+        if (offset + size > m_segmentSize)
+        {
+            m_overflowed = true;
+            return std::nullopt;
+        }
+
+        m_head = offset + size;
+        return RingAllocation{.offset = offset, .size = size};
+    }
+
+    template<class T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] auto push(const std::span<const T> values) -> std::optional<RingAllocation>
+    {
+        const auto allocation = allocate(static_cast<GLsizeiptr>(values.size_bytes()));
+        if (allocation)
+            std::memcpy(data(*allocation), values.data(), values.size_bytes());
+        return allocation;
+    }
+
+    template<class T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] auto push(const T & value) -> std::optional<RingAllocation>
+    {
+        return push(std::span<const T>(&value, 1));
+    }
+
+    [[nodiscard]] auto data(const RingAllocation & allocation) -> std::byte *
+    {
+        return m_staging.data() + allocation.offset;
+    }
+
+    /**
+     * Upload everything allocated since the previous flush.
+     */
+    auto flush() -> void
+    {
+        if (m_head == m_flushed)
+            return;
+
+        const GLsizeiptr length = m_head - m_flushed;
+
+        m_stateCache->bindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        auto * mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, segmentOffset() + m_flushed, length,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped != nullptr)
+        {
+            std::memcpy(mapped, m_staging.data() + m_flushed, length);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+
+        m_flushed = m_head;
+    }
+
+    [[nodiscard]] auto id() const -> GLuint { return m_buffer; }
+
+    /**
+     * Offset of an allocation of the current frame in the whole buffer, as expected by glBindBufferRange.
+     */
+    [[nodiscard]] auto bufferOffset(const RingAllocation & allocation) const -> GLintptr
+    {
+        return segmentOffset() + allocation.offset;
+    }
+};
@@ -0,0 +1,75 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+#include "GLFW/glfw3.h"
+
+// GL_KHR_parallel_shader_compile is not part of the generated loader
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+export module ParallelShaderCompile;
+import std;
+import OpenGL.Utility;
+
+using PFNGLMAXSHADERCOMPILERTHREADSKHRPROC = void (GLAD_API_PTR *)(GLuint count);
+
+bool parallelShaderCompile = false;
+
+/**
+ * Let the driver compile and link on its own threads when GL_KHR_parallel_shader_compile (or its ARB twin) is
+ * exposed. Must be called once the context is current. Without it, the completion queries below always report
+ * done and the status queries block as usual.
+ */
+export auto enableParallelShaderCompile() -> bool
+{
+    const char * function = nullptr;
+    if (OpenGL::hasExtension("GL_KHR_parallel_shader_compile"))
+        function = "glMaxShaderCompilerThreadsKHR";
+    else if (OpenGL::hasExtension("GL_ARB_parallel_shader_compile"))
+        function = "glMaxShaderCompilerThreadsARB";
+
+    if (function == nullptr)
+        return parallelShaderCompile = false;
+
+    const auto maxShaderCompilerThreads =
+            reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(glfwGetProcAddress(function));
+    if (maxShaderCompilerThreads != nullptr)
+        maxShaderCompilerThreads(0xFFFFFFFF); // Implementation defined number of threads
+
+    return parallelShaderCompile = true;
+}
+
+export auto isParallelShaderCompileEnabled() -> bool
+{
+    return parallelShaderCompile;
+}
+
+/**
+ * Never blocks, unlike GL_COMPILE_STATUS which waits for the compilation to finish.
+ */
+export auto isShaderCompileDone(const GLuint shader) -> bool
+{
+    if (!parallelShaderCompile)
+        return true;
+
+    GLint done = GL_TRUE;
+    glGetShaderiv(shader, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+/**
+ * Never blocks, unlike GL_LINK_STATUS which waits for the link to finish.
+ */
+export auto isProgramLinkDone(const GLuint program) -> bool
+{
+    if (!parallelShaderCompile)
+        return true;
+
+    GLint done = GL_TRUE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
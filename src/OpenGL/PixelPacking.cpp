@@ -0,0 +1,250 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+module OpenGL.PixelPacking;
+import std.compat;
+import Utility.Simd;
+
+namespace
+{
+    constexpr float MaxRgb9e5 = 65408.0f; // (2^9 - 1) / 2^9 * 2^16
+    constexpr float MaxFloat11 = 65024.0f; // 6 mantissa bits, largest exponent below infinity
+    constexpr float MaxFloat10 = 64512.0f; // 5 mantissa bits
+
+    /**
+     * 2^exponent, for biased exponents of normal floats.
+     */
+    auto exp2i(const UInt4 biasedExponent) -> Float4
+    {
+        return bitCast(shiftLeft<23>(biasedExponent));
+    }
+
+    /**
+     * Round to nearest even. Every case is computed and one is selected per lane.
+     */
+    auto floatToHalf(const Float4 value) -> UInt4
+    {
+        const UInt4 denormMagic = UInt4::broadcast(((127 - 15) + (23 - 10) + 1) << 23);
+
+        const UInt4 bits = bitCast(value);
+        const UInt4 sign = shiftRight<16>(bits) & UInt4::broadcast(0x8000u);
+        const UInt4 abs = bits & UInt4::broadcast(0x7fffffffu);
+
+        const UInt4 infNan = select(abs > UInt4::broadcast(0x7f800000u), UInt4::broadcast(0x7e00u),
+                                    UInt4::broadcast(0x7c00u));
+        const UInt4 denormal = bitCast(bitCast(abs) + bitCast(denormMagic)) - denormMagic;
+        const UInt4 normal = shiftRight<13>(abs + UInt4::broadcast(static_cast<uint32_t>(15 - 127) << 23)
+                                            + UInt4::broadcast(0xfffu) + (shiftRight<13>(abs) & UInt4::broadcast(1)));
+
+        const UInt4 half = select(abs > UInt4::broadcast(0x477fffffu), infNan,
+                                  select(abs < UInt4::broadcast(0x38800000u), denormal, normal));
+        return half | sign;
+    }
+
+    auto halfToFloat(const UInt4 half) -> Float4
+    {
+        const Float4 magic = exp2i(UInt4::broadcast(127 - 15 + 127));
+        const Float4 wasInfNan = exp2i(UInt4::broadcast(16 + 127));
+
+        const Float4 scaled = bitCast(shiftLeft<13>(half & UInt4::broadcast(0x7fffu))) * magic;
+        const UInt4 infNan = select(scaled >= wasInfNan, UInt4::broadcast(0x7f800000u), UInt4::broadcast(0));
+        return bitCast(bitCast(scaled) | infNan | shiftLeft<16>(half & UInt4::broadcast(0x8000u)));
+    }
+
+    /**
+     * Clamp to [0, max], NaN compares false and becomes 0.
+     */
+    auto clampPositive(const Float4 value, const float max) -> Float4
+    {
+        const Float4 zero = Float4::broadcast(0.0f);
+        return select(value > zero, min(value, Float4::broadcast(max)), zero);
+    }
+
+    /**
+     * Unsigned float with 5 exponent bits, as the top bits of a positive half.
+     */
+    template<int DroppedBits>
+    auto floatToSmallFloat(const Float4 value, const float max) -> UInt4
+    {
+        const UInt4 half = floatToHalf(clampPositive(value, max));
+        return shiftRight<DroppedBits>(half + UInt4::broadcast(1u << (DroppedBits - 1)));
+    }
+
+    template<int DroppedBits>
+    auto smallFloatToFloat(const UInt4 value) -> Float4
+    {
+        return halfToFloat(shiftLeft<DroppedBits>(value));
+    }
+
+    /**
+     * Call convert(in, out) on groups of 4 values or texels, of InSize and OutSize elements each. The last group goes
+     * through padded copies, so convert always reads and writes whole groups.
+     */
+    template<size_t InSize, size_t OutSize, class In, class Out, class Convert>
+    auto convertGroups(const std::span<const In> in, const std::span<Out> out, const size_t count,
+                       const Convert & convert) -> void
+    {
+        assert(in.size() >= count * InSize && out.size() >= count * OutSize);
+
+        const size_t whole = count / 4 * 4;
+        for (size_t i = 0; i < whole; i += 4)
+            convert(in.data() + i * InSize, out.data() + i * OutSize);
+
+        if (whole < count)
+        {
+            std::array<In, 4 * InSize> paddedIn{};
+            std::array<Out, 4 * OutSize> paddedOut;
+            std::copy_n(in.begin() + whole * InSize, (count - whole) * InSize, paddedIn.begin());
+            convert(paddedIn.data(), paddedOut.data());
+            std::copy_n(paddedOut.begin(), (count - whole) * OutSize, out.begin() + whole * OutSize);
+        }
+    }
+
+    template<class T>
+    auto as(const std::span<const std::byte> bytes) -> std::span<const T>
+    {
+        assert(reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) == 0);
+        return {reinterpret_cast<const T *>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    template<class T>
+    auto as(const std::span<std::byte> bytes) -> std::span<T>
+    {
+        assert(reinterpret_cast<uintptr_t>(bytes.data()) % alignof(T) == 0);
+        return {reinterpret_cast<T *>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+}
+
+namespace OpenGL
+{
+    auto packHalf(const std::span<const float> values, const std::span<uint16_t> out) -> void
+    {
+        convertGroups<1, 1>(values, out, values.size(), [](const float * in, uint16_t * halves)
+        {
+            floatToHalf(Float4::load(in)).storeUInt16(halves);
+        });
+    }
+
+    auto unpackHalf(const std::span<const uint16_t> values, const std::span<float> out) -> void
+    {
+        convertGroups<1, 1>(values, out, values.size(), [](const uint16_t * halves, float * floats)
+        {
+            halfToFloat(UInt4::loadUInt16(halves)).store(floats);
+        });
+    }
+
+    /**
+     * From the EXT_texture_shared_exponent reference encoder, with floor(log2) read from the exponent bits.
+     */
+    auto packRgb9e5(const std::span<const float> rgb, const std::span<uint32_t> out) -> void
+    {
+        convertGroups<3, 1>(rgb, out, rgb.size() / 3, [](const float * texels, uint32_t * packed)
+        {
+            const auto [red, green, blue] = loadTriplets(texels);
+            const Float4 r = clampPositive(red, MaxRgb9e5);
+            const Float4 g = clampPositive(green, MaxRgb9e5);
+            const Float4 b = clampPositive(blue, MaxRgb9e5);
+            const Float4 maxRgb = max(r, max(g, b));
+
+            // max(-16, floor(log2)) + 1 + 15, from the biased exponent
+            const UInt4 biased = shiftRight<23>(bitCast(maxRgb)) & UInt4::broadcast(0xffu);
+            UInt4 exponent = select(biased > UInt4::broadcast(127 - 16), biased - UInt4::broadcast(127 - 16),
+                                    UInt4::broadcast(0));
+
+            // The largest channel may round up to 2^9, which needs the next exponent
+            const Float4 half = Float4::broadcast(0.5f);
+            Float4 scale = exp2i(UInt4::broadcast(24 + 127) - exponent);
+            const Mask4 overflow = maxRgb * scale + half >= Float4::broadcast(512.0f);
+            exponent = select(overflow, exponent + UInt4::broadcast(1), exponent);
+            scale = select(overflow, scale * half, scale);
+
+            const UInt4 rm = truncate(r * scale + half);
+            const UInt4 gm = truncate(g * scale + half);
+            const UInt4 bm = truncate(b * scale + half);
+            (rm | shiftLeft<9>(gm) | shiftLeft<18>(bm) | shiftLeft<27>(exponent)).store(packed);
+        });
+    }
+
+    auto unpackRgb9e5(const std::span<const uint32_t> values, const std::span<float> rgb) -> void
+    {
+        convertGroups<1, 3>(values, rgb, values.size(), [](const uint32_t * packed, float * texels)
+        {
+            const UInt4 mantissaMask = UInt4::broadcast(0x1ffu);
+            const UInt4 value = UInt4::load(packed);
+            const Float4 scale = exp2i(shiftRight<27>(value) + UInt4::broadcast(127 - 15 - 9));
+            storeTriplets({toFloat(value & mantissaMask) * scale,
+                         toFloat(shiftRight<9>(value) & mantissaMask) * scale,
+                         toFloat(shiftRight<18>(value) & mantissaMask) * scale}, texels);
+        });
+    }
+
+    auto packR11g11b10f(const std::span<const float> rgb, const std::span<uint32_t> out) -> void
+    {
+        convertGroups<3, 1>(rgb, out, rgb.size() / 3, [](const float * texels, uint32_t * packed)
+        {
+            const auto [red, green, blue] = loadTriplets(texels);
+            const UInt4 r = floatToSmallFloat<4>(red, MaxFloat11);
+            const UInt4 g = floatToSmallFloat<4>(green, MaxFloat11);
+            const UInt4 b = floatToSmallFloat<5>(blue, MaxFloat10);
+            (r | shiftLeft<11>(g) | shiftLeft<22>(b)).store(packed);
+        });
+    }
+
+    auto unpackR11g11b10f(const std::span<const uint32_t> values, const std::span<float> rgb) -> void
+    {
+        convertGroups<1, 3>(values, rgb, values.size(), [](const uint32_t * packed, float * texels)
+        {
+            const UInt4 float11Mask = UInt4::broadcast(0x7ffu);
+            const UInt4 value = UInt4::load(packed);
+            storeTriplets({smallFloatToFloat<4>(value & float11Mask),
+                         smallFloatToFloat<4>(shiftRight<11>(value) & float11Mask),
+                         smallFloatToFloat<5>(shiftRight<22>(value))}, texels);
+        });
+    }
+
+    auto encodeRgb(const GLint internalFormat, const std::span<const float> rgb, const std::span<std::byte> out)
+        -> void
+    {
+        assert(out.size() >= rgb.size() / 3 * rgbEncoding(internalFormat).pixelSize);
+        switch (internalFormat)
+        {
+            case GL_RGB16F:
+                packHalf(rgb, as<uint16_t>(out));
+                break;
+            case GL_RGB9_E5:
+                packRgb9e5(rgb, as<uint32_t>(out));
+                break;
+            case GL_R11F_G11F_B10F:
+                packR11g11b10f(rgb, as<uint32_t>(out));
+                break;
+            default:
+                std::ranges::copy(std::as_bytes(rgb), out.begin());
+                break;
+        }
+    }
+
+    auto decodeRgb(const GLint internalFormat, const std::span<const std::byte> pixels, const std::span<float> rgb)
+        -> void
+    {
+        switch (internalFormat)
+        {
+            case GL_RGB16F:
+                unpackHalf(as<uint16_t>(pixels), rgb);
+                break;
+            case GL_RGB9_E5:
+                unpackRgb9e5(as<uint32_t>(pixels), rgb);
+                break;
+            case GL_R11F_G11F_B10F:
+                unpackR11g11b10f(as<uint32_t>(pixels), rgb);
+                break;
+            default:
+                std::ranges::copy(as<float>(pixels), rgb.begin());
+                break;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include "glad/gl.h"
+
+export module OpenGL.PixelPacking;
+import std.compat;
+
+export namespace OpenGL
+{
+    /**
+     * Client side layout of the texels of an internal format, as uploaded and as stored in the data cache.
+     */
+    struct PixelEncoding
+    {
+        GLenum format;
+        GLenum type;
+        uint32_t pixelSize;
+    };
+
+    /**
+     * Encoding of the RGB float formats: GL_RGB32F, GL_RGB16F, GL_RGB9_E5 and GL_R11F_G11F_B10F.
+     */
+    [[nodiscard]] constexpr auto rgbEncoding(const GLint internalFormat) -> PixelEncoding
+    {
+        switch (internalFormat)
+        {
+            case GL_RGB16F:
+                return {GL_RGB, GL_HALF_FLOAT, 3 * sizeof(uint16_t)};
+            case GL_RGB9_E5:
+                return {GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, sizeof(uint32_t)};
+            case GL_R11F_G11F_B10F:
+                return {GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, sizeof(uint32_t)};
+            default:
+                assert(internalFormat == GL_RGB32F && "Unsupported internal format");
+                return {GL_RGB, GL_FLOAT, 3 * sizeof(float)};
+        }
+    }
+
+    /**
+     * Conversions between floats and the packed formats, on whole spans, 4 values or texels per instruction. Packing
+     * rounds to nearest, and clamps to the range of the format: negative values and NaNs become 0 in the unsigned
+     * formats.
+     */
+    auto packHalf(std::span<const float> values, std::span<uint16_t> out) -> void;
+
+    auto unpackHalf(std::span<const uint16_t> values, std::span<float> out) -> void;
+
+    auto packRgb9e5(std::span<const float> rgb, std::span<uint32_t> out) -> void;
+
+    auto unpackRgb9e5(std::span<const uint32_t> values, std::span<float> rgb) -> void;
+
+    auto packR11g11b10f(std::span<const float> rgb, std::span<uint32_t> out) -> void;
+
+    auto unpackR11g11b10f(std::span<const uint32_t> values, std::span<float> rgb) -> void;
+
+    /**
+     * Pack RGB float texels to the encoding of internalFormat, out holds rgbEncoding(internalFormat).pixelSize
+     * bytes per texel.
+     */
+    auto encodeRgb(GLint internalFormat, std::span<const float> rgb, std::span<std::byte> out) -> void;
+
+    auto decodeRgb(GLint internalFormat, std::span<const std::byte> pixels, std::span<float> rgb) -> void;
+}
@@ -8,6 +8,7 @@ module;
 
 export module Shader;
 import std;
+import ParallelShaderCompile;
 import ShaderFile;
 import ShaderFlags;
 import Utility.SlotSet;
@@ -72,7 +73,11 @@ public:
     [[nodiscard]] auto type() const -> GLenum { return m_type; }
     [[nodiscard]] auto id() const -> GLuint { return m_id; }
 
-    [[nodiscard]] auto update(const ShaderFile & file) -> std::expected<void, std::string>
+    /**
+     * Start compiling the code of file for the flags of this shader. The driver may compile in the background, see
+     * isCompileDone() and compileResult().
+     */
+    [[nodiscard]] auto submit(const ShaderFile & file) -> std::expected<void, std::string>
     {
         assert(file.index == m_fileIdx && "Unexpected shader file");
 
@@ -88,6 +93,16 @@ public:
         glShaderSource(m_id, 1, &codePtr, &length);
         glCompileShader(m_id);
 
+        return {};
+    }
+
+    [[nodiscard]] auto isCompileDone() const -> bool { return isShaderCompileDone(m_id); }
+
+    /**
+     * Blocks until the compilation submitted last is done.
+     */
+    [[nodiscard]] auto compileResult() const -> std::expected<void, std::string>
+    {
         int success;
         glGetShaderiv(m_id, GL_COMPILE_STATUS, &success);
         if (!success)
@@ -87,6 +87,8 @@ public:
             defines += "#define HAS_EMISSIVEMAP\n";
         if ((flags & ShaderFlags::HasSkin) == ShaderFlags::HasSkin)
             defines += "#define HAS_SKIN\n";
+        if ((flags & ShaderFlags::HasVertexAnimation) == ShaderFlags::HasVertexAnimation)
+            defines += "#define HAS_VERTEX_ANIMATION\n";
 
         auto copy = m_code;
         copy.insert(afterVersionIndex, defines);
@@ -12,6 +12,7 @@ export enum class ShaderFlags : unsigned char
     HasNormalMap = 1 << 3,
     HasEmissiveMap = 1 << 4,
     HasSkin = 1 << 5,
+    HasVertexAnimation = 1 << 6,
 };
 
 export
@@ -4,15 +4,20 @@
 
 module;
 
+#include <cstdio>
 #include "glad/gl.h"
 
 export module ShaderManager;
 import std;
+import DataCache;
 import Shader;
 import ShaderProgram;
 import ShaderFile;
 import ShaderFlags;
+import Utility.FileWatcher;
+import Utility.Hash;
 import Utility.SlotSet;
+import Utility.StringUnorderedMap;
 
 export struct ShaderProgramDefinition
 {
@@ -23,6 +28,56 @@ export struct ShaderProgramDefinition
     ShaderFlags shaderFlags; // Unified, but can be split into two variables for vertex/fragment
 };
 
+export struct ProgramCacheStats
+{
+    std::size_t hits{0};
+    std::size_t misses{0};
+};
+
+struct ShaderKey
+{
+    GLenum type;
+    SlotSetIndex fileIdx;
+    ShaderFlags flags;
+
+    auto operator==(const ShaderKey & other) const -> bool = default;
+};
+
+struct ShaderProgramKey
+{
+    SlotSetIndex vertexShaderIdx;
+    SlotSetIndex fragmentShaderIdx;
+
+    auto operator==(const ShaderProgramKey & other) const -> bool = default;
+};
+
+struct ShaderKeyHash
+{
+    auto operator()(const ShaderKey & key) const -> std::size_t
+    {
+        const auto packed = static_cast<std::uint64_t>(key.type) << 40 |
+                            static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.fileIdx.value)) << 8 |
+                            static_cast<std::uint64_t>(key.flags);
+        return std::hash<std::uint64_t>{}(packed);
+    }
+
+    auto operator()(const ShaderProgramKey & key) const -> std::size_t
+    {
+        const auto packed = static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.vertexShaderIdx.value)) << 32 |
+                            static_cast<std::uint32_t>(key.fragmentShaderIdx.value);
+        return std::hash<std::uint64_t>{}(packed);
+    }
+};
+
+/**
+ * Program waiting for its shaders to compile, then for its own link.
+ */
+struct PendingProgram
+{
+    SlotSetIndex program;
+    std::optional<std::uint64_t> cacheKey; // Saved to the program cache once linked
+};
+
 export class ShaderManager
 {
 private:
@@ -30,6 +85,287 @@ private:
     SlotSet<Shader> m_shaders;
     SlotSet<ShaderFile> m_shaderFiles;
 
+    // Nothing is ever removed, indices stay valid
+    StringUnorderedMap<SlotSetIndex> m_shaderFilesByPath;
+    std::unordered_map<ShaderKey, SlotSetIndex, ShaderKeyHash> m_shadersByKey;
+    std::unordered_map<ShaderProgramKey, SlotSetIndex, ShaderKeyHash> m_shaderProgramsByShaders;
+
+    /**
+     * Only change the vertex shader, fragment shaders are shared by skinned, vertex animated and static meshes.
+     */
+    static inline const ShaderFlags VertexShaderFlags = ShaderFlags::HasSkin | ShaderFlags::HasVertexAnimation;
+
+    /**
+     * Material flags only change the fragment shader, a program without them is drawn while its variant is built.
+     */
+    static inline const ShaderFlags MaterialShaderFlags = ShaderFlags::HasBaseColorMap |
+                                                          ShaderFlags::HasMetalRoughnessMap |
+                                                          ShaderFlags::HasNormalMap | ShaderFlags::HasEmissiveMap;
+
+    ProgramCacheStats m_programCacheStats{};
+    std::string m_driverIdentity;
+
+    std::vector<SlotSetIndex> m_compilingShaders;
+    std::vector<PendingProgram> m_compilingPrograms;
+    std::vector<PendingProgram> m_linkingPrograms;
+    bool m_programsSwapped{false};
+
+    FileWatcher m_fileWatcher;
+    std::vector<SlotSetIndex> m_changedFiles; // Rebuilt once nothing is pending anymore
+
+    [[nodiscard]] static auto programCachePath(const std::uint64_t key) -> std::filesystem::path
+    {
+        return std::format(".cache/programs/{:016x}.program", key);
+    }
+
+    /**
+     * Binaries are only valid for the driver that produced them, which is part of the key.
+     */
+    [[nodiscard]] auto driverIdentity() -> const std::string &
+    {
+        if (m_driverIdentity.empty())
+        {
+            for (const GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            {
+                const auto * value = reinterpret_cast<const char *>(glGetString(name));
+                m_driverIdentity += value != nullptr ? value : "";
+                m_driverIdentity += '\n';
+            }
+        }
+        return m_driverIdentity;
+    }
+
+    [[nodiscard]] auto programCacheKey(const ShaderProgram & program) -> std::uint64_t
+    {
+        StableHash hash;
+        hash.add(driverIdentity());
+        for (const SlotSetIndex shaderIdx: {program.vertexShaderIdx(), program.fragmentShaderIdx()})
+        {
+            const Shader & shader = m_shaders[shaderIdx];
+            hash.add(shader.type());
+            hash.add(shader.flags());
+            hash.add(m_shaderFiles[shader.fileIdx()].createCodeForFlags(shader.flags()));
+        }
+        return hash.value();
+    }
+
+    /**
+     * Layout of a cached program: the binary format, then the binary itself.
+     */
+    [[nodiscard]] static auto loadCachedProgram(ShaderProgram & program, const std::uint64_t key) -> bool
+    {
+        const auto path = programCachePath(key);
+        const auto oe_result = DataCache::readFile(path);
+        if (!oe_result)
+        {
+            return false;
+        }
+
+        if (!oe_result->has_value())
+        {
+            std::println(stderr, "Failed to load program from {}: {}", path.c_str(), oe_result->error());
+            return false;
+        }
+
+        const auto & data = oe_result->value();
+        ProgramBinary binary;
+        if (data.size() <= sizeof(binary.format))
+        {
+            return false;
+        }
+
+        std::memcpy(&binary.format, data.data(), sizeof(binary.format));
+        binary.data.assign(data.begin() + sizeof(binary.format), data.end());
+
+        // Rejected after a driver update for example, the program is then linked from source and saved again
+        return program.loadBinary(binary);
+    }
+
+    static auto saveCachedProgram(const ShaderProgram & program, const std::uint64_t key) -> void
+    {
+        const auto binary = program.binary();
+        if (!binary)
+        {
+            return;
+        }
+
+        std::vector<std::byte> data(sizeof(binary->format) + binary->data.size());
+        std::memcpy(data.data(), &binary->format, sizeof(binary->format));
+        std::ranges::copy(binary->data, data.begin() + sizeof(binary->format));
+
+        if (const auto e_result = DataCache::writeFile(programCachePath(key), data); !e_result)
+        {
+            std::println(stderr, "Failed to save program: {}", e_result.error());
+        }
+    }
+
+    [[nodiscard]] auto isPending(const SlotSetIndex programIdx) const -> bool
+    {
+        const auto isProgram = [programIdx](const PendingProgram & pending) { return pending.program == programIdx; };
+        return std::ranges::any_of(m_compilingPrograms, isProgram) || std::ranges::any_of(m_linkingPrograms, isProgram);
+    }
+
+    [[nodiscard]] auto programName(const ShaderProgram & program) const -> std::string
+    {
+        return std::format("{} + {}",
+                           m_shaderFiles[m_shaders[program.vertexShaderIdx()].fileIdx()].path(),
+                           m_shaderFiles[m_shaders[program.fragmentShaderIdx()].fileIdx()].path());
+    }
+
+    auto poll() -> void
+    {
+        if (!m_compilingPrograms.empty())
+        {
+            submitLinks();
+        }
+
+        std::erase_if(m_linkingPrograms, [this](const PendingProgram & pending) {
+            ShaderProgram & program = m_shaderPrograms[pending.program];
+            if (!program.isLinkDone())
+            {
+                return false;
+            }
+
+            if (const auto && e_result = program.linkResult(); !e_result)
+            {
+                std::println(stderr, "Failed to link {}: {}", programName(program), e_result.error());
+                return true;
+            }
+
+            if (pending.cacheKey)
+            {
+                saveCachedProgram(program, *pending.cacheKey);
+            }
+            m_programsSwapped = true;
+            return true;
+        });
+    }
+
+    /**
+     * Restore each program matching predicate from the program cache, or submit its shaders to the driver and queue
+     * its link. Nothing must be pending.
+     */
+    template<class Predicate>
+    [[nodiscard]] auto submitPrograms(Predicate && predicate) -> std::expected<void, std::string>
+    {
+        assert(!hasPending() && "Programs are already being built");
+
+        GLint binaryFormatsCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatsCount);
+        const bool useProgramCache = binaryFormatsCount > 0;
+
+        for (ShaderProgram & program: m_shaderPrograms)
+        {
+            if (!predicate(std::as_const(program)))
+                continue;
+
+            std::optional<std::uint64_t> key;
+            if (useProgramCache)
+            {
+                key = programCacheKey(program);
+                if (loadCachedProgram(program, *key))
+                {
+                    m_programsSwapped = true;
+                    ++m_programCacheStats.hits;
+                    continue;
+                }
+            }
+
+            ++m_programCacheStats.misses;
+            m_compilingPrograms.push_back({program.index, key});
+            for (const SlotSetIndex shaderIdx: {program.vertexShaderIdx(), program.fragmentShaderIdx()})
+            {
+                if (!std::ranges::contains(m_compilingShaders, shaderIdx))
+                    m_compilingShaders.push_back(shaderIdx);
+            }
+        }
+
+        // Only the shaders of the programs missing from the cache are compiled, all at once so the driver can spread
+        // them on its threads
+        for (const SlotSetIndex shaderIdx: m_compilingShaders)
+        {
+            if (const auto && e_result = compile(m_shaders[shaderIdx]); !e_result)
+            {
+                m_compilingShaders.clear();
+                m_compilingPrograms.clear();
+                return e_result;
+            }
+        }
+
+        return {};
+    }
+
+    /**
+     * Read the changed files again and rebuild only the programs using them, without waiting.
+     */
+    auto reloadChangedFiles() -> void
+    {
+        // A file failing to read, being replaced for example, keeps its previous code
+        std::erase_if(m_changedFiles, [this](const SlotSetIndex fileIdx) {
+            if (const auto && e_result = m_shaderFiles[fileIdx].readCode(); !e_result)
+            {
+                std::println(stderr, "{}", e_result.error());
+                return true;
+            }
+            return false;
+        });
+
+        const auto usesChangedFile = [this](const ShaderProgram & program) {
+            return std::ranges::contains(m_changedFiles, m_shaders[program.vertexShaderIdx()].fileIdx()) ||
+                   std::ranges::contains(m_changedFiles, m_shaders[program.fragmentShaderIdx()].fileIdx());
+        };
+        if (const auto && e_result = submitPrograms(usesChangedFile); !e_result)
+        {
+            std::println(stderr, "{}", e_result.error());
+        }
+        m_changedFiles.clear();
+    }
+
+    /**
+     * Once every submitted shader compiled, start linking the programs whose shaders all succeeded.
+     */
+    auto submitLinks() -> void
+    {
+        if (!std::ranges::all_of(m_compilingShaders, [this](const SlotSetIndex shaderIdx) {
+            return m_shaders[shaderIdx].isCompileDone();
+        }))
+        {
+            return;
+        }
+
+        std::vector<SlotSetIndex> failedShaders;
+        for (const SlotSetIndex shaderIdx: m_compilingShaders)
+        {
+            const Shader & shader = m_shaders[shaderIdx];
+            if (const auto && e_result = shader.compileResult(); !e_result)
+            {
+                std::println(stderr, "Failed to compile {}: {}", m_shaderFiles[shader.fileIdx()].path(),
+                             e_result.error());
+                failedShaders.push_back(shaderIdx);
+            }
+        }
+        m_compilingShaders.clear();
+
+        for (const PendingProgram & pending: m_compilingPrograms)
+        {
+            ShaderProgram & program = m_shaderPrograms[pending.program];
+            if (std::ranges::contains(failedShaders, program.vertexShaderIdx()) ||
+                std::ranges::contains(failedShaders, program.fragmentShaderIdx()))
+            {
+                continue;
+            }
+
+            if (const auto && e_result = program.submitLink(m_shaders[program.vertexShaderIdx()],
+                                                            m_shaders[program.fragmentShaderIdx()]); !e_result)
+            {
+                std::println(stderr, "Failed to link {}: {}", programName(program), e_result.error());
+                continue;
+            }
+            m_linkingPrograms.push_back(pending);
+        }
+        m_compilingPrograms.clear();
+    }
+
 public:
     [[nodiscard]] auto addShaderFile(const std::string_view & path)
         -> std::expected<SlotSetIndex, std::string>
@@ -40,7 +376,10 @@ public:
             return std::unexpected(std::move(e_result).error());
         }
 
-        return {m_shaderFiles.emplace(std::move(shaderFile)).index};
+        m_fileWatcher.watch(path);
+        const SlotSetIndex index = m_shaderFiles.emplace(std::move(shaderFile)).index;
+        m_shaderFilesByPath.emplace(path, index);
+        return index;
     }
 
     [[nodiscard]] auto createShader(const GLenum type, const SlotSetIndex fileIdx, const ShaderFlags flags)
@@ -54,7 +393,9 @@ public:
             return std::unexpected(std::move(e_shader).error());
         }
 
-        return {m_shaders.emplace(std::move(e_shader).value()).index};
+        const SlotSetIndex index = m_shaders.emplace(std::move(e_shader).value()).index;
+        m_shadersByKey.emplace(ShaderKey{type, fileIdx, flags}, index);
+        return index;
     }
 
     [[nodiscard]] auto createShaderProgram(const SlotSetIndex vertexShaderIdx, const SlotSetIndex fragmentShaderIdx)
@@ -69,18 +410,17 @@ public:
             return std::unexpected(std::move(e_shaderProgram).error());
         }
 
-        return {m_shaderPrograms.emplace(std::move(e_shaderProgram).value()).index};
+        const SlotSetIndex index = m_shaderPrograms.emplace(std::move(e_shaderProgram).value()).index;
+        m_shaderProgramsByShaders.emplace(ShaderProgramKey{vertexShaderIdx, fragmentShaderIdx}, index);
+        return index;
     }
 
     [[nodiscard]] auto getOrAddShaderFile(const std::string_view & path)
         -> std::expected<SlotSetIndex, std::string>
     {
-        for (const auto & shaderFile: m_shaderFiles)
+        if (const auto it = m_shaderFilesByPath.find(path); it != m_shaderFilesByPath.end())
         {
-            if (shaderFile.path() == path)
-            {
-                return shaderFile.index;
-            }
+            return it->second;
         }
         return addShaderFile(path);
     }
@@ -90,12 +430,9 @@ public:
     {
         assert(fileIdx.isValid() && "file index is invalid");
 
-        for (const auto & shader: m_shaders)
+        if (const auto it = m_shadersByKey.find({type, fileIdx, flags}); it != m_shadersByKey.end())
         {
-            if (shader.type() == type && shader.fileIdx() == fileIdx && shader.flags() == flags)
-            {
-                return shader.index;
-            }
+            return it->second;
         }
         return createShader(type, fileIdx, flags);
     }
@@ -107,12 +444,10 @@ public:
         assert(vertexShaderIdx.isValid() && "vertex shader index is invalid");
         assert(fragmentShaderIdx.isValid() && "fragment shader index is invalid");
 
-        for (const auto & program: m_shaderPrograms)
+        if (const auto it = m_shaderProgramsByShaders.find({vertexShaderIdx, fragmentShaderIdx});
+            it != m_shaderProgramsByShaders.end())
         {
-            if (program.vertexShaderIdx() == vertexShaderIdx && program.fragmentShaderIdx() == fragmentShaderIdx)
-            {
-                return program.index;
-            }
+            return it->second;
         }
         return createShaderProgram(vertexShaderIdx, fragmentShaderIdx);
     }
@@ -124,7 +459,7 @@ public:
     {
         const auto e_vertexResult = getOrCreateShader(GL_VERTEX_SHADER,
                                                       vertexShaderFileIdx,
-                                                      shaderFlags & ShaderFlags::HasSkin);
+                                                      shaderFlags & VertexShaderFlags);
         if (!e_vertexResult)
         {
             return std::move(e_vertexResult);
@@ -132,17 +467,41 @@ public:
 
         const auto e_fragmentResult = getOrCreateShader(GL_FRAGMENT_SHADER,
                                                         fragmentShaderFileIdx,
-                                                        shaderFlags & ~ShaderFlags::HasSkin);
+                                                        shaderFlags & ~VertexShaderFlags);
         if (!e_fragmentResult)
         {
             return std::move(e_fragmentResult);
         }
 
-        return getOrCreateShaderProgram(*e_vertexResult, *e_fragmentResult);
+        const auto e_programResult = getOrCreateShaderProgram(*e_vertexResult, *e_fragmentResult);
+        if (!e_programResult || (shaderFlags & MaterialShaderFlags) == ShaderFlags::None)
+        {
+            return e_programResult;
+        }
+
+        const auto e_fallbackResult = getOrCreateShaderProgram(vertexShaderFileIdx,
+                                                               fragmentShaderFileIdx,
+                                                               shaderFlags & ~MaterialShaderFlags);
+        if (!e_fallbackResult)
+        {
+            return std::move(e_fallbackResult);
+        }
+
+        m_shaderPrograms[*e_programResult].setFallbackIdx(*e_fallbackResult);
+        return e_programResult;
     }
 
+    /**
+     * Read every shader file again, then restore each program from the program cache or submit its shaders and link
+     * to the driver. Programs are keyed by their expanded sources, so edited shaders miss the cache and are rebuilt.
+     * Only programs that were never linked and have no fallback are waited for, the others are swapped in by update()
+     * once ready and keep rendering with their previous program meanwhile.
+     */
     [[nodiscard]] auto reloadAllShaders() -> std::expected<void, std::string>
     {
+        waitPending();
+        m_changedFiles.clear();
+
         for (ShaderFile & shaderFile: m_shaderFiles)
         {
             if (const auto && e_result = shaderFile.readCode(); !e_result)
@@ -151,29 +510,90 @@ public:
             }
         }
 
-        for (Shader & shader: m_shaders)
+        m_programCacheStats = {};
+
+        if (const auto && e_result = submitPrograms([](const ShaderProgram &) { return true; }); !e_result)
         {
-            if (const auto && e_result = compile(shader); !e_result)
-            {
-                return e_result;
-            }
+            return e_result;
         }
 
-        for (ShaderProgram & program: m_shaderPrograms)
+        // Programs without anything to draw with meanwhile, like the fallbacks themselves
+        std::vector<SlotSetIndex> requiredPrograms;
+        for (const PendingProgram & pending: m_compilingPrograms)
         {
-            if (const auto && e_result = link(program); !e_result)
+            const ShaderProgram & program = m_shaderPrograms[pending.program];
+            if (!program.isReady() && !program.fallbackIdx().isValid())
+                requiredPrograms.push_back(pending.program);
+        }
+
+        while (std::ranges::any_of(requiredPrograms, [this](const SlotSetIndex programIdx) {
+            return isPending(programIdx);
+        }))
+        {
+            poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (const SlotSetIndex programIdx: requiredPrograms)
+        {
+            if (!m_shaderPrograms[programIdx].isReady())
             {
-                return e_result;
+                return std::unexpected(std::format("Failed to build {}", programName(m_shaderPrograms[programIdx])));
             }
         }
 
         return {};
     }
 
+    /**
+     * Rebuild the programs using shader files changed on disk, poll the shaders and programs submitted without
+     * blocking, and swap in the programs that finished linking. A program that fails to compile or link keeps its
+     * previous version. Returns whether any program changed since the last call, a cached current program id is then
+     * stale.
+     */
+    auto update() -> bool
+    {
+        for (const std::string & path: m_fileWatcher.poll())
+        {
+            const auto it = m_shaderFilesByPath.find(path);
+            if (it != m_shaderFilesByPath.end() && !std::ranges::contains(m_changedFiles, it->second))
+                m_changedFiles.push_back(it->second);
+        }
+
+        if (!m_changedFiles.empty() && !hasPending())
+        {
+            reloadChangedFiles();
+        }
+
+        poll();
+        return std::exchange(m_programsSwapped, false);
+    }
+
+    [[nodiscard]] auto hasPending() const -> bool
+    {
+        return !m_compilingPrograms.empty() || !m_linkingPrograms.empty();
+    }
+
+    /**
+     * Block until everything submitted is built.
+     */
+    auto waitPending() -> void
+    {
+        for (poll(); hasPending(); poll())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /**
+     * Counters since the last reloadAllShaders(), including the rebuilds of changed files.
+     */
+    [[nodiscard]] auto programCacheStats() const -> const ProgramCacheStats & { return m_programCacheStats; }
+
     [[nodiscard]] auto compile(Shader & shader) const -> std::expected<void, std::string>
     {
         const ShaderFile & shaderFile = m_shaderFiles[shader.fileIdx()];
-        return shader.update(shaderFile);
+        return shader.submit(shaderFile);
     }
 
     [[nodiscard]] auto link(ShaderProgram & shaderProgram) const -> std::expected<void, std::string>
@@ -195,6 +615,24 @@ public:
         return m_shaderPrograms[index];
     }
 
+    /**
+     * The program if linked, otherwise its fallback if linked, otherwise nullptr.
+     */
+    [[nodiscard]] auto getReadyProgram(const SlotSetIndex index) -> ShaderProgram *
+    {
+        ShaderProgram & program = getProgram(index);
+        if (program.isReady())
+        {
+            return &program;
+        }
+
+        if (program.fallbackIdx().isValid() && m_shaderPrograms[program.fallbackIdx()].isReady())
+        {
+            return &m_shaderPrograms[program.fallbackIdx()];
+        }
+        return nullptr;
+    }
+
     [[nodiscard]] auto getPrograms() -> SlotSet<ShaderProgram> &
     {
         return m_shaderPrograms;
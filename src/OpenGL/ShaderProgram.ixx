@@ -4,17 +4,23 @@
 
 module;
 
-#include <version>
-
 #include "glad/gl.h"
 
 export module ShaderProgram;
 import std;
 import glm;
+import ParallelShaderCompile;
 import Shader;
+import UniformBlockBinding;
+import UniformId;
 import UniformValue;
 import Utility.SlotSet;
-import Utility.StringUnorderedMap;
+
+export struct ProgramBinary
+{
+    GLenum format{0};
+    std::vector<std::byte> data;
+};
 
 export class ShaderProgram
 {
@@ -22,38 +28,100 @@ public:
     SlotSetIndex index;
 
 private:
-    StringUnorderedMap<UniformValue> m_uniformCache;
+    std::vector<UniformValue> m_uniforms; // Indexed by UniformId, ids past the end are not active
     SlotSetIndex m_vertexShaderIdx;
     SlotSetIndex m_fragmentShaderIdx;
-    GLint m_id;
+    SlotSetIndex m_fallbackIdx;
+    GLuint m_id{0}; // Last successfully linked program, 0 until the first link is done
+    GLuint m_pendingId{0}; // Program being linked, replaces m_id once linked successfully
 
-public:
-    [[nodiscard]] static auto Create(const Shader & vertexShader,
-                                     const Shader & fragmentShader) -> std::expected<ShaderProgram, std::string>
+    /**
+     * Build the uniform slots of the active uniforms. Arrays are found by their name without the subscript, and
+     * members of uniform blocks, which have no location, are skipped.
+     */
+    auto reflectUniforms() -> void
     {
-        const GLuint id = glCreateProgram();
-        if (id == 0)
+        m_uniforms.clear();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::string name(maxLength, '\0');
+        for (GLint i = 0; i < count; ++i)
         {
-            return std::unexpected("Failed to create new program");
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(m_id, i, maxLength, &length, &size, &type, name.data());
+
+            const GLint location = glGetUniformLocation(m_id, name.c_str());
+            if (location < 0)
+                continue;
+
+            std::string_view uniformName(name.data(), length);
+            if (uniformName.ends_with("[0]"))
+                uniformName.remove_suffix(3);
+
+            const UniformId id(uniformName);
+            if (id.value() >= m_uniforms.size())
+                m_uniforms.resize(id.value() + 1);
+            m_uniforms[id.value()] = UniformValue(location);
+        }
+    }
+
+    auto onLinked() -> void
+    {
+        reflectUniforms();
+
+        for (const auto & [name, binding]: uniformBlockBindings)
+        {
+            setUniformBlock(name, static_cast<GLuint>(binding));
         }
+    }
 
-        glAttachShader(id, vertexShader.id());
-        glAttachShader(id, fragmentShader.id());
+    /**
+     * Swap the pending program in if it linked, otherwise drop it and keep the previous one.
+     */
+    auto resolvePending() -> bool
+    {
+        int success;
+        glGetProgramiv(m_pendingId, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(std::exchange(m_pendingId, 0));
+            return false;
+        }
 
-        return std::expected<ShaderProgram, std::string>{std::in_place, vertexShader.index, fragmentShader.index, id};
+        glDeleteProgram(std::exchange(m_id, std::exchange(m_pendingId, 0)));
+        onLinked();
+        return true;
     }
 
-    explicit ShaderProgram(const SlotSetIndex vertexShaderIdx, const SlotSetIndex fragmentShaderIdx, const GLint id)
-        : m_vertexShaderIdx(vertexShaderIdx), m_fragmentShaderIdx(fragmentShaderIdx), m_id(id)
+public:
+    /**
+     * The program is linked later, with submitLink() or loadBinary().
+     */
+    [[nodiscard]] static auto Create(const Shader & vertexShader,
+                                     const Shader & fragmentShader) -> std::expected<ShaderProgram, std::string>
+    {
+        return std::expected<ShaderProgram, std::string>{std::in_place, vertexShader.index, fragmentShader.index};
+    }
+
+    explicit ShaderProgram(const SlotSetIndex vertexShaderIdx, const SlotSetIndex fragmentShaderIdx)
+        : m_vertexShaderIdx(vertexShaderIdx), m_fragmentShaderIdx(fragmentShaderIdx)
     {}
 
     ShaderProgram(ShaderProgram && other) noexcept : index(std::exchange(other.index, {})),
-                                                     m_uniformCache(std::exchange(other.m_uniformCache, {})),
+                                                     m_uniforms(std::exchange(other.m_uniforms, {})),
                                                      m_vertexShaderIdx(
                                                          std::exchange(other.m_vertexShaderIdx, {})),
                                                      m_fragmentShaderIdx(
                                                          std::exchange(other.m_fragmentShaderIdx, {})),
-                                                     m_id(std::exchange(other.m_id, {}))
+                                                     m_fallbackIdx(std::exchange(other.m_fallbackIdx, {})),
+                                                     m_id(std::exchange(other.m_id, 0)),
+                                                     m_pendingId(std::exchange(other.m_pendingId, 0))
     {}
 
     ShaderProgram(const ShaderProgram &) = delete;
@@ -63,15 +131,18 @@ public:
     ShaderProgram & operator=(ShaderProgram && other) noexcept
     {
         std::swap(index, other.index);
-        std::swap(m_uniformCache, other.m_uniformCache);
+        std::swap(m_uniforms, other.m_uniforms);
         std::swap(m_vertexShaderIdx, other.m_vertexShaderIdx);
         std::swap(m_fragmentShaderIdx, other.m_fragmentShaderIdx);
+        std::swap(m_fallbackIdx, other.m_fallbackIdx);
         std::swap(m_id, other.m_id);
+        std::swap(m_pendingId, other.m_pendingId);
         return *this;
     }
 
     ~ShaderProgram()
     {
+        glDeleteProgram(m_pendingId);
         glDeleteProgram(m_id);
     }
 
@@ -79,84 +150,157 @@ public:
     [[nodiscard]] auto fragmentShaderIdx() const -> SlotSetIndex { return m_fragmentShaderIdx; }
     [[nodiscard]] auto id() const -> GLuint { return m_id; }
 
-    [[nodiscard]] auto link(const Shader & vertexShader,
-                            const Shader & fragmentShader) -> std::expected<void, std::string>
+    /**
+     * Program drawn with while this one is not linked yet, usually a variant without any material map.
+     */
+    [[nodiscard]] auto fallbackIdx() const -> SlotSetIndex { return m_fallbackIdx; }
+
+    auto setFallbackIdx(const SlotSetIndex fallbackIdx) -> void { m_fallbackIdx = fallbackIdx; }
+
+    /**
+     * Linked at least once, a relink in progress keeps using the previous program.
+     */
+    [[nodiscard]] auto isReady() const -> bool { return m_id != 0; }
+
+    [[nodiscard]] auto isLinkPending() const -> bool { return m_pendingId != 0; }
+
+    [[nodiscard]] auto isLinkDone() const -> bool { return !isLinkPending() || isProgramLinkDone(m_pendingId); }
+
+    /**
+     * Start linking compiled shaders in a new program, the driver may link in the background. The current program
+     * stays in use until linkResult().
+     */
+    [[nodiscard]] auto submitLink(const Shader & vertexShader,
+                                  const Shader & fragmentShader) -> std::expected<void, std::string>
     {
         assert(vertexShader.index == m_vertexShaderIdx && "Unexpected vertex shader");
         assert(fragmentShader.index == m_fragmentShaderIdx && "Unexpected fragment shader");
 
-        int success;
+        glDeleteProgram(m_pendingId);
+        m_pendingId = glCreateProgram();
+        if (m_pendingId == 0)
+        {
+            return std::unexpected("Failed to create new program");
+        }
 
-        glLinkProgram(m_id);
-        glGetProgramiv(m_id, GL_LINK_STATUS, &success);
-        if (!success)
+        glAttachShader(m_pendingId, vertexShader.id());
+        glAttachShader(m_pendingId, fragmentShader.id());
+        glProgramParameteri(m_pendingId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(m_pendingId);
+
+        return {};
+    }
+
+    /**
+     * Blocks until the link submitted last is done. On failure the previous program, if any, is kept.
+     */
+    [[nodiscard]] auto linkResult() -> std::expected<void, std::string>
+    {
+        assert(isLinkPending() && "No link submitted");
+
+        char infoLog[1024];
+        GLsizei infoLength = 0;
+        glGetProgramInfoLog(m_pendingId, 1024, &infoLength, infoLog);
+
+        if (!resolvePending())
         {
-            char infoLog[1024];
-            GLsizei infoLength;
-            glGetProgramInfoLog(m_id, 1024, &infoLength, infoLog);
             return std::unexpected(std::string(infoLog, infoLength));
         }
 
-        for (auto & cache: m_uniformCache | std::views::values)
+        return {};
+    }
+
+    [[nodiscard]] auto link(const Shader & vertexShader,
+                            const Shader & fragmentShader) -> std::expected<void, std::string>
+    {
+        if (auto e_result = submitLink(vertexShader, fragmentShader); !e_result)
+        {
+            return e_result;
+        }
+        return linkResult();
+    }
+
+    /**
+     * Restore a binary returned by binary(), possibly during a previous run. Returns false when the driver rejects
+     * it, the program must then be linked from source.
+     */
+    [[nodiscard]] auto loadBinary(const ProgramBinary & binary) -> bool
+    {
+        glDeleteProgram(m_pendingId);
+        m_pendingId = glCreateProgram();
+        if (m_pendingId == 0)
         {
-            cache.invalidateLocation();
+            return false;
         }
 
-        return {};
+        glProgramBinary(m_pendingId, binary.format, binary.data.data(), static_cast<GLsizei>(binary.data.size()));
+        return resolvePending();
     }
 
-    auto setBool(const std::string_view & name, const GLboolean value) -> void
+    [[nodiscard]] auto binary() const -> std::optional<ProgramBinary>
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        GLint length = 0;
+        glGetProgramiv(m_id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+        {
+            return std::nullopt;
+        }
+
+        ProgramBinary binary;
+        binary.data.resize(length);
+        glGetProgramBinary(m_id, length, &length, &binary.format, binary.data.data());
+        binary.data.resize(length);
+        return binary;
     }
 
-    auto setInt(const std::string_view & name, const GLint value) -> void
+    auto setBool(const UniformId id, const GLboolean value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setUint(const std::string_view & name, const GLuint value) -> void
+    auto setInt(const UniformId id, const GLint value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setFloat(const std::string_view & name, const GLfloat value) -> void
+    auto setUint(const UniformId id, const GLuint value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setVec3(const std::string_view & name, const glm::vec3 value) -> void
+    auto setFloat(const UniformId id, const GLfloat value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setVec4(const std::string_view & name, const glm::vec4 value) -> void
+    auto setVec3(const UniformId id, const glm::vec3 value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setMat4(const std::string_view & name, const glm::mat4 & value) -> void
+    auto setVec4(const UniformId id, const glm::vec4 value) -> void
     {
-        getOrCreateUniformCache(name).set(m_id, value);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-    auto setUniformBlock(const std::string_view & name, const GLuint uniformBlockBinding) -> void
+    auto setMat4(const UniformId id, const glm::mat4 & value) -> void
     {
-        glUniformBlockBinding(m_id, glGetUniformBlockIndex(m_id, name.data()), uniformBlockBinding);
+        if (id.value() < m_uniforms.size())
+            m_uniforms[id.value()].set(value);
     }
 
-private:
-    auto getOrCreateUniformCache(const std::string_view & name) -> UniformValue &
+    auto setUniformBlock(const std::string_view & name, const GLuint uniformBlockBinding) -> void
     {
-#if __cpp_lib_associative_heterogeneous_insertion
-        return m_uniformCache.try_emplace(name, name).first->second;
-#else
-        const auto it = m_uniformCache.find(name);
-        if (it == m_uniformCache.end())
+        const GLuint blockIndex = glGetUniformBlockIndex(m_id, name.data());
+        if (blockIndex != GL_INVALID_INDEX)
         {
-            return m_uniformCache.try_emplace(std::string(name), name).first->second;
+            glUniformBlockBinding(m_id, blockIndex, uniformBlockBinding);
         }
-        return it->second;
-#endif
     }
 };
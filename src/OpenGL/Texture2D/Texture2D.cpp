@@ -25,15 +25,7 @@ namespace OpenGL
             return std::unexpected<std::string>("Failed to generate texture");
         }
 
-        if (m_stateCache->setActiveTexture(0))
-        {
-            glActiveTexture(GL_TEXTURE0);
-        }
-
-        if (m_stateCache->setBoundTexture(id))
-        {
-            glBindTexture(GL_TEXTURE_2D, id);
-        }
+        m_stateCache->bindTexture(0, GL_TEXTURE_2D, id);
 
         // if (m_debugLabel != nullptr)
         // {
@@ -61,7 +53,7 @@ namespace OpenGL
 
     auto Texture2D::fromCache(const std::filesystem::path & path, const GLenum format, const GLenum type) -> bool
     {
-        const auto oe_result = DataCache::readFile(path);
+        const auto oe_result = DataCache::mapFile(path);
 
         if (!oe_result)
         {
@@ -74,16 +66,18 @@ namespace OpenGL
             return false;
         }
 
+        const auto pixels = oe_result->value().data();
+
         const uint32_t pixelSize = formatComponentsCount(format) * typeSize(type);
         const uint32_t saveSize = width() * height() * pixelSize;
 
-        if (oe_result->value().size() != saveSize)
+        if (pixels.size() != saveSize)
         {
-            std::println(stderr, "Failed to load texture from {}: unexpected size", path.c_str(), oe_result->value().size());
+            std::println(stderr, "Failed to load texture from {}: unexpected size", path.c_str(), pixels.size());
             return false;
         }
 
-        fromRaw(format, type, oe_result->value().data()); // TODO maybe return result of from data
+        fromRaw(format, type, pixels.data()); // TODO maybe return result of from data
         return true;
     }
 
@@ -94,7 +88,7 @@ namespace OpenGL
         const uint32_t saveSize = width() * height() * pixelSize;
 
         std::vector<std::byte> pixels(saveSize);
-        glBindTexture(GL_TEXTURE_2D, m_id);
+        m_stateCache->bindTexture(GL_TEXTURE_2D, m_id);
         glGetTexImage(GL_TEXTURE_2D, 0, format, type, pixels.data());
 
         TRY(DataCache::writeFile(path, pixels));
@@ -103,7 +97,7 @@ namespace OpenGL
 
     auto Texture2D::fromRaw(const GLenum format, const GLenum type, const void * const pixels) -> void
     {
-        glBindTexture(GL_TEXTURE_2D, m_id);
+        m_stateCache->bindTexture(GL_TEXTURE_2D, m_id);
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, format, type, pixels);
     }
 
@@ -111,15 +105,14 @@ namespace OpenGL
     {
         GLuint captureFBO;
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_id);
+        m_stateCache->bindTexture(0, GL_TEXTURE_2D, m_id);
 
-        glDisable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, false);
         glGenFramebuffers(1, &captureFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-        glViewport(0, 0, m_width, m_height);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+        m_stateCache->viewport(0, 0, m_width, m_height);
 
-        glUseProgram(converter.id()); // Bad way to use
+        m_stateCache->useProgram(converter.id());
 
         glFramebufferTexture2D(GL_FRAMEBUFFER,
                                GL_COLOR_ATTACHMENT0,
@@ -127,11 +120,11 @@ namespace OpenGL
                                m_id,
                                0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        renderQuad();
+        renderQuad(*m_stateCache);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        m_stateCache->bindFramebuffer(GL_FRAMEBUFFER, 0);
         glDeleteFramebuffers(1, &captureFBO);
-        glEnable(GL_DEPTH_TEST);
+        m_stateCache->setEnabled(GL_DEPTH_TEST, true);
 
         return {};
     }
@@ -63,7 +63,7 @@ export namespace OpenGL
             if (m_id != 0)
             {
                 glDeleteTextures(1, &m_id);
-                m_stateCache->invalidateBoundTexturesCache();
+                m_stateCache->invalidateTexture(m_id);
                 m_id = 0;
             }
         }
@@ -82,12 +82,12 @@ export namespace OpenGL
             return std::unexpected<std::string>("a");
         }
 
+        /**
+         * unit is an index, not GL_TEXTURE0 + index.
+         */
         auto bind(const GLuint unit) const -> void
         {
-            if (m_stateCache->setActiveTexture(unit))
-                glActiveTexture(unit);
-            if (m_stateCache->setBoundTexture(m_id))
-                glBindTexture(GL_TEXTURE_2D, m_id);
+            m_stateCache->bindTexture(unit, GL_TEXTURE_2D, m_id);
         }
 
         [[nodiscard]]
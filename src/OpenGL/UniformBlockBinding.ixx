@@ -0,0 +1,31 @@
+//
+// Created by Simon Cros on 3/9/26.
+//
+
+export module UniformBlockBinding;
+import std;
+
+/**
+ * Binding points of the uniform blocks shared by every program.
+ */
+export enum class UniformBlockBinding : unsigned int
+{
+    DrawData = 0,
+    JointMatrices = 1,
+    FrameData = 2,
+};
+
+export struct UniformBlockBindingEntry
+{
+    std::string_view name;
+    UniformBlockBinding binding;
+};
+
+/**
+ * Applied to every program when it is linked, blocks missing from a program are ignored.
+ */
+export constexpr UniformBlockBindingEntry uniformBlockBindings[] = {
+    {"DrawData", UniformBlockBinding::DrawData},
+    {"JointMatrices", UniformBlockBinding::JointMatrices},
+    {"FrameData", UniformBlockBinding::FrameData},
+};
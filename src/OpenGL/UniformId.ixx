@@ -0,0 +1,73 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module UniformId;
+import std;
+import Utility.StringUnorderedMap;
+
+/**
+ * Dense index of a uniform name, shared by every program. Programs store their uniforms in an array indexed by it, so
+ * setting a uniform never hashes its name. Names are interned once, ids of the uniforms set every frame are resolved
+ * at startup in the Uniform namespace below.
+ */
+export class UniformId
+{
+private:
+    std::uint32_t m_value;
+
+    [[nodiscard]] static auto registry() -> StringUnorderedMap<std::uint32_t> &
+    {
+        static StringUnorderedMap<std::uint32_t> registry;
+        return registry;
+    }
+
+public:
+    explicit UniformId(const std::string_view name)
+    {
+        auto & ids = registry();
+        const auto it = ids.find(name);
+        m_value = it != ids.end()
+                      ? it->second
+                      : ids.emplace(name, static_cast<std::uint32_t>(ids.size())).first->second;
+    }
+
+    [[nodiscard]] auto value() const -> std::uint32_t { return m_value; }
+
+    auto operator==(const UniformId & other) const -> bool = default;
+};
+
+export namespace Uniform
+{
+    inline const UniformId BaseColorFactor{"u_baseColorFactor"};
+    inline const UniformId BaseColorTexCoordIndex{"u_baseColorTexCoordIndex"};
+    inline const UniformId BaseColorTexture{"u_baseColorTexture"};
+    inline const UniformId BrdfLUT{"u_brdfLUT"};
+    inline const UniformId CameraPosition{"u_cameraPosition"};
+    inline const UniformId Cubemap{"u_cubemap"};
+    inline const UniformId EmissiveFactor{"u_emissiveFactor"};
+    inline const UniformId EmissiveMap{"u_emissiveMap"};
+    inline const UniformId EmissiveTexCoordIndex{"u_emissiveTexCoordIndex"};
+    inline const UniformId EquirectangularMap{"u_equirectangularMap"};
+    inline const UniformId Exposure{"u_exposure"};
+    inline const UniformId Hdr{"u_hdr"};
+    inline const UniformId Instances{"u_instances"};
+    inline const UniformId LightPosition{"u_lightPosition"};
+    inline const UniformId MetallicFactor{"u_metallicFactor"};
+    inline const UniformId MetallicRoughnessMap{"u_metallicRoughnessMap"};
+    inline const UniformId MetallicRoughnessTexCoordIndex{"u_metallicRoughnessTexCoordIndex"};
+    inline const UniformId NormalMap{"u_normalMap"};
+    inline const UniformId NormalScale{"u_normalScale"};
+    inline const UniformId NormalTexCoordIndex{"u_normalTexCoordIndex"};
+    inline const UniformId PrefilterMap{"u_prefilterMap"};
+    inline const UniformId ProjectionView{"u_projectionView"};
+    inline const UniformId Roughness{"u_roughness"};
+    inline const UniformId RoughnessFactor{"u_roughnessFactor"};
+    inline const UniformId Time{"u_time"};
+    inline const UniformId Transform{"u_transform"};
+    inline const UniformId VertexAnimation{"u_vertexAnimation"};
+    inline const UniformId VertexAnimationDuration{"u_vertexAnimationDuration"};
+    inline const UniformId VertexAnimationFrameCount{"u_vertexAnimationFrameCount"};
+    inline const UniformId VertexAnimationOffset{"u_vertexAnimationOffset"};
+    inline const UniformId VertexAnimationVertexCount{"u_vertexAnimationVertexCount"};
+}
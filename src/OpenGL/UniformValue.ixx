@@ -10,24 +10,21 @@ export module UniformValue;
 import std;
 import glm;
 
+/**
+ * Slot of an active uniform, found when the program is linked. Keeps the last value set to skip redundant calls.
+ */
 export class UniformValue
 {
 private:
-    static constexpr GLint Unset = -2;
     static constexpr GLint NotFound = -1;
 
-    std::string m_name;
     std::variant<std::monostate, GLboolean, GLfloat, GLint, GLuint, glm::vec2, glm::vec3, glm::vec4, glm::mat4> m_value;
     GLint m_location;
 
 public:
-    explicit UniformValue(const std::string_view & m_name) : m_name(m_name), m_location(Unset) {}
+    UniformValue() : m_location(NotFound) {}
 
-    auto invalidateLocation() -> void
-    {
-        m_location = Unset;
-        m_value = std::monostate{};
-    }
+    explicit UniformValue(const GLint location) : m_location(location) {}
 
     template<typename T>
     auto hasValue(const T & value) -> bool
@@ -35,8 +32,11 @@ public:
         return std::holds_alternative<T>(m_value) && std::get<T>(m_value) == value;
     }
 
+    /**
+     * Applies to the program currently in use.
+     */
     template<typename T>
-    auto set(const GLint program, const T & value) -> void
+    auto set(const T & value) -> void
     {
         if (m_location == NotFound || hasValue(value))
         {
@@ -45,11 +45,6 @@ public:
 
         m_value = value;
 
-        if (m_location == Unset)
-        {
-            m_location = glGetUniformLocation(program, m_name.c_str());
-        }
-
         if constexpr (std::is_same_v<T, GLboolean>)
         {
             glUniform1i(m_location, static_cast<GLint>(value));
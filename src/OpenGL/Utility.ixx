@@ -6,6 +6,7 @@ module;
 #include "glad/gl.h"
 
 export module OpenGL.Utility;
+import std;
 
 export namespace OpenGL
 {
@@ -49,4 +50,20 @@ export namespace OpenGL
                 assert(false && "Unknown format");
         }
     }
+
+    /**
+     * Must be called once the context is current.
+     */
+    auto hasExtension(const std::string_view name) -> bool
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const auto * extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension != nullptr && extension == name)
+                return true;
+        }
+        return false;
+    }
 }
@@ -10,78 +10,297 @@ import std;
 
 export namespace OpenGL
 {
+    /**
+     * Calls made through the state cache, issued to the driver or elided because the state was already set.
+     */
+    struct StateCacheStats
+    {
+        std::uint32_t issued{0};
+        std::uint32_t elided{0};
+    };
+
+    /**
+     * Shadow copy of the GL state of the context. Every bind and state change goes through it, and only reaches the
+     * driver when the value differs. Code changing the state behind its back must invalidate what it touched.
+     */
     class StateCache
     {
     public:
-        constexpr auto setActiveTexture(const GLuint unit) noexcept -> bool
+        static constexpr GLuint MaxTextureUnits = 16;
+        static constexpr GLuint MaxUniformBufferBindings = 4;
+
+    private:
+        static constexpr GLuint Unknown = std::numeric_limits<GLuint>::max();
+
+        static constexpr GLenum TextureTargets[] = {
+            GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D,
+        };
+
+        static constexpr GLenum BufferTargets[] = {
+            GL_ARRAY_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+            GL_ELEMENT_ARRAY_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_TEXTURE_BUFFER,
+            GL_TRANSFORM_FEEDBACK_BUFFER, GL_UNIFORM_BUFFER,
+        };
+
+        static constexpr GLenum Capabilities[] = {
+            GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST,
+        };
+
+        struct BufferRange
+        {
+            GLuint buffer{0};
+            GLintptr offset{0};
+            GLsizeiptr size{0};
+
+            constexpr auto operator==(const BufferRange & other) const -> bool = default;
+        };
+
+        [[nodiscard]] static constexpr auto indexOf(const std::span<const GLenum> values, const GLenum value) -> std::size_t
+        {
+            const auto index = static_cast<std::size_t>(std::ranges::find(values, value) - values.begin());
+            assert(index < values.size() && "State not tracked");
+            return index;
+        }
+
+        StateCacheStats m_stats{};
+
+        GLuint m_program{0};
+        GLuint m_vertexArray{0};
+        GLuint m_buffers[std::size(BufferTargets)]{};
+        BufferRange m_uniformBufferRanges[MaxUniformBufferBindings]{};
+        GLuint m_activeTextureUnit{0};
+        GLuint m_textures[MaxTextureUnits][std::size(TextureTargets)]{};
+        GLuint m_drawFramebuffer{0};
+        GLuint m_readFramebuffer{0};
+
+        bool m_capabilities[std::size(Capabilities)]{};
+        bool m_depthMask{true};
+        GLenum m_depthFunc{GL_LESS};
+        GLenum m_blendSource{GL_ONE};
+        GLenum m_blendDestination{GL_ZERO};
+        GLenum m_cullFace{GL_BACK};
+        GLenum m_polygonMode{GL_FILL};
+        std::array<GLint, 4> m_viewport{-1, -1, -1, -1}; // Set by the context to the window size, never elided first
+
+        template<class T>
+        constexpr auto update(T & current, const T & value) noexcept -> bool
         {
-            if (m_activeTextureUnit != unit)
+            if (current == value)
             {
-                m_activeTextureUnit = unit;
-                return true;
+                ++m_stats.elided;
+                return false;
             }
-            return false;
+            current = value;
+            ++m_stats.issued;
+            return true;
         }
 
-        constexpr auto setBoundTexture(const GLuint texture) noexcept -> bool
+    public:
+        auto useProgram(const GLuint program) -> void
+        {
+            if (update(m_program, program))
+                glUseProgram(program);
+        }
+
+        auto bindVertexArray(const GLuint vertexArray) -> void
         {
-            if (m_boundTextures[m_activeTextureUnit] != texture)
+            if (update(m_vertexArray, vertexArray))
             {
-                m_boundTextures[m_activeTextureUnit] = texture;
-                return true;
+                glBindVertexArray(vertexArray);
+                // The element array binding is part of the vertex array
+                m_buffers[indexOf(BufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = Unknown;
             }
-            return false;
         }
 
-        constexpr auto setBoundBuffer(const GLenum target, const GLuint buffer) noexcept -> bool
+        auto bindBuffer(const GLenum target, const GLuint buffer) -> void
         {
-            if (const auto it = m_boundBuffers.find(target); it->second != buffer)
+            if (update(m_buffers[indexOf(BufferTargets, target)], buffer))
+                glBindBuffer(target, buffer);
+        }
+
+        /**
+         * Also binds the buffer to the generic uniform buffer target, like GL does.
+         */
+        auto bindUniformBufferRange(const GLuint index, const GLuint buffer, const GLintptr offset,
+                                    const GLsizeiptr size) -> void
+        {
+            assert(index < MaxUniformBufferBindings);
+            if (update(m_uniformBufferRanges[index], BufferRange{buffer, offset, size}))
             {
-                it->second = buffer;
-                return true;
+                glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+                m_buffers[indexOf(BufferTargets, GL_UNIFORM_BUFFER)] = buffer;
             }
-            return false;
         }
 
-        constexpr auto invalidateBoundTexturesCache() noexcept -> void
+        /**
+         * unit is an index, not GL_TEXTURE0 + index.
+         */
+        auto activeTexture(const GLuint unit) -> void
+        {
+            assert(unit < MaxTextureUnits);
+            if (update(m_activeTextureUnit, unit))
+                glActiveTexture(GL_TEXTURE0 + unit);
+        }
+
+        /**
+         * Bind to the active texture unit, for creation and uploads.
+         */
+        auto bindTexture(const GLenum target, const GLuint texture) -> void
+        {
+            if (update(m_textures[m_activeTextureUnit][indexOf(TextureTargets, target)], texture))
+                glBindTexture(target, texture);
+        }
+
+        auto bindTexture(const GLuint unit, const GLenum target, const GLuint texture) -> void
         {
-            std::ranges::fill(m_boundTextures, 0);
+            assert(unit < MaxTextureUnits);
+            const std::size_t targetIndex = indexOf(TextureTargets, target);
+            if (m_textures[unit][targetIndex] == texture)
+            {
+                ++m_stats.elided;
+                return;
+            }
+
+            activeTexture(unit);
+            bindTexture(target, texture);
         }
 
-        constexpr auto invalidateBuffer(const GLenum target, const GLuint buffer) noexcept -> void
+        auto bindFramebuffer(const GLenum target, const GLuint framebuffer) -> void
         {
-            if (const auto it = m_boundBuffers.find(target); it->second == buffer)
+            bool changed = false;
+            if (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER)
+                changed |= m_drawFramebuffer != framebuffer;
+            if (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER)
+                changed |= m_readFramebuffer != framebuffer;
+
+            if (!changed)
             {
-                it->second = 0;
+                ++m_stats.elided;
+                return;
             }
+
+            ++m_stats.issued;
+            if (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER)
+                m_drawFramebuffer = framebuffer;
+            if (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER)
+                m_readFramebuffer = framebuffer;
+            glBindFramebuffer(target, framebuffer);
         }
 
+        auto setEnabled(const GLenum capability, const bool enabled) -> void
+        {
+            if (update(m_capabilities[indexOf(Capabilities, capability)], enabled))
+            {
+                if (enabled)
+                    glEnable(capability);
+                else
+                    glDisable(capability);
+            }
+        }
+
+        auto depthMask(const bool enabled) -> void
+        {
+            if (update(m_depthMask, enabled))
+                glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+        }
+
+        auto depthFunc(const GLenum func) -> void
+        {
+            if (update(m_depthFunc, func))
+                glDepthFunc(func);
+        }
+
+        auto blendFunc(const GLenum source, const GLenum destination) -> void
+        {
+            if (m_blendSource == source && m_blendDestination == destination)
+            {
+                ++m_stats.elided;
+                return;
+            }
+
+            ++m_stats.issued;
+            m_blendSource = source;
+            m_blendDestination = destination;
+            glBlendFunc(source, destination);
+        }
+
+        auto cullFace(const GLenum face) -> void
+        {
+            if (update(m_cullFace, face))
+                glCullFace(face);
+        }
+
+        auto polygonMode(const GLenum mode) -> void
+        {
+            if (update(m_polygonMode, mode))
+                glPolygonMode(GL_FRONT_AND_BACK, mode);
+        }
+
+        auto viewport(const GLint x, const GLint y, const GLsizei width, const GLsizei height) -> void
+        {
+            if (update(m_viewport, {x, y, width, height}))
+                glViewport(x, y, width, height);
+        }
+
+        /**
+         * Forget a deleted texture, its id may be reused.
+         */
+        constexpr auto invalidateTexture(const GLuint texture) noexcept -> void
+        {
+            for (auto & unit: m_textures)
+                std::ranges::replace(unit, texture, Unknown);
+        }
+
+        /**
+         * Forget a deleted buffer, its id may be reused.
+         */
+        constexpr auto invalidateBuffer(const GLuint buffer) noexcept -> void
+        {
+            std::ranges::replace(m_buffers, buffer, Unknown);
+            for (auto & range: m_uniformBufferRanges)
+            {
+                if (range.buffer == buffer)
+                    range.buffer = Unknown;
+            }
+        }
+
+        /**
+         * Forget the current program, after it was deleted for example.
+         */
+        constexpr auto invalidateProgram() noexcept -> void { m_program = Unknown; }
+
+        /**
+         * Forget the bound vertex array and buffers, after code binding them directly.
+         */
+        constexpr auto invalidateVertexArray() noexcept -> void
+        {
+            m_vertexArray = Unknown;
+            std::ranges::fill(m_buffers, Unknown);
+        }
+
+        constexpr auto invalidateFramebuffer(const GLuint framebuffer) noexcept -> void
+        {
+            if (m_drawFramebuffer == framebuffer)
+                m_drawFramebuffer = Unknown;
+            if (m_readFramebuffer == framebuffer)
+                m_readFramebuffer = Unknown;
+        }
+
+        [[nodiscard]] constexpr auto program() const noexcept -> GLuint { return m_program; }
+
         [[nodiscard]] constexpr auto activeTextureUnit() const noexcept -> GLuint { return m_activeTextureUnit; }
 
-        [[nodiscard]] constexpr auto boundTexture(const GLuint unit) const noexcept -> GLuint
+        [[nodiscard]] constexpr auto isEnabled(const GLenum capability) const noexcept -> bool
         {
-            return m_boundTextures[unit];
+            return m_capabilities[indexOf(Capabilities, capability)];
         }
 
-    private:
-        GLenum m_activeTextureUnit = 0;
-        GLuint m_boundTextures[GL_MAX_TEXTURE_UNITS] = {0};
-        GLuint m_boundFramebuffer = 0;
-        std::unordered_map<GLenum, GLuint> m_boundBuffers{
-            {GL_ARRAY_BUFFER, 0},
-            // {GL_ATOMIC_COUNTER_BUFFER, 0},
-            {GL_COPY_READ_BUFFER, 0},
-            {GL_COPY_WRITE_BUFFER, 0},
-            // {GL_DISPATCH_INDIRECT_BUFFER, 0},
-            {GL_DRAW_INDIRECT_BUFFER, 0},
-            {GL_ELEMENT_ARRAY_BUFFER, 0},
-            {GL_PIXEL_PACK_BUFFER, 0},
-            {GL_PIXEL_UNPACK_BUFFER, 0},
-            // {GL_QUERY_BUFFER, 0},
-            // {GL_SHADER_STORAGE_BUFFER, 0},
-            {GL_TEXTURE_BUFFER, 0},
-            {GL_TRANSFORM_FEEDBACK_BUFFER, 0},
-            {GL_UNIFORM_BUFFER, 0},
-        };
+        [[nodiscard]] constexpr auto isDepthMaskEnabled() const noexcept -> bool { return m_depthMask; }
+
+        [[nodiscard]] constexpr auto polygonMode() const noexcept -> GLenum { return m_polygonMode; }
+
+        [[nodiscard]] constexpr auto stats() const noexcept -> StateCacheStats { return m_stats; }
+
+        constexpr auto resetStats() noexcept -> void { m_stats = {}; }
     };
 }
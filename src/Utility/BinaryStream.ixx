@@ -0,0 +1,115 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module Utility.BinaryStream;
+import std;
+
+template<class T>
+concept Blittable = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>;
+
+/**
+ * Appends values to a byte blob, in host layout. Arrays are written as their size, then their elements in one copy.
+ */
+export class BinaryWriter
+{
+private:
+    std::vector<std::byte> m_data;
+
+public:
+    template<Blittable T>
+    auto write(const T & value) -> void
+    {
+        const auto bytes = std::as_bytes(std::span(&value, 1));
+        m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+    }
+
+    template<Blittable T>
+    auto writeArray(const std::span<const T> values) -> void
+    {
+        write(static_cast<std::uint64_t>(values.size()));
+        const auto bytes = std::as_bytes(values);
+        m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+    }
+
+    auto writeString(const std::string_view string) -> void
+    {
+        writeArray(std::span(string));
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_data.size(); }
+
+    [[nodiscard]] auto data() && -> std::vector<std::byte> { return std::move(m_data); }
+};
+
+/**
+ * Reads back what BinaryWriter wrote. Reading past the end fails the reader, which then only returns default values,
+ * so callers check failed() once at the end.
+ */
+export class BinaryReader
+{
+private:
+    std::span<const std::byte> m_data;
+    std::size_t m_offset{0};
+    bool m_failed{false};
+
+    [[nodiscard]] auto take(const std::size_t size) -> std::span<const std::byte>
+    {
+        if (m_failed || size > m_data.size() - m_offset)
+        {
+            m_failed = true;
+            return {};
+        }
+        const auto bytes = m_data.subspan(m_offset, size);
+        m_offset += size;
+        return bytes;
+    }
+
+public:
+    explicit BinaryReader(const std::span<const std::byte> data) : m_data(data) {}
+
+    template<Blittable T>
+    [[nodiscard]] auto read() -> T
+    {
+        T value{};
+        if (const auto bytes = take(sizeof(T)); !bytes.empty())
+            std::memcpy(&value, bytes.data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * Size of an array written by the writer. Sizes the remaining bytes cannot hold fail the reader, so a corrupted
+     * size never allocates.
+     */
+    [[nodiscard]] auto readCount(const std::size_t elementSize = 1) -> std::size_t
+    {
+        const auto count = read<std::uint64_t>();
+        if (elementSize > 0 && count > (m_data.size() - m_offset) / elementSize)
+        {
+            m_failed = true;
+            return 0;
+        }
+        return static_cast<std::size_t>(count);
+    }
+
+    template<Blittable T>
+    [[nodiscard]] auto readArray() -> std::vector<T>
+    {
+        std::vector<T> values(readCount(sizeof(T)));
+        if (const auto bytes = take(values.size() * sizeof(T)); !bytes.empty())
+            std::memcpy(values.data(), bytes.data(), bytes.size());
+        return values;
+    }
+
+    [[nodiscard]] auto readString() -> std::string
+    {
+        std::string string(readCount(), '\0');
+        if (const auto bytes = take(string.size()); !bytes.empty())
+            std::memcpy(string.data(), bytes.data(), bytes.size());
+        return string;
+    }
+
+    [[nodiscard]] auto failed() const -> bool { return m_failed; }
+
+    [[nodiscard]] auto atEnd() const -> bool { return m_offset == m_data.size(); }
+};
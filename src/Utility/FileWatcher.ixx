@@ -0,0 +1,161 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#include <cerrno>
+#include <cstdio>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+export module Utility.FileWatcher;
+import std;
+
+/**
+ * Reports which watched files changed on disk since the last poll, without ever blocking. Uses inotify on Linux,
+ * elsewhere the modification times are compared on each poll.
+ */
+export class FileWatcher
+{
+private:
+    struct WatchedFile
+    {
+        std::string path; // As given to watch(), returned by poll()
+        std::filesystem::path normalizedPath;
+        std::filesystem::file_time_type lastWriteTime;
+    };
+
+    std::vector<WatchedFile> m_files;
+
+#ifdef __linux__
+    int m_fd{-1};
+    // Directories are watched rather than files, editors often save by replacing the file
+    std::unordered_map<int, std::filesystem::path> m_directories;
+#endif
+
+    [[nodiscard]] static auto lastWriteTime(const std::filesystem::path & path) -> std::filesystem::file_time_type
+    {
+        std::error_code ec;
+        const auto time = std::filesystem::last_write_time(path, ec);
+        return ec ? std::filesystem::file_time_type::min() : time;
+    }
+
+public:
+    FileWatcher()
+    {
+#ifdef __linux__
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+            std::println(stderr, "Failed to watch files, falling back to modification times: {}",
+                         std::generic_category().message(errno));
+#endif
+    }
+
+    FileWatcher(FileWatcher && other) noexcept : m_files(std::exchange(other.m_files, {}))
+#ifdef __linux__
+                                                 , m_fd(std::exchange(other.m_fd, -1)),
+                                                 m_directories(std::exchange(other.m_directories, {}))
+#endif
+    {}
+
+    FileWatcher(const FileWatcher &) = delete;
+
+    FileWatcher & operator=(const FileWatcher &) = delete;
+
+    FileWatcher & operator=(FileWatcher && other) noexcept
+    {
+        std::swap(m_files, other.m_files);
+#ifdef __linux__
+        std::swap(m_fd, other.m_fd);
+        std::swap(m_directories, other.m_directories);
+#endif
+        return *this;
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    auto watch(const std::string_view path) -> void
+    {
+        const auto normalizedPath = std::filesystem::absolute(path).lexically_normal();
+        if (std::ranges::contains(m_files, normalizedPath, &WatchedFile::normalizedPath))
+            return;
+
+        m_files.push_back({std::string(path), normalizedPath, lastWriteTime(normalizedPath)});
+
+#ifdef __linux__
+        if (m_fd < 0)
+            return;
+
+        const auto directory = normalizedPath.parent_path();
+        if (std::ranges::contains(m_directories | std::views::values, directory))
+            return;
+
+        const int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+        {
+            std::println(stderr, "Failed to watch {}: {}", directory.string(),
+                         std::generic_category().message(errno));
+            return;
+        }
+        m_directories.emplace(wd, directory);
+#endif
+    }
+
+    /**
+     * Paths of the watched files that changed, as given to watch(), each one at most once.
+     */
+    [[nodiscard]] auto poll() -> std::vector<std::string>
+    {
+        std::vector<std::string> changed;
+        const auto markChanged = [&changed](const WatchedFile & file) {
+            if (!std::ranges::contains(changed, file.path))
+                changed.push_back(file.path);
+        };
+
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(m_fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    const auto * event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                    const auto directory = m_directories.find(event->wd);
+                    if (event->len == 0 || directory == m_directories.end())
+                        continue;
+
+                    const auto path = directory->second / event->name;
+                    const auto file = std::ranges::find(m_files, path, &WatchedFile::normalizedPath);
+                    if (file != m_files.end())
+                        markChanged(*file);
+                }
+            }
+            return changed;
+        }
+#endif
+
+        for (WatchedFile & file: m_files)
+        {
+            const auto time = lastWriteTime(file.normalizedPath);
+            if (time != file.lastWriteTime)
+            {
+                file.lastWriteTime = time;
+                markChanged(file);
+            }
+        }
+        return changed;
+    }
+};
@@ -0,0 +1,43 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+export module Utility.Hash;
+import std;
+
+/**
+ * 64-bit FNV-1a. Unlike std::hash the value is the same on every run and platform, so it can name files written to
+ * the data cache.
+ */
+export class StableHash
+{
+private:
+    std::uint64_t m_value{14695981039346656037ull};
+
+public:
+    auto add(const std::span<const std::byte> data) -> StableHash &
+    {
+        for (const auto byte: data)
+        {
+            m_value ^= static_cast<std::uint64_t>(byte);
+            m_value *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+    auto add(const std::string_view string) -> StableHash &
+    {
+        // The size separates consecutive strings, "ab" + "c" and "a" + "bc" do not collide
+        add(string.size());
+        return add(std::as_bytes(std::span(string)));
+    }
+
+    template<class T>
+        requires std::is_trivially_copyable_v<T> && (!std::is_pointer_v<T>) && (!std::is_array_v<T>)
+    auto add(const T & value) -> StableHash &
+    {
+        return add(std::as_bytes(std::span(&value, 1)));
+    }
+
+    [[nodiscard]] auto value() const -> std::uint64_t { return m_value; }
+};
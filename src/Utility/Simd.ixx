@@ -0,0 +1,644 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+module;
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+export module Utility.Simd;
+import std;
+
+/**
+ * 4 lanes of 32 bits processed by single instructions: SSE2 on x86-64 and NEON on arm64. Every CPU of these
+ * architectures has them, no -march flag is needed. Other targets run the same operations lane by lane.
+ *
+ * Loads and stores are unaligned. Comparisons return a Mask4, consumed by select(). Integer lanes are compared and
+ * converted as signed, their values must stay below 2^31.
+ */
+export struct Mask4
+{
+#if defined(SIMD_SSE2)
+    __m128 value;
+#elif defined(SIMD_NEON)
+    uint32x4_t value;
+#else
+    std::array<bool, 4> value;
+#endif
+};
+
+export struct Float4
+{
+    static constexpr std::size_t Width = 4;
+
+#if defined(SIMD_SSE2)
+    __m128 value;
+#elif defined(SIMD_NEON)
+    float32x4_t value;
+#else
+    std::array<float, 4> value;
+#endif
+
+    [[nodiscard]] inline static auto load(const float * data) -> Float4
+    {
+#if defined(SIMD_SSE2)
+        return {_mm_loadu_ps(data)};
+#elif defined(SIMD_NEON)
+        return {vld1q_f32(data)};
+#else
+        return {{data[0], data[1], data[2], data[3]}};
+#endif
+    }
+
+    [[nodiscard]] inline static auto broadcast(const float value) -> Float4
+    {
+#if defined(SIMD_SSE2)
+        return {_mm_set1_ps(value)};
+#elif defined(SIMD_NEON)
+        return {vdupq_n_f32(value)};
+#else
+        return {{value, value, value, value}};
+#endif
+    }
+
+    /**
+     * Lanes from separate values, e.g. gathered from memory.
+     */
+    [[nodiscard]] inline static auto set(const float a, const float b, const float c, const float d) -> Float4
+    {
+#if defined(SIMD_SSE2)
+        return {_mm_setr_ps(a, b, c, d)};
+#elif defined(SIMD_NEON)
+        const std::array values{a, b, c, d};
+        return {vld1q_f32(values.data())};
+#else
+        return {{a, b, c, d}};
+#endif
+    }
+
+    inline auto store(float * data) const -> void
+    {
+#if defined(SIMD_SSE2)
+        _mm_storeu_ps(data, value);
+#elif defined(SIMD_NEON)
+        vst1q_f32(data, value);
+#else
+        std::ranges::copy(value, data);
+#endif
+    }
+};
+
+export struct UInt4
+{
+    static constexpr std::size_t Width = 4;
+
+#if defined(SIMD_SSE2)
+    __m128i value;
+#elif defined(SIMD_NEON)
+    uint32x4_t value;
+#else
+    std::array<std::uint32_t, 4> value;
+#endif
+
+    [[nodiscard]] inline static auto load(const std::uint32_t * data) -> UInt4
+    {
+#if defined(SIMD_SSE2)
+        return {_mm_loadu_si128(reinterpret_cast<const __m128i *>(data))};
+#elif defined(SIMD_NEON)
+        return {vld1q_u32(data)};
+#else
+        return {{data[0], data[1], data[2], data[3]}};
+#endif
+    }
+
+    [[nodiscard]] inline static auto broadcast(const std::uint32_t value) -> UInt4
+    {
+#if defined(SIMD_SSE2)
+        return {_mm_set1_epi32(static_cast<int>(value))};
+#elif defined(SIMD_NEON)
+        return {vdupq_n_u32(value)};
+#else
+        return {{value, value, value, value}};
+#endif
+    }
+
+    inline auto store(std::uint32_t * data) const -> void
+    {
+#if defined(SIMD_SSE2)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data), value);
+#elif defined(SIMD_NEON)
+        vst1q_u32(data, value);
+#else
+        std::ranges::copy(value, data);
+#endif
+    }
+
+    [[nodiscard]] inline static auto loadUInt16(const std::uint16_t * data) -> UInt4
+    {
+#if defined(SIMD_SSE2)
+        const __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+        return {_mm_unpacklo_epi16(values, _mm_setzero_si128())};
+#elif defined(SIMD_NEON)
+        return {vmovl_u16(vld1_u16(data))};
+#else
+        return {{data[0], data[1], data[2], data[3]}};
+#endif
+    }
+
+    /**
+     * Lanes must be below 2^16.
+     */
+    inline auto storeUInt16(std::uint16_t * data) const -> void
+    {
+#if defined(SIMD_SSE2)
+        // packs saturates signed values, sign extending the low 16 bits first keeps them unchanged
+        const __m128i extended = _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(data), _mm_packs_epi32(extended, extended));
+#elif defined(SIMD_NEON)
+        vst1_u16(data, vmovn_u32(value));
+#else
+        for (std::size_t i = 0; i < 4; ++i)
+            data[i] = static_cast<std::uint16_t>(value[i]);
+#endif
+    }
+};
+
+#if !defined(SIMD_SSE2) && !defined(SIMD_NEON)
+template<class Result, class Function>
+inline auto perLane(const Function & function) -> Result
+{
+    Result result;
+    for (std::size_t i = 0; i < 4; ++i)
+        result.value[i] = function(i);
+    return result;
+}
+#endif
+
+// ********************************
+// Float4
+// ********************************
+
+export [[nodiscard]] inline auto operator+(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_add_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vaddq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return a.value[i] + b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator-(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_sub_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vsubq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return a.value[i] - b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator*(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_mul_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vmulq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return a.value[i] * b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator/(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_div_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vdivq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return a.value[i] / b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto min(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_min_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vminq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::min(a.value[i], b.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto max(const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_max_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vmaxq_f32(a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::max(a.value[i], b.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto sqrt(const Float4 a) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_sqrt_ps(a.value)};
+#elif defined(SIMD_NEON)
+    return {vsqrtq_f32(a.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::sqrt(a.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto abs(const Float4 a) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_and_ps(a.value, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)))};
+#elif defined(SIMD_NEON)
+    return {vabsq_f32(a.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::abs(a.value[i]); });
+#endif
+}
+
+/**
+ * Largest whole number not above a, |a| must be below 2^31.
+ */
+export [[nodiscard]] inline auto floor(const Float4 a) -> Float4
+{
+#if defined(SIMD_SSE2)
+    // Truncation rounds negative values up, they are moved one step down
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.value));
+    return {_mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.value), _mm_set1_ps(1.0f)))};
+#elif defined(SIMD_NEON)
+    return {vrndmq_f32(a.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::floor(a.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto operator<(const Float4 a, const Float4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_cmplt_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vcltq_f32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] < b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator>(const Float4 a, const Float4 b) -> Mask4
+{
+    return b < a;
+}
+
+export [[nodiscard]] inline auto operator<=(const Float4 a, const Float4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_cmple_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vcleq_f32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] <= b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator>=(const Float4 a, const Float4 b) -> Mask4
+{
+    return b <= a;
+}
+
+export [[nodiscard]] inline auto operator==(const Float4 a, const Float4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_cmpeq_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vceqq_f32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] == b.value[i]; });
+#endif
+}
+
+/**
+ * a in the lanes of mask, b in the others.
+ */
+export [[nodiscard]] inline auto select(const Mask4 mask, const Float4 a, const Float4 b) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_or_ps(_mm_and_ps(mask.value, a.value), _mm_andnot_ps(mask.value, b.value))};
+#elif defined(SIMD_NEON)
+    return {vbslq_f32(mask.value, a.value, b.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return mask.value[i] ? a.value[i] : b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto reduceMin(const Float4 a) -> float
+{
+#if defined(SIMD_SSE2)
+    const __m128 pairs = _mm_min_ps(a.value, _mm_shuffle_ps(a.value, a.value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(_mm_min_ps(pairs, _mm_movehl_ps(pairs, pairs)));
+#elif defined(SIMD_NEON)
+    return vminvq_f32(a.value);
+#else
+    return std::ranges::min(a.value);
+#endif
+}
+
+export [[nodiscard]] inline auto reduceMax(const Float4 a) -> float
+{
+#if defined(SIMD_SSE2)
+    const __m128 pairs = _mm_max_ps(a.value, _mm_shuffle_ps(a.value, a.value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(_mm_max_ps(pairs, _mm_movehl_ps(pairs, pairs)));
+#elif defined(SIMD_NEON)
+    return vmaxvq_f32(a.value);
+#else
+    return std::ranges::max(a.value);
+#endif
+}
+
+export [[nodiscard]] inline auto reduceAdd(const Float4 a) -> float
+{
+#if defined(SIMD_SSE2)
+    const __m128 pairs = _mm_add_ps(a.value, _mm_shuffle_ps(a.value, a.value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_movehl_ps(pairs, pairs)));
+#elif defined(SIMD_NEON)
+    return vaddvq_f32(a.value);
+#else
+    return a.value[0] + a.value[1] + a.value[2] + a.value[3];
+#endif
+}
+
+// ********************************
+// Mask4
+// ********************************
+
+export [[nodiscard]] inline auto operator&(const Mask4 a, const Mask4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_and_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vandq_u32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] && b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator|(const Mask4 a, const Mask4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_or_ps(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vorrq_u32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] || b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto any(const Mask4 mask) -> bool
+{
+#if defined(SIMD_SSE2)
+    return _mm_movemask_ps(mask.value) != 0;
+#elif defined(SIMD_NEON)
+    return vmaxvq_u32(mask.value) != 0;
+#else
+    return std::ranges::contains(mask.value, true);
+#endif
+}
+
+// ********************************
+// UInt4
+// ********************************
+
+export [[nodiscard]] inline auto operator+(const UInt4 a, const UInt4 b) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_add_epi32(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vaddq_u32(a.value, b.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] + b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator-(const UInt4 a, const UInt4 b) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_sub_epi32(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vsubq_u32(a.value, b.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] - b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator&(const UInt4 a, const UInt4 b) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_and_si128(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vandq_u32(a.value, b.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] & b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator|(const UInt4 a, const UInt4 b) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_or_si128(a.value, b.value)};
+#elif defined(SIMD_NEON)
+    return {vorrq_u32(a.value, b.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] | b.value[i]; });
+#endif
+}
+
+/**
+ * Shifts take their count as a template argument, NEON only shifts by constants.
+ */
+export template<int Bits>
+[[nodiscard]] inline auto shiftLeft(const UInt4 a) -> UInt4
+{
+    static_assert(Bits > 0 && Bits < 32);
+#if defined(SIMD_SSE2)
+    return {_mm_slli_epi32(a.value, Bits)};
+#elif defined(SIMD_NEON)
+    return {vshlq_n_u32(a.value, Bits)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] << Bits; });
+#endif
+}
+
+export template<int Bits>
+[[nodiscard]] inline auto shiftRight(const UInt4 a) -> UInt4
+{
+    static_assert(Bits > 0 && Bits < 32);
+#if defined(SIMD_SSE2)
+    return {_mm_srli_epi32(a.value, Bits)};
+#elif defined(SIMD_NEON)
+    return {vshrq_n_u32(a.value, Bits)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return a.value[i] >> Bits; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator==(const UInt4 a, const UInt4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_castsi128_ps(_mm_cmpeq_epi32(a.value, b.value))};
+#elif defined(SIMD_NEON)
+    return {vceqq_u32(a.value, b.value)};
+#else
+    return perLane<Mask4>([&](const std::size_t i) { return a.value[i] == b.value[i]; });
+#endif
+}
+
+export [[nodiscard]] inline auto operator>(const UInt4 a, const UInt4 b) -> Mask4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_castsi128_ps(_mm_cmpgt_epi32(a.value, b.value))};
+#elif defined(SIMD_NEON)
+    return {vcgtq_s32(vreinterpretq_s32_u32(a.value), vreinterpretq_s32_u32(b.value))};
+#else
+    return perLane<Mask4>([&](const std::size_t i)
+    {
+        return static_cast<std::int32_t>(a.value[i]) > static_cast<std::int32_t>(b.value[i]);
+    });
+#endif
+}
+
+export [[nodiscard]] inline auto operator<(const UInt4 a, const UInt4 b) -> Mask4
+{
+    return b > a;
+}
+
+export [[nodiscard]] inline auto select(const Mask4 mask, const UInt4 a, const UInt4 b) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    const __m128i bits = _mm_castps_si128(mask.value);
+    return {_mm_or_si128(_mm_and_si128(bits, a.value), _mm_andnot_si128(bits, b.value))};
+#elif defined(SIMD_NEON)
+    return {vbslq_u32(mask.value, a.value, b.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return mask.value[i] ? a.value[i] : b.value[i]; });
+#endif
+}
+
+// ********************************
+// Conversions
+// ********************************
+
+/**
+ * 4 interleaved triplets (x0 y0 z0 x1 ...), as one vector per component.
+ */
+export [[nodiscard]] inline auto loadTriplets(const float * data) -> std::array<Float4, 3>
+{
+#if defined(SIMD_SSE2)
+    const __m128 v0 = _mm_loadu_ps(data); // x0 y0 z0 x1
+    const __m128 v1 = _mm_loadu_ps(data + 4); // y1 z1 x2 y2
+    const __m128 v2 = _mm_loadu_ps(data + 8); // z2 x3 y3 z3
+    const __m128 x23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(0, 1, 0, 2));
+    const __m128 y01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 0, 1));
+    const __m128 y23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(0, 2, 0, 3));
+    const __m128 z01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 1, 0, 2));
+    return {Float4{_mm_shuffle_ps(v0, x23, _MM_SHUFFLE(2, 0, 3, 0))},
+            Float4{_mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0))},
+            Float4{_mm_shuffle_ps(z01, v2, _MM_SHUFFLE(3, 0, 2, 0))}};
+#elif defined(SIMD_NEON)
+    const float32x4x3_t triplets = vld3q_f32(data);
+    return {Float4{triplets.val[0]}, Float4{triplets.val[1]}, Float4{triplets.val[2]}};
+#else
+    std::array<Float4, 3> components;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        for (std::size_t c = 0; c < 3; ++c)
+            components[c].value[i] = data[i * 3 + c];
+    }
+    return components;
+#endif
+}
+
+export inline auto storeTriplets(const std::array<Float4, 3> & components, float * data) -> void
+{
+    const auto & [x, y, z] = components;
+#if defined(SIMD_SSE2)
+    const __m128 x0y0 = _mm_shuffle_ps(x.value, y.value, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 z0x1 = _mm_shuffle_ps(z.value, x.value, _MM_SHUFFLE(1, 1, 0, 0));
+    const __m128 y1z1 = _mm_shuffle_ps(y.value, z.value, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 x2y2 = _mm_shuffle_ps(x.value, y.value, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 z2x3 = _mm_shuffle_ps(z.value, x.value, _MM_SHUFFLE(3, 3, 2, 2));
+    const __m128 y3z3 = _mm_shuffle_ps(y.value, z.value, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(data, _mm_shuffle_ps(x0y0, z0x1, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(data + 4, _mm_shuffle_ps(y1z1, x2y2, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(data + 8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+#elif defined(SIMD_NEON)
+    vst3q_f32(data, float32x4x3_t{{x.value, y.value, z.value}});
+#else
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        data[i * 3] = x.value[i];
+        data[i * 3 + 1] = y.value[i];
+        data[i * 3 + 2] = z.value[i];
+    }
+#endif
+}
+
+export [[nodiscard]] inline auto toFloat(const UInt4 a) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_cvtepi32_ps(a.value)};
+#elif defined(SIMD_NEON)
+    return {vcvtq_f32_s32(vreinterpretq_s32_u32(a.value))};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return static_cast<float>(static_cast<std::int32_t>(a.value[i])); });
+#endif
+}
+
+/**
+ * Rounded toward zero, a must be within [0, 2^31).
+ */
+export [[nodiscard]] inline auto truncate(const Float4 a) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_cvttps_epi32(a.value)};
+#elif defined(SIMD_NEON)
+    return {vreinterpretq_u32_s32(vcvtq_s32_f32(a.value))};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return static_cast<std::uint32_t>(a.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto bitCast(const Float4 a) -> UInt4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_castps_si128(a.value)};
+#elif defined(SIMD_NEON)
+    return {vreinterpretq_u32_f32(a.value)};
+#else
+    return perLane<UInt4>([&](const std::size_t i) { return std::bit_cast<std::uint32_t>(a.value[i]); });
+#endif
+}
+
+export [[nodiscard]] inline auto bitCast(const UInt4 a) -> Float4
+{
+#if defined(SIMD_SSE2)
+    return {_mm_castsi128_ps(a.value)};
+#elif defined(SIMD_NEON)
+    return {vreinterpretq_f32_u32(a.value)};
+#else
+    return perLane<Float4>([&](const std::size_t i) { return std::bit_cast<float>(a.value[i]); });
+#endif
+}
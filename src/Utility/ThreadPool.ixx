@@ -0,0 +1,149 @@
+//
+// Created by Simon Cros on 3/10/26.
+//
+
+export module Utility.ThreadPool;
+import std;
+
+/**
+ * Fixed set of worker threads consuming a shared FIFO of jobs. wait() blocks until every submitted job is done,
+ * running queued jobs on the calling thread meanwhile. It must not be called from a job. The first exception thrown by
+ * a job is rethrown by wait(), once the other jobs are done.
+ */
+export class ThreadPool
+{
+public:
+    using Job = std::move_only_function<void()>;
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_jobsDone;
+    std::deque<Job> m_jobs;
+    std::size_t m_pending{0};
+    std::exception_ptr m_error;
+    bool m_stopping{false};
+    std::vector<std::jthread> m_workers;
+
+    auto popJob() -> std::optional<Job>
+    {
+        if (m_jobs.empty())
+            return std::nullopt;
+
+        auto job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        return job;
+    }
+
+    auto runJob(Job & job, std::unique_lock<std::mutex> & lock) -> void
+    {
+        lock.unlock();
+        std::exception_ptr error;
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            // Caught so the job is always counted as done, a throwing job would otherwise leave wait() blocked
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !m_error)
+            m_error = std::move(error);
+        if (--m_pending == 0)
+            m_jobsDone.notify_all();
+    }
+
+    auto workerLoop() -> void
+    {
+        std::unique_lock lock(m_mutex);
+        while (true)
+        {
+            m_jobAvailable.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping && m_jobs.empty())
+                return;
+
+            if (auto job = popJob())
+                runJob(*job, lock);
+        }
+    }
+
+public:
+    static auto defaultThreadCount() -> unsigned int
+    {
+        // Keep one core for the main thread, which also runs jobs while waiting
+        return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    explicit ThreadPool(const unsigned int threadCount = defaultThreadCount())
+    {
+        m_workers.reserve(threadCount);
+        for (unsigned int i = 0; i < threadCount; ++i)
+            m_workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobAvailable.notify_all();
+        m_workers.clear();
+    }
+
+    [[nodiscard]] auto threadCount() const -> std::size_t { return m_workers.size(); }
+
+    auto submit(Job && job) -> void
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+            ++m_pending;
+        }
+        m_jobAvailable.notify_one();
+        // A thread blocked in wait() also runs jobs
+        m_jobsDone.notify_one();
+    }
+
+    /**
+     * Run fn(i) for every i in [0, count), split in jobs of grainSize iterations, then wait().
+     */
+    template<class F>
+        requires std::invocable<F &, std::size_t>
+    auto parallelFor(const std::size_t count, const std::size_t grainSize, F && fn) -> void
+    {
+        const std::size_t grain = std::max<std::size_t>(grainSize, 1);
+        for (std::size_t begin = 0; begin < count; begin += grain)
+        {
+            const std::size_t end = std::min(begin + grain, count);
+            submit([&fn, begin, end]
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                    fn(i);
+            });
+        }
+        wait();
+    }
+
+    auto wait() -> void
+    {
+        std::unique_lock lock(m_mutex);
+        while (m_pending > 0)
+        {
+            if (auto job = popJob())
+                runJob(*job, lock);
+            else
+                m_jobsDone.wait(lock, [this] { return m_pending == 0 || !m_jobs.empty(); });
+        }
+
+        if (m_error)
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+};
@@ -4,6 +4,10 @@
 
 export module Utility;
 
+export import Utility.BinaryStream;
+export import Utility.FileWatcher;
+export import Utility.Hash;
 export import Utility.SlotSet;
 export import Utility.StridedIterator;
 export import Utility.StringUnorderedMap;
+export import Utility.ThreadPool;
@@ -0,0 +1,142 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+#include <cstdlib>
+
+import std;
+import glm;
+import Engine.AnimationSampler;
+
+namespace
+{
+    constexpr std::size_t ChannelCount = 256;
+    constexpr std::size_t KeyCount = 4096; // A bit more than 2 minutes at 30 keys per second
+    constexpr float KeyInterval = 1.0f / 30.0f;
+    constexpr float FrameInterval = 1.0f / 60.0f;
+    constexpr int RunCount = 5;
+
+    /**
+     * Key times and packed values of every channel of a clip, laid out as an Animation stores them.
+     */
+    struct Clip
+    {
+        std::vector<float> times;
+        std::vector<std::uint16_t> values;
+        std::vector<AnimationSampler> samplers;
+    };
+
+    /**
+     * Uniform clips are spaced as baked clips. The keys of the others are moved randomly by up to 30% of the interval,
+     * as key reduction leaves them.
+     */
+    auto makeClip(const bool uniform) -> Clip
+    {
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+        std::uniform_int_distribution<std::uint16_t> value;
+
+        Clip clip;
+        clip.times.resize(ChannelCount * KeyCount);
+        clip.values.resize(ChannelCount * KeyCount * 3);
+
+        for (std::size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            float * times = clip.times.data() + channel * KeyCount;
+            for (std::size_t key = 0; key < KeyCount; ++key)
+            {
+                const bool moved = !uniform && key > 0 && key < KeyCount - 1;
+                times[key] = (static_cast<float>(key) + (moved ? jitter(random) : 0.0f)) * KeyInterval;
+            }
+        }
+        std::ranges::generate(clip.values, [&] { return value(random); });
+
+        clip.samplers.reserve(ChannelCount);
+        for (std::size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            clip.samplers.emplace_back(AnimationSampler::Track{
+                .type = channel % 2 == 0 ? AnimationSampler::Type::Vec3 : AnimationSampler::Type::Quat,
+                .keyCount = KeyCount,
+                .times = clip.times.data() + channel * KeyCount,
+                .values = clip.values.data() + channel * KeyCount * 3,
+                .rangeMin = glm::vec3(-1.0f),
+                .rangeExtent = glm::vec3(2.0f),
+            });
+        }
+        return clip;
+    }
+
+    /**
+     * Nanoseconds per sample of every channel at every time, best of a few runs. Cursors start over on each run.
+     */
+    auto measure(const Clip & clip, const std::span<const float> times, const bool useCursors, float & checksum)
+        -> double
+    {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < RunCount; ++run)
+        {
+            std::vector<AnimationSampler::Cursor> cursors(ChannelCount);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (const float time: times)
+            {
+                for (std::size_t channel = 0; channel < ChannelCount; ++channel)
+                {
+                    const AnimationSampler & sampler = clip.samplers[channel];
+                    AnimationSampler::Cursor * cursor = useCursors ? &cursors[channel] : nullptr;
+                    if (sampler.type() == AnimationSampler::Type::Vec3)
+                        checksum += sampler.vec3(time, cursor).x;
+                    else
+                        checksum += sampler.quat(time, cursor).w;
+                }
+            }
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+            best = std::min(best, elapsed.count() / static_cast<double>(times.size() * ChannelCount));
+        }
+        return best;
+    }
+}
+
+/**
+ * Time keyframe lookups of long clips with many channels: a binary search per sample, the cursor kept between
+ * samples, and the direct index of uniformly spaced keys. Playback moves forward one frame at a time, seeks jump to
+ * random times and defeat the cursors.
+ */
+auto main() -> int
+{
+    const Clip varying = makeClip(false);
+    const Clip uniform = makeClip(true);
+
+    if (varying.samplers.front().isUniform() || !uniform.samplers.front().isUniform())
+    {
+        std::println(stderr, "Spacing of the generated keys was not detected as expected");
+        return EXIT_FAILURE;
+    }
+
+    const float duration = static_cast<float>(KeyCount - 1) * KeyInterval;
+    const auto frameCount = static_cast<std::size_t>(duration / FrameInterval);
+
+    std::vector<float> playback(frameCount);
+    for (std::size_t frame = 0; frame < frameCount; ++frame)
+        playback[frame] = static_cast<float>(frame) * FrameInterval;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> seekTime(0.0f, duration);
+    std::vector<float> seeks(frameCount);
+    std::ranges::generate(seeks, [&] { return seekTime(random); });
+
+    float checksum = 0;
+    std::println("{} channels of {} keys, {} samples per channel, ns per sample", ChannelCount, KeyCount, frameCount);
+    std::println("{:<30}{:>10}{:>10}", "", "playback", "seeks");
+    std::println("{:<30}{:>10.1f}{:>10.1f}", "varying spacing, upper_bound",
+                 measure(varying, playback, false, checksum), measure(varying, seeks, false, checksum));
+    std::println("{:<30}{:>10.1f}{:>10.1f}", "varying spacing, cursor",
+                 measure(varying, playback, true, checksum), measure(varying, seeks, true, checksum));
+    std::println("{:<30}{:>10.1f}{:>10.1f}", "uniform spacing",
+                 measure(uniform, playback, true, checksum), measure(uniform, seeks, true, checksum));
+
+    // Keeps the samples from being optimized out
+    std::println("checksum {}", checksum);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+//
+// Created by Simon Cros on 3/12/26.
+//
+
+#include <cstdlib>
+
+#include "stb_image.h"
+#include "tiny_gltf.h"
+
+import std;
+import DataCache;
+import Engine;
+import Engine.CookedModel;
+import Engine.CookedTexture;
+import Engine.EnvironmentBake;
+import Image;
+import Utility.ThreadPool;
+
+/**
+ * Cook a glTF file and its textures into the data cache, where the game finds them on its next load. Textures are
+ * cooked as if the driver supports S3TC, like most desktop drivers do.
+ */
+auto cook(tinygltf::TinyGLTF & loader, ThreadPool & workers, const std::filesystem::path & path)
+    -> std::expected<void, std::string>
+{
+    std::string err;
+    std::string warn;
+
+    tinygltf::Model rawModel;
+    const bool loadResult = path.extension() == ".glb"
+                                ? loader.LoadBinaryFromFile(&rawModel, &err, &warn, path.string())
+                                : loader.LoadASCIIFromFile(&rawModel, &err, &warn, path.string());
+
+    if (!loadResult)
+        return std::unexpected("failed to load model: " + std::move(err));
+
+    if (!warn.empty())
+        std::cout << "[WARN] " << warn << std::endl;
+
+    const auto cooked = Model::Cook(rawModel);
+    TRY(saveCookedModel(path, cooked));
+
+    std::atomic<size_t> failures{0};
+    for (const auto & texture: cooked.textures)
+    {
+        if (texture.image.empty())
+            continue;
+
+        workers.submit([&texture, &failures] {
+            if (const auto e_texture = loadCookedTexture(texture.image, cookSettings(texture, true, true)); !e_texture)
+            {
+                std::cerr << "Failed to cook texture: " << e_texture.error() << std::endl;
+                ++failures;
+            }
+        });
+    }
+    workers.wait();
+
+    if (failures > 0)
+        return std::unexpected(std::format("failed to cook {} textures", failures.load()));
+    return {};
+}
+
+/**
+ * Bake the lighting maps of an HDR environment on the CPU, no GPU is needed. The game loads the environment flipped
+ * vertically, it is loaded the same way so the maps match.
+ */
+auto bake(ThreadPool & workers, const std::filesystem::path & path) -> std::expected<void, std::string>
+{
+    stbi_set_flip_vertically_on_load(true);
+    auto e_image = Image::Create(path.c_str());
+    stbi_set_flip_vertically_on_load(false);
+    if (!e_image)
+        return std::unexpected(std::move(e_image).error());
+
+    return bakeEnvironment(path, *e_image, EnvironmentSettings{}, workers);
+}
+
+auto main(const int argc, char ** argv) -> int
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <model.glb|model.gltf|environment.hdr>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(keepEncodedImage, nullptr);
+    ThreadPool workers;
+
+    int status = EXIT_SUCCESS;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::filesystem::path path = argv[i];
+        std::cout << "Cooking " << argv[i] << "... " << std::flush;
+        const auto e_result = path.extension() == ".hdr" ? bake(workers, path) : cook(loader, workers, path);
+        DataCache::saveIndex();
+        if (!e_result)
+        {
+            std::cout << "FAILED" << std::endl;
+            std::cerr << "Error: " << e_result.error() << std::endl;
+            status = EXIT_FAILURE;
+            continue;
+        }
+        std::cout << "OK!" << std::endl;
+    }
+    return status;
+}
@@ -13,6 +13,9 @@ import std;
 import glm;
 import Components;
 import Engine;
+import Engine.EnvironmentBake;
+import Engine.SphericalHarmonics;
+import Engine.VertexAnimation;
 import InterfaceBlocks;
 import Window;
 import Image;
@@ -23,7 +26,8 @@ import OpenGL.Cubemap;
 import DataCache;
 import Utility.SlotSet;
 
-constexpr GLuint cubemapSize = 512;
+constexpr EnvironmentSettings environmentSettings{};
+constexpr auto hdrPath = RESOURCE_PATH"textures/skybox/san_giuseppe_bridge_1k.hdr";
 
 class Rotator : public Component
 {
@@ -39,15 +43,18 @@ public:
     }
 };
 
-auto start() -> std::expected<void, std::string>
+/**
+ * withCrowd adds a background crowd of 2000 instanced characters, a stress test of vertex animation textures.
+ */
+auto start(const bool withCrowd) -> std::expected<void, std::string>
 {
     std::cout << "42run " << FTRUN_VERSION_MAJOR << "." << FTRUN_VERSION_MINOR << std::endl;
 
     TRY_V(auto, windowContext, WindowContext::Create(4, 1));
     TRY_V(auto, window, Window::Create(WIDTH, HEIGHT, "42run"));
 
-    auto stateCache = std::make_shared<OpenGL::StateCache>();
     auto engine = Engine::Create(std::move(window));
+    auto & stateCache = engine.stateCache();
 
 
     // ********************************
@@ -68,6 +75,26 @@ auto start() -> std::expected<void, std::string>
     stbi_set_flip_vertically_on_load(true);
 
 
+    // ********************************
+    // Bake vertex animations
+    // ********************************
+
+    std::optional<VertexAnimation> crowdAnimation;
+    if (withCrowd)
+    {
+        std::cout << "Baking crowd animation... " << std::flush;
+        CacheKey crowdAnimationKey("vat", 2);
+        TRY(crowdAnimationKey.addFile(RESOURCE_PATH"models/character.glb"));
+        crowdAnimationKey.add(0).add(30);
+        TRY_V(auto, animation, VertexAnimation::Create(&stateCache, engine.workers(),
+                                                       characterMesh.get().renderInfo(),
+                                                       characterMesh.get().animations()[0], 30,
+                                                       crowdAnimationKey.path()));
+        crowdAnimation.emplace(std::move(animation));
+        std::cout << "OK!" << std::endl;
+    }
+
+
     // ********************************
     // Create shaders
     // ********************************
@@ -81,7 +108,6 @@ auto start() -> std::expected<void, std::string>
     TRY_V(const SlotSetIndex, hdrFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/hdr.frag"));
     TRY_V(const SlotSetIndex, brdfFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/brdf.frag"));
     TRY_V(const SlotSetIndex, equirectangularFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/equirectangular.frag"));
-    TRY_V(const SlotSetIndex, irradianceFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/irradiance.frag"));
     TRY_V(const SlotSetIndex, prefilterFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/prefilter.frag"));
     TRY_V(const SlotSetIndex, skyboxFragShaderIdx, engine.getShaderManager().getOrAddShaderFile(RESOURCE_PATH"shaders/skybox.frag"));
 
@@ -90,26 +116,18 @@ auto start() -> std::expected<void, std::string>
     // Create IBL resources
     // ********************************
 
-    TRY_V(auto, irradianceMap, OpenGL::Cubemap::builder(stateCache.get())
-        .internalFormat(GL_RGB32F)
-        .size(cubemapSize)
-        .baseLevel(0)
-        .maxLevel(4)
-        .debugLabel("Irradiance")
-        .build());
-
-    TRY_V(auto, prefilterMap, OpenGL::Cubemap::builder(stateCache.get())
-        .internalFormat(GL_RGB32F)
-        .size(cubemapSize)
+    TRY_V(auto, prefilterMap, OpenGL::Cubemap::builder(&stateCache)
+        .internalFormat(environmentSettings.prefilterFormat)
+        .size(environmentSettings.prefilterSize)
         .filtering(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR)
         .baseLevel(0)
-        .maxLevel(4)
+        .maxLevel(environmentSettings.prefilterMaxLevel)
         .debugLabel("Prefilter")
         .build());
 
-    TRY_V(auto, brdfTexture, OpenGL::Texture2D::builder(stateCache.get())
+    TRY_V(auto, brdfTexture, OpenGL::Texture2D::builder(&stateCache)
         .internalFormat(GL_RG16F)
-        .size(cubemapSize, cubemapSize)
+        .size(environmentSettings.cubemapSize, environmentSettings.cubemapSize)
         .debugLabel("BRDF")
         .build());
 
@@ -121,13 +139,14 @@ auto start() -> std::expected<void, std::string>
     TRY_V(const SlotSetIndex, hdrProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(texcoordVertShaderIdx, hdrFragShaderIdx, ShaderFlags::None));
     TRY_V(const SlotSetIndex, brdfProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(texcoordVertShaderIdx, brdfFragShaderIdx, ShaderFlags::None));
     TRY_V(const SlotSetIndex, eqProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(cubemapVertShaderIdx, equirectangularFragShaderIdx, ShaderFlags::None));
-    TRY_V(const SlotSetIndex, irradianceProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(cubemapVertShaderIdx, irradianceFragShaderIdx, ShaderFlags::None));
     TRY_V(const SlotSetIndex, prefilterProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(cubemapVertShaderIdx, prefilterFragShaderIdx, ShaderFlags::None));
     TRY_V(const SlotSetIndex, skyboxProgramIdx, engine.getShaderManager().getOrCreateShaderProgram(skyboxVertShaderIdx, skyboxFragShaderIdx, ShaderFlags::None));
 
     TRY(characterMesh.get().prepareShaderPrograms(engine.getShaderManager(), defaultVertShaderIdx, defaultFragShaderIdx));
     TRY(floorMesh.get().prepareShaderPrograms(engine.getShaderManager(), defaultVertShaderIdx, defaultFragShaderIdx));
     TRY(deskMesh.get().prepareShaderPrograms(engine.getShaderManager(), defaultVertShaderIdx, defaultFragShaderIdx));
+    if (crowdAnimation)
+        TRY(crowdAnimation->prepareShaderPrograms(engine.getShaderManager(), characterMesh.get().renderInfo(), defaultVertShaderIdx, defaultFragShaderIdx));
 
     // ********************************
     // Compile and link programs
@@ -135,7 +154,8 @@ auto start() -> std::expected<void, std::string>
 
     std::cout << "Compiling programs... " << std::flush;
     TRY(engine.getShaderManager().reloadAllShaders());
-    std::cout << "OK!" << std::endl;
+    std::cout << "OK! (" << engine.getShaderManager().programCacheStats().hits << " cached, "
+              << engine.getShaderManager().programCacheStats().misses << " compiled)" << std::endl;
 
 
     // ********************************
@@ -143,46 +163,57 @@ auto start() -> std::expected<void, std::string>
     // ********************************
 
     std::cout << "Building IBL... " << std::flush;
-    const bool irradianceLoaded = irradianceMap.fromCache(".cache/irradiance.cubemap", GL_RGB, GL_FLOAT);
-    const bool prefilterLoaded = prefilterMap.fromCache(".cache/prefilter.cubemap", GL_RGB, GL_FLOAT);
-    if (!irradianceLoaded || !prefilterLoaded)
+
+    // Every input of a map is part of its cache key, editing the skybox, a shader or a size rebuilds it. Maps baked
+    // ahead of time by 42run-cook are found under the same keys.
+    TRY_V(const auto, irradiancePath, irradianceCacheKey(hdrPath));
+    TRY_V(const auto, prefilterPath, prefilterCacheKey(hdrPath, environmentSettings));
+    TRY_V(const auto, brdfPath, brdfCacheKey(environmentSettings));
+
+    // Projected on the CPU, straight from the equirectangular image
+    auto irradiance = IrradianceSH::FromCache(irradiancePath);
+    const bool prefilterLoaded = prefilterMap.fromCache(prefilterPath);
+    if (!irradiance || !prefilterLoaded)
     {
-        TRY_V(auto, hdrImage, Image::Create(RESOURCE_PATH"textures/skybox/san_giuseppe_bridge_1k.hdr"));
-        TRY_V(auto, hdrTexture, OpenGL::Texture2D::builder(stateCache.get())
-            .internalFormat(GL_RGB32F)
-            .size(hdrImage.width(), hdrImage.height())
-            .debugLabel("Equirectangular Skybox")
-            .build());
-        TRY_V(auto, cubemap, OpenGL::Cubemap::builder(stateCache.get())
-            .internalFormat(GL_RGB32F)
-            .size(cubemapSize)
-            .debugLabel("Skybox")
-            .build());
-
-        hdrTexture.fromRaw(hdrImage.glFormat(), hdrImage.glType(), hdrImage.data());
-        TRY(cubemap.fromEquirectangular(engine.getShaderManager().getProgram(eqProgramIdx), hdrTexture));
-
-        if (!irradianceLoaded)
+        TRY_V(auto, hdrImage, Image::Create(hdrPath));
+
+        if (!irradiance)
         {
-            TRY(irradianceMap.fromCubemap(engine.getShaderManager().getProgram(irradianceProgramIdx), cubemap, 0));
-            TRY(irradianceMap.saveCache(".cache/irradiance.cubemap", GL_RGB, GL_FLOAT));
+            TRY_V(const auto, projected, IrradianceSH::Project(hdrImage, engine.workers()));
+            TRY_LOG(projected.saveCache(irradiancePath));
+            irradiance = projected;
         }
 
         if (!prefilterLoaded)
         {
+            TRY_V(auto, hdrTexture, OpenGL::Texture2D::builder(&stateCache)
+                .internalFormat(GL_RGB32F)
+                .size(hdrImage.width(), hdrImage.height())
+                .debugLabel("Equirectangular Skybox")
+                .build());
+            TRY_V(auto, cubemap, OpenGL::Cubemap::builder(&stateCache)
+                .internalFormat(GL_RGB32F)
+                .size(environmentSettings.cubemapSize)
+                .debugLabel("Skybox")
+                .build());
+
+            hdrTexture.fromRaw(hdrImage.glFormat(), hdrImage.glType(), hdrImage.data());
+            TRY(cubemap.fromEquirectangular(engine.getShaderManager().getProgram(eqProgramIdx), hdrTexture));
+
             TRY(prefilterMap.fromCubemap(engine.getShaderManager().getProgram(prefilterProgramIdx), cubemap, 0));
             TRY(prefilterMap.fromCubemap(engine.getShaderManager().getProgram(prefilterProgramIdx), cubemap, 1));
             TRY(prefilterMap.fromCubemap(engine.getShaderManager().getProgram(prefilterProgramIdx), cubemap, 2));
             TRY(prefilterMap.fromCubemap(engine.getShaderManager().getProgram(prefilterProgramIdx), cubemap, 3));
             TRY(prefilterMap.fromCubemap(engine.getShaderManager().getProgram(prefilterProgramIdx), cubemap, 4));
-            TRY(prefilterMap.saveCache(".cache/prefilter.cubemap", GL_RGB, GL_FLOAT));
+            TRY(prefilterMap.saveCache(prefilterPath));
         }
     }
+    engine.setIrradiance(*irradiance);
 
-    if (!brdfTexture.fromCache(".cache/brdf.texture2d", GL_RG, GL_HALF_FLOAT))
+    if (!brdfTexture.fromCache(brdfPath, GL_RG, GL_HALF_FLOAT))
     {
         TRY(brdfTexture.fromShader(engine.getShaderManager().getProgram(brdfProgramIdx)));
-        TRY_LOG(brdfTexture.saveCache(".cache/brdf.texture2d", GL_RG, GL_HALF_FLOAT));
+        TRY_LOG(brdfTexture.saveCache(brdfPath, GL_RG, GL_HALF_FLOAT));
     }
     std::cout << "OK!" << std::endl;
 
@@ -198,12 +229,12 @@ auto start() -> std::expected<void, std::string>
 
     {
         auto & object = engine.instantiate();
-        object.addComponent<SkyboxRenderer>(engine, irradianceMap);
+        object.addComponent<SkyboxRenderer>(engine, prefilterMap);
     }
 
     // {
     //     auto & object = engine.instantiate();
-    //     object.addComponent<MeshRenderer>(*e_spheresMesh, irradianceMap, prefilterMap, brdfTexture);
+    //     object.addComponent<MeshRenderer>(*e_spheresMesh, prefilterMap, brdfTexture);
     // }
     //
     // {
@@ -219,14 +250,13 @@ auto start() -> std::expected<void, std::string>
     // }
 
     auto & map = engine.instantiate();
-    map.addComponent<MapController>(irradianceMap, prefilterMap, brdfTexture);
+    map.addComponent<MapController>(prefilterMap, brdfTexture);
 
     {
         // Ancient
         auto & object = engine.instantiate();
         auto & animator = object.addComponent<Animator>(characterMesh);
-        auto & meshRenderer = object.addComponent<MeshRenderer>(characterMesh, irradianceMap, prefilterMap,
-                                                                brdfTexture);
+        auto & meshRenderer = object.addComponent<MeshRenderer>(characterMesh, prefilterMap, brdfTexture);
         auto & ui = object.addComponent<UserInterface>("Character");
         ui.addBlock<DisplayInterfaceBlock>(1);
         ui.addBlock<AnimationInterfaceBlock>(2);
@@ -237,6 +267,25 @@ auto start() -> std::expected<void, std::string>
         animator.setAnimation(0);
     }
 
+    if (crowdAnimation)
+    {
+        // Background crowd, a single instanced draw per primitive
+        auto & object = engine.instantiate();
+        object.transform().setTranslation({0, 0, 20});
+        auto & crowd = object.addComponent<CrowdRenderer>(characterMesh, *crowdAnimation, prefilterMap, brdfTexture);
+
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> timeOffset(0, crowdAnimation->duration());
+        for (int x = -25; x < 25; ++x)
+        {
+            for (int z = 0; z < 40; ++z)
+            {
+                crowd.addInstance(glm::translate(glm::identity<glm::mat4>(), glm::vec3(x * 1.5f, 0, z * 1.5f)),
+                                  timeOffset(random));
+            }
+        }
+    }
+
     {
         // Camera
         auto & object = engine.instantiate();
@@ -254,12 +303,18 @@ auto start() -> std::expected<void, std::string>
     // Run game loop
     // ********************************
 
+    // Assets are loaded, what they cooked and baked is recorded once
+    DataCache::saveIndex();
     return engine.run();
 }
 
-auto main() -> int
+auto main(const int argc, char ** argv) -> int
 {
-    auto e_result = start();
+    bool withCrowd = false;
+    for (int i = 1; i < argc; ++i)
+        withCrowd |= std::string_view(argv[i]) == "--crowd";
+
+    auto e_result = start(withCrowd);
     if (!e_result)
     {
         std::cerr << "Error: " << e_result.error() << std::endl;